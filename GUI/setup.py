@@ -8,7 +8,10 @@ setup(ext_modules=cythonize(
         "./src/masks.cpp",
         "./src/bits.cpp",
         "./src/piece.cpp",
-        "./src/game.cpp"
+        "./src/game.cpp",
+        "./src/zobrist.cpp",
+        "./src/psqt.cpp",
+        "./src/nnue.cpp"
         ],
         language="c++",
         extra_compile_args=["/O2", "/std:c++17"],
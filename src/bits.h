@@ -60,4 +60,55 @@ const uint64_t debruijn64 = uint64_t(0x03f79d71b4cb0a89);
  */
 inline uint8_t bitScanForward(Bitboard bb) {
    return index64[((bb ^ (bb-1)) * debruijn64) >> 58];
-}
\ No newline at end of file
+}
+
+//Pawn structure fills
+
+//Smears every bit up or down to the edge of the board, keeping the bits themselves
+inline Bitboard north_fill(Bitboard bb) {
+    bb |= bb << 8;
+    bb |= bb << 16;
+    bb |= bb << 32;
+    return bb;
+}
+
+inline Bitboard south_fill(Bitboard bb) {
+    bb |= bb >> 8;
+    bb |= bb >> 16;
+    bb |= bb >> 32;
+    return bb;
+}
+
+//Every square on a file with a bit on it
+inline Bitboard file_fill(Bitboard bb) {
+    return north_fill(bb) | south_fill(bb);
+}
+
+//Shift one file over without wrapping around to the other side of the board
+inline Bitboard east_one(Bitboard bb) {
+    return (bb << 1) & ~Bitboard(0x101010101010101);
+}
+
+inline Bitboard west_one(Bitboard bb) {
+    return (bb >> 1) & ~Bitboard(0x8080808080808080);
+}
+
+//Squares in front of each pawn, not including the pawn. North is white's forward direction
+inline Bitboard north_front_span(Bitboard pawns) {
+    return north_fill(pawns) << 8;
+}
+
+inline Bitboard south_front_span(Bitboard pawns) {
+    return south_fill(pawns) >> 8;
+}
+
+//Squares the pawns attack now or could attack later by pushing
+inline Bitboard north_attack_span(Bitboard pawns) {
+    Bitboard span = north_front_span(pawns);
+    return east_one(span) | west_one(span);
+}
+
+inline Bitboard south_attack_span(Bitboard pawns) {
+    Bitboard span = south_front_span(pawns);
+    return east_one(span) | west_one(span);
+}
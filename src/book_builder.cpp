@@ -0,0 +1,337 @@
+#include "book_builder.h"
+#include "external_sort.h"
+#include "mapped_file.h"
+#include "pgn.h"
+#include "polyglot.h"
+#include "training.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+using std::cout;
+
+namespace {
+    //Results after one move from one position, from the point of view of the side that played it
+    struct Record {
+        uint64_t key;
+        uint16_t move; //Polyglot encoding, never 0 for a real move so 0 marks an empty slot
+        uint16_t unused;
+        uint32_t wins;
+        uint32_t draws;
+        uint32_t losses;
+    };
+
+    constexpr size_t MAX_LOAD_NUMERATOR = 3; //Tables spill when they're 3/4 full
+    constexpr size_t MAX_LOAD_DENOMINATOR = 4;
+
+    //Open addressing hash table counting the results of each (key, move) pair
+    class Table {
+      public:
+        explicit Table(size_t capacity) : slots(capacity), mask(capacity - 1) {}
+
+        inline void add(uint64_t key, uint16_t move, int result) {
+            size_t index = (key ^ (uint64_t(move) * 0x9E3779B97F4A7C15)) & mask;
+            while (slots[index].move && (slots[index].key != key || slots[index].move != move)) {
+                index = (index + 1) & mask;
+            }
+
+            Record &record = slots[index];
+            if (!record.move) {
+                record.key = key;
+                record.move = move;
+                used++;
+            }
+            (result > 0 ? record.wins : result < 0 ? record.losses : record.draws)++;
+        }
+
+        inline bool full() const {
+            return used * MAX_LOAD_DENOMINATOR > slots.size() * MAX_LOAD_NUMERATOR;
+        }
+
+        inline size_t size() const {
+            return used;
+        }
+
+        //Moves every record to the end of out and empties the table
+        void drain(std::vector<Record> &out) {
+            for (Record &record : slots) {
+                if (record.move) {
+                    out.push_back(record);
+                    record = Record{};
+                }
+            }
+            used = 0;
+        }
+
+      private:
+        std::vector<Record> slots;
+        size_t mask;
+        size_t used = 0;
+    };
+
+    //Per-thread state, padded so threads don't share cache lines
+    struct alignas(64) ThreadState {
+        std::unique_ptr<Table> table;
+
+        //Position before the one being decoded, for training data which gives the move that led to a position
+        uint64_t last_key = 0;
+        Color last_color = WHITE;
+        bool last_counted = false;
+    };
+
+    //Takes records in key order, adds up the ones for the same move and writes each position's entries
+    class BookWriter {
+      public:
+        BookWriter(std::ostream &out, uint32_t min_games) : out(out), min_games(min_games) {}
+
+        void add(const Record &record) {
+            if (!group.empty() && group.front().key != record.key) {
+                flush();
+            }
+            for (Record &same : group) {
+                if (same.move == record.move) {
+                    same.wins += record.wins;
+                    same.draws += record.draws;
+                    same.losses += record.losses;
+                    return;
+                }
+            }
+            group.push_back(record);
+        }
+
+        //Polyglot weights are 16 bits, so a position's weights are scaled down together if the biggest doesn't fit
+        void flush() {
+            std::vector<std::pair<uint64_t, uint16_t>> weights; //Weight and move
+            uint64_t max_weight = 0;
+            for (const Record &record : group) {
+                if (uint64_t(record.wins) + record.draws + record.losses < min_games) {
+                    continue;
+                }
+                const uint64_t weight = 2 * uint64_t(record.wins) + record.draws;
+                weights.emplace_back(weight, record.move);
+                max_weight = std::max(max_weight, weight);
+            }
+
+            //Ties go by move so the book doesn't depend on which thread saw a move first
+            std::sort(weights.begin(), weights.end(), [](const auto &a, const auto &b) {
+                return a.first > b.first || (a.first == b.first && a.second < b.second);
+            });
+            for (auto [weight, move] : weights) {
+                if (max_weight > UINT16_MAX) {
+                    weight = weight * UINT16_MAX / max_weight;
+                }
+                if (!weight) {
+                    continue; //Never played from a book anyway
+                }
+
+                unsigned char bytes[Polyglot::ENTRY_SIZE] = {};
+                for (int i = 0; i < 8; i++) {
+                    bytes[i] = uint8_t(group.front().key >> (56 - 8 * i));
+                }
+                bytes[8] = uint8_t(move >> 8);
+                bytes[9] = uint8_t(move);
+                bytes[10] = uint8_t(weight >> 8);
+                bytes[11] = uint8_t(weight);
+                out.write(reinterpret_cast<const char*>(bytes), sizeof(bytes));
+                written++;
+            }
+            group.clear();
+        }
+
+        uint64_t entries() const {
+            return written;
+        }
+
+      private:
+        std::ostream &out;
+        uint32_t min_games;
+        std::vector<Record> group; //Records for the position being added
+        uint64_t written = 0;
+    };
+
+    //Sorts what's in a thread's table and appends it to the thread's run file
+    void spill_table(ExternalSort::Runs<Record> &runs, ThreadState &state, size_t thread) {
+        std::vector<Record> records;
+        records.reserve(state.table->size());
+        state.table->drain(records);
+        runs.spill(thread, records);
+    }
+}
+
+namespace BookBuilder {
+    bool build(const std::string &path, const Options &options, Stats &stats) {
+        const size_t threads = std::max<size_t>(options.threads, 1);
+        const bool pgn = path.size() >= 4 && path.compare(path.size() - 4, 4, ".pgn") == 0;
+        MappedFile file;
+        if (!file.open(path)) {
+            cout << "Unable to open \"" << path << "\".\n";
+            return false;
+        }
+
+        //Largest power of two number of slots that fits in each thread's share of the memory
+        size_t capacity = 1024;
+        while (capacity * 2 * sizeof(Record) * threads <= options.memory * 1024 * 1024) {
+            capacity *= 2;
+        }
+
+        std::vector<ThreadState> states(threads);
+        for (ThreadState &state : states) {
+            state.table = std::make_unique<Table>(capacity);
+        }
+        ExternalSort::Runs<Record> runs(options.out, threads);
+        std::vector<uint64_t> positions(threads * 8); //Strided so threads don't share cache lines
+
+        auto count = [&](ThreadState &state, size_t thread, uint64_t key, Move move, Color color, int result) {
+            state.table->add(key, Polyglot::encodeMove(move), color == WHITE ? result : -result);
+            positions[thread * 8]++;
+            if (state.table->full()) {
+                spill_table(runs, state, thread);
+            }
+        };
+
+        if (pgn) {
+            PGN::Options pgn_options;
+            pgn_options.threads = threads;
+            pgn_options.max_plies = options.max_plies;
+            auto callback = [&](const PGN::Position &position) {
+                if (position.move == Move() || position.info.result == PGN::UNKNOWN_RESULT) {
+                    return;
+                }
+                const int result = position.info.result == PGN::WHITE_WIN ? 1 : position.info.result == PGN::BLACK_WIN ? -1 : 0;
+                count(states[position.thread], position.thread, position.game.getPolyglotKey(position.color), position.move, position.color, result);
+            };
+            const PGN::Stats pgn_stats = PGN::replay(file.view(), pgn_options, callback);
+            stats.games = pgn_stats.games;
+            stats.errors = pgn_stats.errors;
+        } else {
+            //Training data gives the move that led to each position, so it's counted for the position before
+            auto callback = [&](const Training::Position &position) {
+                ThreadState &state = states[position.thread];
+                if (position.played != Move() && state.last_counted) {
+                    count(state, position.thread, state.last_key, position.played, state.last_color, position.result);
+                }
+                if (position.played == Move()) {
+                    positions[position.thread * 8 + 1]++; //Start of a chain
+                }
+                state.last_counted = position.ply < options.max_plies;
+                if (state.last_counted) {
+                    state.last_key = position.game.getPolyglotKey(position.color);
+                    state.last_color = position.color;
+                }
+            };
+            const Training::Stats data_stats = Training::read(file.view(), threads, callback);
+            for (size_t i = 0; i < threads; i++) {
+                stats.games += positions[i * 8 + 1];
+            }
+            stats.errors = data_stats.errors;
+        }
+        for (size_t i = 0; i < threads; i++) {
+            stats.positions += positions[i * 8];
+        }
+
+        std::ofstream out(options.out, std::ios::binary);
+        if (!out) {
+            cout << "Unable to open \"" << options.out << "\".\n";
+            return false;
+        }
+        BookWriter writer(out, options.min_games);
+
+        bool merged = true;
+        if (!runs.count()) {
+            //Everything fit in memory, so the tables are sorted together in one go
+            std::vector<Record> records;
+            size_t total = 0;
+            for (const ThreadState &state : states) {
+                total += state.table->size();
+            }
+            records.reserve(total);
+            for (ThreadState &state : states) {
+                state.table->drain(records);
+                state.table.reset();
+            }
+            ExternalSort::radixSort(records, threads);
+            for (const Record &record : records) {
+                writer.add(record);
+            }
+        } else {
+            //What's left in the tables becomes the last runs, then every run is merged
+            ExternalSort::runParallel(threads, [&](size_t thread) {
+                if (states[thread].table->size()) {
+                    spill_table(runs, states[thread], thread);
+                }
+                states[thread].table.reset();
+            });
+            stats.runs = runs.count();
+            merged = runs.merge(options.memory * 1024 * 1024, [&](const Record &record) {
+                writer.add(record);
+            });
+            runs.clear();
+        }
+
+        writer.flush();
+        stats.entries = writer.entries();
+        if (!merged) {
+            cout << "Unable to read back the spilled runs.\n";
+        }
+        return merged && bool(out);
+    }
+
+    int command(std::istringstream &stream) {
+        Options options;
+        std::string path, keys_path;
+        std::string arg, value;
+        while (stream >> std::skipws >> arg) {
+            stream >> value;
+            try {
+                if (arg == "file") {
+                    path = value;
+                } else if (arg == "out") {
+                    options.out = value;
+                } else if (arg == "threads") {
+                    options.threads = std::stoull(value);
+                } else if (arg == "plies") {
+                    options.max_plies = std::max(std::stoi(value), 1);
+                } else if (arg == "memory") {
+                    options.memory = std::max<size_t>(std::stoull(value), 1);
+                } else if (arg == "min") {
+                    options.min_games = uint32_t(std::stoul(value));
+                } else if (arg == "keys") {
+                    keys_path = value;
+                } else {
+                    cout << "Unknown option \"" << arg << "\".\n";
+                    return 1;
+                }
+            } catch (std::invalid_argument) {
+                cout << "Invalid value for " << arg << ". \"" << value << "\" was recived.\n";
+                return 1;
+            }
+        }
+
+        if (path.empty() || options.out.empty()) {
+            cout << "Both file and out are needed.\n";
+            return 1;
+        }
+        if (!keys_path.empty() && !Polyglot::loadKeys(keys_path)) {
+            cout << "Unable to read " << Polyglot::KEY_COUNT << " keys from \"" << keys_path << "\".\n";
+            return 1;
+        }
+
+        Stats stats;
+        const auto start = std::chrono::steady_clock::now();
+        if (!build(path, options, stats)) {
+            return 1;
+        }
+        const int64_t time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+
+        cout << "Games: " << stats.games << " in " << time << " ms (" << uint64_t(stats.games * 60000 / std::max<int64_t>(time, 1)) << " games/min)\n";
+        cout << "Positions: " << stats.positions << '\n';
+        cout << "Errors: " << stats.errors << '\n';
+        cout << "Runs spilled: " << stats.runs << '\n';
+        cout << "Entries: " << stats.entries << '\n';
+        cout << "Book written to " << options.out << std::endl;
+        return 0;
+    }
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include "game.h"
+#include <sstream>
+#include <string>
+
+//Builds Polyglot opening books from PGN files or training data
+//
+//Each thread replays its share of the games and counts the wins, draws and losses after every (position, move) pair
+//in its own hash table. When a table gets past its share of the memory it's radix sorted by key and spilled to disk
+//as a run. At the end the tables are radix sorted together across all the threads, or merged with the spilled runs,
+//and written out in key order with each move's weight worked out from its results
+namespace BookBuilder {
+    struct Options {
+        size_t threads = 1;
+        int max_plies = 32; //Only positions this close to the start of the game go in the book
+        size_t memory = 1024; //Megabytes for the counting tables of all the threads together
+        uint32_t min_games = 1; //Moves played fewer times than this are left out
+        std::string out;
+    };
+
+    struct Stats {
+        uint64_t games = 0;
+        uint64_t positions = 0; //Positions counted towards the book
+        uint64_t errors = 0; //From reading the games
+        uint64_t runs = 0; //Tables spilled to disk
+        uint64_t entries = 0; //Written to the book
+    };
+
+    //Reads games from path, a PGN file if it ends in .pgn and training data otherwise
+    //Plies are counted from the start of the game, also for training data chains that start mid-game
+    //Books are keyed with the current Polyglot keys, the standard Random64 table unless Polyglot::loadKeys replaced it
+    //Returns false if a file can't be opened
+    bool build(const std::string &path, const Options &options, Stats &stats);
+
+    //Command line entry point. Reads options as name value pairs like UCI:
+    //file <games> out <book> threads <n> plies <n> memory <mb> min <n> keys <Random64 file>
+    int command(std::istringstream &stream);
+}
@@ -0,0 +1,76 @@
+#include "evaluate.h"
+#include "psqt.h"
+#include "nnue.h"
+#include "pawns.h"
+
+namespace {
+    //Mobility bonus per square as {middlegame, endgame}, indexed by PieceType
+    //Counted relative to a typical number of squares so the bonus doesn't change what the pieces are worth
+    constexpr int MOBILITY_MG[8] = {0, 0, 4, 5, 2, 1, 0, 0};
+    constexpr int MOBILITY_EG[8] = {0, 0, 4, 5, 4, 2, 0, 0};
+    constexpr int TYPICAL_MOBILITY[8] = {0, 0, 4, 6, 6, 12, 0, 0};
+
+    //Middlegame penalty per attacked king zone square, by how many pieces are attacking it
+    constexpr int KING_ATTACK_WEIGHT[8] = {0, 0, 8, 16, 24, 30, 36, 40};
+
+    //Tapered score from white's point of view, with mg and eg holding any extra terms to add in
+    int classical(const Chess &game, int mg, int eg) {
+        //The piece square sums and the phase are kept up to date by makeMove
+        int phase = std::min(game.getPhase(), PSQT::MAX_PHASE);
+        mg += game.getMidgame();
+        eg += game.getEndgame();
+
+        const Pawns::Entry &pawns = Pawns::probe(game);
+        mg += pawns.mg;
+        eg += pawns.eg;
+
+        //Pawn shields only count while the king is still on its first two ranks
+        const Square white_king = bitScanForward(game.getBitboard(WhiteKing));
+        const Square black_king = bitScanForward(game.getBitboard(BlackKing));
+        if (white_king < 16) {
+            mg += pawns.shield[WHITE][white_king & 0b111];
+        }
+        if (black_king >= 48) {
+            mg -= pawns.shield[BLACK][black_king & 0b111];
+        }
+
+        //Blend between the middlegame and endgame scores by how much material is left
+        return (mg * phase + eg * (PSQT::MAX_PHASE - phase)) / PSQT::MAX_PHASE;
+    }
+}
+
+namespace Eval {
+    int evaluate(const Chess &game, Color color) {
+        //Games with accumulators attached use the network
+        if (game.getAccumulators()) {
+            return NNUE::evaluate(game, color);
+        }
+
+        int score = classical(game, 0, 0);
+        return color == WHITE ? score : -score;
+    }
+
+    int evaluate(const Chess &game, Color color, const AttackInfo &attacks) {
+        if (game.getAccumulators()) {
+            return NNUE::evaluate(game, color);
+        }
+
+        int mg = 0;
+        int eg = 0;
+        for (Color side : {WHITE, BLACK}) {
+            const int sign = side == WHITE ? 1 : -1;
+            for (PieceType piece : {Knight, Bishop, Rook, Queen}) {
+                const int count = pop_count(game.getBitboard(makePiece(piece, side)));
+                const int mobility = attacks.mobility[side][piece] - count * TYPICAL_MOBILITY[piece];
+                mg += sign * mobility * MOBILITY_MG[piece];
+                eg += sign * mobility * MOBILITY_EG[piece];
+            }
+
+            //Attacks on the enemy king only matter in the middlegame
+            mg += sign * attacks.king_zone_attacks[side] * KING_ATTACK_WEIGHT[std::min(attacks.king_attackers[side], 7)];
+        }
+
+        int score = classical(game, mg, eg);
+        return color == WHITE ? score : -score;
+    }
+}
@@ -0,0 +1,10 @@
+#pragma once
+#include "game.h"
+
+namespace Eval {
+    //Static evaluation in centipawns from the point of view of the side to move
+    int evaluate(const Chess &game, Color color);
+
+    //Same but adds mobility and king safety, using the attack maps from Chess::getMovesAndAttacks
+    int evaluate(const Chess &game, Color color, const AttackInfo &attacks);
+}
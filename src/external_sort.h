@@ -0,0 +1,220 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <queue>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+//Sorting records by a 64 bit key when there may be more of them than fit in memory, for building books and indices
+//Records have to be trivially copyable with a uint64_t member called key, since runs are written to disk as raw bytes
+namespace ExternalSort {
+    constexpr size_t MIN_READ_BUFFER = 1024; //Records read at a time from each run while merging
+
+    //Runs fn(0) to fn(threads - 1) at once, fn(0) on the calling thread
+    template<typename Function>
+    void runParallel(size_t threads, const Function &fn) {
+        std::vector<std::thread> helpers;
+        for (size_t i = 1; i < threads; i++) {
+            helpers.emplace_back(fn, i);
+        }
+        fn(0);
+        for (std::thread &helper : helpers) {
+            helper.join();
+        }
+    }
+
+    //Stable LSD radix sort on the key a byte at a time. Each thread counts and then scatters its own slice,
+    //so the only serial part is adding up the 256 counts of every thread in between
+    template<typename Record>
+    void radixSort(std::vector<Record> &records, size_t threads) {
+        const size_t size = records.size();
+        threads = std::clamp<size_t>(size / 65536, 1, std::max<size_t>(threads, 1)); //Not worth a thread for less
+        std::vector<Record> buffer(size);
+        std::vector<std::array<size_t, 256>> counts(threads);
+        auto slice_begin = [&](size_t thread) {
+            return size * thread / threads;
+        };
+
+        for (int shift = 0; shift < 64; shift += 8) {
+            runParallel(threads, [&](size_t thread) {
+                counts[thread].fill(0);
+                for (size_t i = slice_begin(thread); i < slice_begin(thread + 1); i++) {
+                    counts[thread][(records[i].key >> shift) & 0xFF]++;
+                }
+            });
+
+            //Each thread's counts become where it writes its first record of each digit
+            size_t offset = 0;
+            bool all_same = false;
+            for (int digit = 0; digit < 256; digit++) {
+                const size_t start = offset;
+                for (size_t thread = 0; thread < threads; thread++) {
+                    const size_t count = counts[thread][digit];
+                    counts[thread][digit] = offset;
+                    offset += count;
+                }
+                all_same |= offset - start == size;
+            }
+            if (all_same) {
+                continue; //Every key has the same byte here so the order wouldn't change
+            }
+
+            runParallel(threads, [&](size_t thread) {
+                for (size_t i = slice_begin(thread); i < slice_begin(thread + 1); i++) {
+                    buffer[counts[thread][(records[i].key >> shift) & 0xFF]++] = records[i];
+                }
+            });
+            records.swap(buffer);
+        }
+    }
+
+    //Sorted runs spilled to disk, one file for each thread so threads can spill without locking
+    template<typename Record>
+    class Runs {
+      public:
+        Runs(const std::string &prefix, size_t threads) : files(threads) {
+            for (size_t i = 0; i < threads; i++) {
+                files[i].path = prefix + ".run" + std::to_string(i);
+            }
+        }
+
+        ~Runs() {
+            clear();
+        }
+
+        //Sorts records and appends them to the thread's file as a run. Only that thread may call this for it
+        void spill(size_t thread, std::vector<Record> &records) {
+            File &file = files[thread];
+            radixSort(records, 1);
+            if (!file.out.is_open()) {
+                file.out.open(file.path, std::ios::binary | std::ios::trunc);
+            }
+            file.out.write(reinterpret_cast<const char*>(records.data()), std::streamsize(records.size() * sizeof(Record)));
+            file.runs.push_back(Run{file.written, records.size()});
+            file.written += records.size();
+            records.clear();
+        }
+
+        //Number of runs so far. Not safe to call while threads are spilling
+        size_t count() const {
+            size_t runs = 0;
+            for (const File &file : files) {
+                runs += file.runs.size();
+            }
+            return runs;
+        }
+
+        //Hands every record of every run to output in key order, reading about memory bytes at a time altogether
+        //Returns false if a run couldn't be read back
+        template<typename Output>
+        bool merge(size_t memory, const Output &output) {
+            const size_t runs = std::max<size_t>(count(), 1);
+            const size_t buffer_size = std::max(MIN_READ_BUFFER, memory / sizeof(Record) / runs);
+
+            std::vector<Reader> readers;
+            std::vector<std::ifstream> inputs(files.size());
+            for (size_t i = 0; i < files.size(); i++) {
+                files[i].out.close();
+                if (!files[i].runs.empty()) {
+                    inputs[i].open(files[i].path, std::ios::binary);
+                }
+                for (const Run &run : files[i].runs) {
+                    readers.emplace_back(inputs[i], run, buffer_size);
+                }
+            }
+
+            //Smallest key first
+            typedef std::pair<Record, size_t> Head;
+            auto later = [](const Head &a, const Head &b) {
+                return a.first.key > b.first.key;
+            };
+            std::priority_queue<Head, std::vector<Head>, decltype(later)> heads(later);
+            Record record;
+            for (size_t i = 0; i < readers.size(); i++) {
+                if (readers[i].next(record)) {
+                    heads.emplace(record, i);
+                }
+            }
+            while (!heads.empty()) {
+                const auto [top, reader] = heads.top();
+                heads.pop();
+                output(top);
+                if (readers[reader].next(record)) {
+                    heads.emplace(record, reader);
+                }
+            }
+
+            bool failed = false;
+            for (const Reader &reader : readers) {
+                failed |= reader.failed;
+            }
+            return !failed;
+        }
+
+        //Deletes the run files
+        void clear() {
+            for (File &file : files) {
+                if (file.out.is_open() || !file.runs.empty()) {
+                    file.out.close();
+                    std::remove(file.path.c_str());
+                }
+                file.runs.clear();
+                file.written = 0;
+            }
+        }
+
+      private:
+        struct Run {
+            uint64_t offset; //In records
+            uint64_t count;
+        };
+
+        struct File {
+            std::string path;
+            std::ofstream out;
+            std::vector<Run> runs;
+            uint64_t written = 0; //Records in the file
+        };
+
+        //Reads one run back a buffer at a time. Runs from the same thread share its file and seek before each read
+        struct Reader {
+            Reader(std::ifstream &file, const Run &run, size_t buffer_size) :
+                file(file), offset(run.offset), remaining(run.count), buffer_size(buffer_size) {}
+
+            bool next(Record &record) {
+                if (pos == buffer.size()) {
+                    if (!remaining) {
+                        return false;
+                    }
+                    buffer.resize(std::min<uint64_t>(remaining, buffer_size));
+                    file.seekg(std::streamoff(offset * sizeof(Record)));
+                    file.read(reinterpret_cast<char*>(buffer.data()), std::streamsize(buffer.size() * sizeof(Record)));
+                    if (!file) {
+                        failed = true;
+                        return false;
+                    }
+                    offset += buffer.size();
+                    remaining -= buffer.size();
+                    pos = 0;
+                }
+                record = buffer[pos++];
+                return true;
+            }
+
+            std::ifstream &file;
+            uint64_t offset;
+            uint64_t remaining;
+            size_t buffer_size;
+            std::vector<Record> buffer;
+            size_t pos = 0;
+            bool failed = false;
+        };
+
+        std::vector<File> files;
+    };
+}
@@ -1,4 +1,5 @@
 #include "game.h"
+#include <cctype>
 
 Color Chess::setFen(std::string fen) {
     int set_space = 56;
@@ -107,7 +108,8 @@ Color Chess::setFen(std::string fen) {
     int en_passant_square = 0; //0 for no en passant square since there can't possibly be an en passant there
     i++;
     if (fen[i] != '-') {
-        en_passant_square = string_to_index(fen.substr(i, 2));
+        //Fen gives the square behind the pawn but History keeps track of the pawn itself
+        en_passant_square = string_to_index(fen.substr(i, 2)) + (color == WHITE ? -8 : 8);
     }
 
     this->history[depth] = History();
@@ -158,6 +160,23 @@ Color Chess::setFen(std::string fen) {
         this->history[depth].en_passant_square = en_passant_square;
     }
 
+    //Halfmove clock, which some fens leave out
+    while (i < fen.size() && fen[i] != ' ') {
+        i++;
+    }
+    while (i < fen.size() && fen[i] == ' ') {
+        i++;
+    }
+    if (i < fen.size() && std::isdigit(fen[i])) {
+        this->history[depth].halfmove = std::stoi(fen.substr(i));
+    }
+
+    computeKey(color);
+    computeScores();
+    if (accumulators) {
+        NNUE::refresh(*accumulators, *this);
+    }
+
     //History.capture cannot be set as fen doesn't provide the information for it
     //This also means that undoing past where the fen was set would be bugged
     
@@ -165,6 +184,48 @@ Color Chess::setFen(std::string fen) {
 
 }
 
+void Chess::computeKey(Color color) {
+    Bitboard key = 0;
+    Bitboard pawn_key = 0;
+
+    for (Square sq = 0; sq < 64; sq++) {
+        key ^= Zobrist::pieces[mailbox[sq]][sq];
+        if (getPieceType(mailbox[sq]) == Pawn) {
+            pawn_key ^= Zobrist::pieces[mailbox[sq]][sq];
+        }
+    }
+
+    key ^= Zobrist::castling[castling_rights(history[depth].castling)];
+
+    if (history[depth].en_passant_square) {
+        key ^= Zobrist::en_passant[history[depth].en_passant_square & 0b111];
+    }
+
+    if (color == BLACK) {
+        key ^= Zobrist::side;
+    }
+
+    history[depth].key = key;
+    history[depth].pawn_key = pawn_key;
+}
+
+void Chess::computeScores() {
+    History &current = history[depth];
+    current.mg = current.eg = current.material = 0;
+    current.phase = 0;
+
+    for (Square sq = 0; sq < 64; sq++) {
+        current.addPiece(mailbox[sq], sq);
+    }
+}
+
+void Chess::setAccumulators(NNUE::Accumulators *accumulators) {
+    this->accumulators = accumulators;
+    if (accumulators) {
+        NNUE::refresh(*accumulators, *this);
+    }
+}
+
 std::string Chess::getFen() const {
     std::string fen;
     char piece_char;
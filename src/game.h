@@ -2,37 +2,112 @@
 #include "bits.h"
 #include "piece.h"
 #include "moves.h"
+#include "zobrist.h"
+#include "psqt.h"
 #include <array>
 #include <string>
+#include <string_view>
+#include <algorithm>
 
 const std::string starting_pos = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
 constexpr size_t MAX_GAME_LENGTH = 5949;
+constexpr size_t MAX_SAN_LENGTH = 8; //Longest SAN move like Qa1xb2# or exd8=Q+, plus the null terminator
+
+enum GameState : uint8_t {
+    ONGOING,
+    CHECKMATE, //The side to move is checkmated
+    STALEMATE,
+    DRAW_REPETITION,
+    DRAW_FIFTY_MOVE,
+    DRAW_INSUFFICIENT_MATERIAL
+};
 
 struct History {
   public:
 	//Stores information that the chess game needs to move or undo moves
 	Square en_passant_square; //Index of the pawn that can be en passant captured
 	Piece capture; //Captured piece for undoing moves
+    uint16_t halfmove; //Plies since the last capture or pawn move for the 50 move rule
     Bitboard castling;
     /*
     Castling gets initalized to 0x6EFFFFFFFFFFFF6E 
     which includes the inital position of the rooks and kings as 0s and everything else as 1s
     This is used to keep track of if the pieces have been moved or captured to determine if castling is still possible
     */
+    Bitboard key; //Zobrist hash of the position, used for repetition detection
+    Bitboard pawn_key; //Zobrist hash of only the pawns, for caching pawn structure evaluation
+
+    //Evaluation terms kept up to date by makeMove so the static evaluation doesn't need to loop over the board
+    //All of them are from white's point of view
+    int16_t mg; //Middlegame piece square score, material included
+    int16_t eg; //Endgame piece square score, material included
+    int16_t material; //Material balance in centipawns
+    uint8_t phase; //Sum of PSQT::phase over the pieces on the board, not capped at PSQT::MAX_PHASE
+
+    inline History() : en_passant_square(0), capture(NoPiece), halfmove(0), castling(0x6EFFFFFFFFFFFF6E), key(0), pawn_key(0),
+        mg(0), eg(0), material(0), phase(0) {}
+
+    //When making a new history off of an old one, the only relevant information is the castling square, the halfmove clock,
+    //the keys and the evaluation terms
+	//Copy constuctor can only be used for make unmake, Chess copies its plies with the assignment below
+    inline History(const History &history) : en_passant_square(0), capture(NoPiece), halfmove(history.halfmove),
+        castling(history.castling), key(history.key), pawn_key(history.pawn_key), mg(history.mg), eg(history.eg), material(history.material), phase(history.phase) {}
+
+    inline History &operator=(const History &history) = default; //Copies everything, en passant square included
+
+    inline void addPiece(Piece piece, Square sq) {
+        mg += PSQT::mg[piece][sq];
+        eg += PSQT::eg[piece][sq];
+        material += PSQT::material[piece];
+        phase += PSQT::phase[getPieceType(piece)];
+    }
 
-    inline History() : en_passant_square(0), capture(NoPiece), castling(0x6EFFFFFFFFFFFF6E) {}
+    inline void removePiece(Piece piece, Square sq) {
+        mg -= PSQT::mg[piece][sq];
+        eg -= PSQT::eg[piece][sq];
+        material -= PSQT::material[piece];
+        phase -= PSQT::phase[getPieceType(piece)];
+    }
 
-    //When making a new history off of an old one, the only relevant information is the castling square
-	//Copy constuctor can only be used for make unmake, otherwise copying of the Chess class doesn't work correctly
-    inline History(const History &history) : en_passant_square(0), capture(NoPiece), castling(history.castling) {}
+    //Material and phase don't change when a piece only moves
+    inline void movePiece(Piece piece, Square from, Square to) {
+        mg += PSQT::mg[piece][to] - PSQT::mg[piece][from];
+        eg += PSQT::eg[piece][to] - PSQT::eg[piece][from];
+    }
 };
 
+//Attack maps of both sides, filled in by Chess::getMovesAndAttacks while it generates moves so an evaluation doesn't have to redo them
+//The sliding attacks of the side not to move go through the other king, like the danger squares used for king moves
+struct AttackInfo {
+    Bitboard attacked_by[2][8]; //Indexed by Color then PieceType. NoPieceType holds every square the side attacks
+    Bitboard attacked_twice[2]; //Squares attacked by at least two of a side's pieces
+    Bitboard king_zone[2]; //Each king's square and the squares around it
+    Bitboard mobility_area[2]; //Squares a side's pieces count towards mobility, ones that aren't its own or attacked by enemy pawns
+    int mobility[2][8]; //Mobility area squares attacked by each piece type added up
+    int king_attackers[2]; //How many of a side's pieces attack the enemy king zone. Queens count once for each of their directions
+    int king_zone_attacks[2]; //Squares attacked in the enemy king zone, added up over those pieces
+    Bitboard checkers; //Checkers and pinned pieces of the side to move
+    Bitboard pinned;
+};
+
+class Chess;
+
+//The network evaluation lives in nnue.h, only its hooks for makeMove and setFen are needed here
+namespace NNUE {
+    class Accumulators;
+    void refresh(Accumulators &accumulators, const Chess &game); //Computes the accumulator for the current ply from scratch
+    void update(Accumulators &accumulators, const Chess &game, Move move, Color color, Piece capture); //Called after a move is made
+}
+
+struct PackedPosition; //Defined in packed.h
+
 class Chess {
   private:
     Piece mailbox[64];
 	Bitboard bitboards[15];
     History history[MAX_GAME_LENGTH];
     uint16_t depth;
+    NNUE::Accumulators *accumulators; //Optional, only kept up to date when set
 
 	template<Color color> inline Bitboard all_bitboards() const;
 	constexpr inline Bitboard get_bitboard(PieceType piece, Color color) const {
@@ -41,14 +116,102 @@ class Chess {
 
     //Actual move generation.
     //The result is then put in a MoveArray stuct for convience when getMoves() is called
-    template<Color color>
-    Move* genMove(Move* legal_moves) const;
+    //With record set, the attack maps of both sides also get written to info
+    template<Color color, GenType type = ALL_MOVES, bool record = false>
+    Move* genMove(Move* legal_moves, AttackInfo *info = nullptr) const;
+
+    //Attack information shared by the move generator and hasLegalMove
+    template<Color color, bool record = false> inline Bitboard danger_squares(Bitboard all, AttackInfo *info = nullptr) const;
+    template<Color color> inline void checks_and_pins(Square king_square, Bitboard all, Bitboard friendly, Bitboard &checkers, Bitboard &pinned) const;
+
+    //Helpers for static exchange evaluation. Only use the bitboards so they stay cheap
+    inline Bitboard attackers_to(Square sq, Bitboard occupancy) const;
+    inline PieceType piece_type_on(Square sq) const;
+    template<Color color> inline Bitboard least_valuable_attacker(Bitboard attackers, PieceType &piece) const;
+
+    //Helpers for toSAN. Look at the position after a move through its occupancy and piece bitboards, indexed by piece type,
+    //so nothing has to be made or unmade
+    template<Color side> static inline Bitboard attackers_after(Square sq, Bitboard occupancy, const Bitboard pieces[7]);
+    template<Color color> bool mated_after(Move move, Bitboard occupancy, const Bitboard ours[7], const Bitboard theirs[7]) const;
+
+    //Helpers for filling in AttackInfo. record_attacks does nothing unless record is set so the normal move generator can call it for free
+    inline void init_attacks(AttackInfo &info) const;
+    template<bool record> inline void record_attacks(AttackInfo *info, Color side, PieceType piece, Bitboard attacks) const;
+    template<Color side> inline void record_pawn_attacks(AttackInfo &info) const;
+    template<Color side> inline void record_piece_attacks(AttackInfo &info, Bitboard all, Bitboard pieces) const; //For pieces the generator skips
+
+    void computeKey(Color color); //Hashes the position and its pawns from scratch, only needed when setting up a position
+    void computeScores(); //Sums the incremental evaluation terms from scratch, also only needed when setting up a position
 
   public:
-  	template<Color color> inline MoveArray getMoves() const; //Calls Chess::genMove and puts it in a nice struct
+  	template<Color color, GenType type = ALL_MOVES> inline MoveArray getMoves() const; //Calls Chess::genMove and puts it in a nice struct
+    template<Color color, GenType type = ALL_MOVES> inline ScoredMoveArray getScoredMoves(const MoveOrdering &ordering) const; //Moves with ordering scores
+    template<Color color, GenType type = ALL_MOVES> inline MoveArray getMovesAndAttacks(AttackInfo &info) const; //Moves plus both sides' attack maps
     template<Color color> void makeMove(Move move);
     template<Color color> void unmakeMove(Move move);
     template<Color color> inline bool inCheck() const;
+    template<Color color> bool hasLegalMove() const; //Stops at the first legal move found so it's much cheaper than getMoves
+    template<Color color> GameState gameState() const;
+
+    //Static exchange evaluation. Plays out all the captures on the move's square with the least valuable piece first
+    //without actually making any moves. Pins are ignored
+    template<Color color> int see(Move move) const; //Material won by the move in centipawns
+    template<Color color> bool seeGE(Move move, int threshold) const; //Faster check for if see(move) >= threshold
+
+    //Reads a move in standard algebraic notation like Nbd7, exd6, e8=Q+ or O-O. Returns Move() if it can't be read or isn't legal
+    template<Color color> Move fromSAN(std::string_view san) const;
+    //Writes a move in standard algebraic notation, with + or # for checks and mates, into out which needs room for MAX_SAN_LENGTH
+    //characters. Returns the length of the move without the null terminator
+    template<Color color> size_t toSAN(Move move, char *out) const;
+
+    //Draw detection
+    inline bool isRepetition(int count = 2) const;
+    inline bool isFiftyMove() const {
+        //A checkmate given on the last move takes priority over this so check for mate first
+        return history[depth].halfmove >= 100;
+    }
+    inline bool isInsufficientMaterial() const;
+
+    inline Bitboard getKey() const {
+        return history[depth].key;
+    }
+
+    inline Bitboard getPawnKey() const {
+        return history[depth].pawn_key;
+    }
+
+    inline uint16_t getHalfmove() const {
+        return history[depth].halfmove;
+    }
+
+    //Incrementally updated evaluation terms, from white's point of view
+    inline int getMidgame() const {
+        return history[depth].mg;
+    }
+
+    inline int getEndgame() const {
+        return history[depth].eg;
+    }
+
+    inline int getMaterial() const {
+        return history[depth].material;
+    }
+
+    inline int getPhase() const {
+        return history[depth].phase;
+    }
+
+    //Attaches accumulators for the network evaluation, which makeMove then keeps up to date. nullptr detaches them
+    //Copies of the game share them so each copy that moves needs its own
+    void setAccumulators(NNUE::Accumulators *accumulators);
+    inline const NNUE::Accumulators *getAccumulators() const {
+        return accumulators;
+    }
+
+    //Plies played since the position was set. Can't go past MAX_GAME_LENGTH
+    inline uint16_t getDepth() const {
+        return depth;
+    }
 
 	inline std::array<Piece, 64> getMailbox() const {
         std::array<Piece, 64> arr;
@@ -58,21 +221,49 @@ class Chess {
     }
 
     //For accessing the mailbox without needing to copy all the data
-    inline Piece getSquare(Square sq) { 
+    inline Piece getSquare(Square sq) const { 
         return mailbox[sq];
     }
+
+    inline Bitboard getBitboard(Piece piece) const {
+        return bitboards[piece];
+    }
     
 	Color setFen(std::string fen);
 	std::string getFen() const;
+
+    //32 byte binary positions, see packed.h. Like with setFen, moves made before setPacked can't be undone after it
+    Color setPacked(const PackedPosition &packed);
+    PackedPosition getPacked(Color color) const;
+    uint64_t getPolyglotKey(Color color) const; //Opening book key, see polyglot.h. Unlike getKey it isn't kept up to date
+
+    //Endgame tablebase results for the side to move, see tablebase.h. Return false if there's no table for the position,
+    //which needs at most 5 pieces, no castling rights and no en passant capture
+    bool probeWDL(Color color, int &wdl) const; //wdl is 1 for a win, 0 for a draw and -1 for a loss
+    bool probeDTM(Color color, int &wdl, int &plies) const; //Also gives the plies to mate, 0 for draws
     void print() const;
 
-	inline Chess() : depth(0) {
+	inline Chess() : depth(0), accumulators(nullptr) {
 		setFen(starting_pos);
 	}
 
-	inline Chess(std::string fen) : depth(0) {
+	inline Chess(std::string fen) : depth(0), accumulators(nullptr) {
 		setFen(fen);
 	}
+
+    //Only the plies up to depth are copied, by assignment so their en passant squares and captures are kept
+    inline Chess(const Chess &game) : depth(0), accumulators(nullptr) {
+        *this = game;
+    }
+
+    inline Chess &operator=(const Chess &game) {
+        std::copy(game.mailbox, game.mailbox + 64, mailbox);
+        std::copy(game.bitboards, game.bitboards + 15, bitboards);
+        std::copy(game.history, game.history + game.depth + 1, history);
+        depth = game.depth;
+        accumulators = game.accumulators;
+        return *this;
+    }
 };
 
 //Returns all the bitboards of a certain color
@@ -91,8 +282,22 @@ template<Color color>
 void Chess::makeMove(Move move) {
     History current_history_data = history[depth]; //Copy relevant data from current depth to the queued next depth history
 
+    //Key changes that happen on every move. The en passant square only lasts for one move
+    current_history_data.key ^= Zobrist::side;
+    if (history[depth].en_passant_square) {
+        current_history_data.key ^= Zobrist::en_passant[history[depth].en_passant_square & 0b111];
+    }
+    current_history_data.halfmove++; //Gets reset by captures and pawn moves
+
 	switch (move.flag()) {
 		case QUIET:
+            current_history_data.key ^= Zobrist::pieces[mailbox[move.from()]][move.from()] ^ Zobrist::pieces[mailbox[move.from()]][move.to()];
+            current_history_data.movePiece(mailbox[move.from()], move.from(), move.to());
+            if (mailbox[move.from()] == makePiece(Pawn, color)) {
+                current_history_data.halfmove = 0;
+                current_history_data.pawn_key ^= Zobrist::pieces[makePiece(Pawn, color)][move.from()] ^ Zobrist::pieces[makePiece(Pawn, color)][move.to()];
+            }
+
 			bitboards[mailbox[move.from()]] ^= get_single_bitboard(move.from()) | get_single_bitboard(move.to()); // Update piece position on bitboard
 			mailbox[move.to()] = mailbox[move.from()]; // Update new mailbox position
 			mailbox[move.from()] = NoPiece; // Remove the mailbox piece from it's old position
@@ -102,6 +307,18 @@ void Chess::makeMove(Move move) {
 			break;
 
 		case CAPTURE:
+            current_history_data.key ^= Zobrist::pieces[mailbox[move.from()]][move.from()] ^ Zobrist::pieces[mailbox[move.from()]][move.to()] ^
+                                        Zobrist::pieces[mailbox[move.to()]][move.to()];
+            current_history_data.movePiece(mailbox[move.from()], move.from(), move.to());
+            current_history_data.removePiece(mailbox[move.to()], move.to());
+            current_history_data.halfmove = 0;
+            if (mailbox[move.from()] == makePiece(Pawn, color)) {
+                current_history_data.pawn_key ^= Zobrist::pieces[makePiece(Pawn, color)][move.from()] ^ Zobrist::pieces[makePiece(Pawn, color)][move.to()];
+            }
+            if (mailbox[move.to()] == makePiece(Pawn, ~color)) {
+                current_history_data.pawn_key ^= Zobrist::pieces[makePiece(Pawn, ~color)][move.to()];
+            }
+
 			bitboards[mailbox[move.from()]] ^= get_single_bitboard(move.from()) | get_single_bitboard(move.to());; // Update piece position on bitboard
 			bitboards[mailbox[move.to()]] ^= get_single_bitboard(move.to()); //Remove captured piece from its bitboard
             current_history_data.capture = mailbox[move.to()]; //Save the captured piece to the history
@@ -120,6 +337,11 @@ void Chess::makeMove(Move move) {
 			mailbox[move.to()] = makePiece(Pawn, color); // Update new mailbox position
 			mailbox[move.from()] = NoPiece; // Remove the mailbox piece from it's old position
             current_history_data.en_passant_square = move.to();
+            current_history_data.key ^= Zobrist::pieces[makePiece(Pawn, color)][move.from()] ^ Zobrist::pieces[makePiece(Pawn, color)][move.to()] ^
+                                        Zobrist::en_passant[move.to() & 0b111];
+            current_history_data.movePiece(makePiece(Pawn, color), move.from(), move.to());
+            current_history_data.pawn_key ^= Zobrist::pieces[makePiece(Pawn, color)][move.from()] ^ Zobrist::pieces[makePiece(Pawn, color)][move.to()];
+            current_history_data.halfmove = 0;
 			break;
 
         case EN_PASSANT:
@@ -132,12 +354,22 @@ void Chess::makeMove(Move move) {
             if constexpr (color == WHITE) {
                 bitboards[makePiece(Pawn, ~color)] ^= get_single_bitboard(move.to() - 8);
                 mailbox[move.to() - 8] = NoPiece;
+                current_history_data.key ^= Zobrist::pieces[makePiece(Pawn, ~color)][move.to() - 8];
+                current_history_data.pawn_key ^= Zobrist::pieces[makePiece(Pawn, ~color)][move.to() - 8];
+                current_history_data.removePiece(makePiece(Pawn, ~color), move.to() - 8);
             } else {
                 bitboards[makePiece(Pawn, ~color)] ^= get_single_bitboard(move.to() + 8);
                 mailbox[move.to() + 8] = NoPiece;
+                current_history_data.key ^= Zobrist::pieces[makePiece(Pawn, ~color)][move.to() + 8];
+                current_history_data.pawn_key ^= Zobrist::pieces[makePiece(Pawn, ~color)][move.to() + 8];
+                current_history_data.removePiece(makePiece(Pawn, ~color), move.to() + 8);
             }
 
             current_history_data.capture = makePiece(Pawn, ~color); //Save the captured piece to the history
+            current_history_data.key ^= Zobrist::pieces[makePiece(Pawn, color)][move.from()] ^ Zobrist::pieces[makePiece(Pawn, color)][move.to()];
+            current_history_data.movePiece(makePiece(Pawn, color), move.from(), move.to());
+            current_history_data.pawn_key ^= Zobrist::pieces[makePiece(Pawn, color)][move.from()] ^ Zobrist::pieces[makePiece(Pawn, color)][move.to()];
+            current_history_data.halfmove = 0;
 
             break;
 
@@ -150,6 +382,10 @@ void Chess::makeMove(Move move) {
                 mailbox[7] = NoPiece;
                 mailbox[5] = WhiteRook;
                 current_history_data.castling |= Bitboard(0b11111111); //Mask out castling for that side
+                current_history_data.key ^= Zobrist::pieces[WhiteKing][4] ^ Zobrist::pieces[WhiteKing][6] ^
+                                            Zobrist::pieces[WhiteRook][7] ^ Zobrist::pieces[WhiteRook][5];
+                current_history_data.movePiece(WhiteKing, 4, 6);
+                current_history_data.movePiece(WhiteRook, 7, 5);
             } else {
                 bitboards[BlackKing] ^= Bitboard(0x5000000000000000);
                 bitboards[BlackRook] ^= Bitboard(0xA000000000000000);
@@ -158,6 +394,10 @@ void Chess::makeMove(Move move) {
                 mailbox[63] = NoPiece;
                 mailbox[61] = BlackRook;
                 current_history_data.castling |= Bitboard(0xFF00000000000000); //Mask out castling for that side
+                current_history_data.key ^= Zobrist::pieces[BlackKing][60] ^ Zobrist::pieces[BlackKing][62] ^
+                                            Zobrist::pieces[BlackRook][63] ^ Zobrist::pieces[BlackRook][61];
+                current_history_data.movePiece(BlackKing, 60, 62);
+                current_history_data.movePiece(BlackRook, 63, 61);
             }
             break;
 
@@ -170,6 +410,10 @@ void Chess::makeMove(Move move) {
                 mailbox[0] = NoPiece;
                 mailbox[3] = WhiteRook;
                 current_history_data.castling |= Bitboard(0b11111111);
+                current_history_data.key ^= Zobrist::pieces[WhiteKing][4] ^ Zobrist::pieces[WhiteKing][2] ^
+                                            Zobrist::pieces[WhiteRook][0] ^ Zobrist::pieces[WhiteRook][3];
+                current_history_data.movePiece(WhiteKing, 4, 2);
+                current_history_data.movePiece(WhiteRook, 0, 3);
             } else {
                 bitboards[BlackKing] ^= Bitboard(0x1400000000000000);
                 bitboards[BlackRook] ^= Bitboard(0x900000000000000);
@@ -178,11 +422,17 @@ void Chess::makeMove(Move move) {
                 mailbox[56] = NoPiece;
                 mailbox[59] = BlackRook;
                 current_history_data.castling |= Bitboard(0xFF00000000000000);
+                current_history_data.key ^= Zobrist::pieces[BlackKing][60] ^ Zobrist::pieces[BlackKing][58] ^
+                                            Zobrist::pieces[BlackRook][56] ^ Zobrist::pieces[BlackRook][59];
+                current_history_data.movePiece(BlackKing, 60, 58);
+                current_history_data.movePiece(BlackRook, 56, 59);
             }
             break;
 
         case PROMOTION_CAPTURE_KNIGHT:
             //Only includes the special code to handle the capture
+            current_history_data.key ^= Zobrist::pieces[mailbox[move.to()]][move.to()];
+            current_history_data.removePiece(mailbox[move.to()], move.to());
             bitboards[mailbox[move.to()]] ^= get_single_bitboard(move.to());
             current_history_data.capture = mailbox[move.to()]; //Save the captured piece to the history
             //The pawn could capture a rook which would disable castling on that side
@@ -194,9 +444,16 @@ void Chess::makeMove(Move move) {
             bitboards[makePiece(Pawn, color)] ^= get_single_bitboard(move.from()); //Remove the old pawn
             mailbox[move.from()] = NoPiece; //Update mailbox
             mailbox[move.to()] = makePiece(Knight, color);
+            current_history_data.key ^= Zobrist::pieces[makePiece(Pawn, color)][move.from()] ^ Zobrist::pieces[makePiece(Knight, color)][move.to()];
+            current_history_data.removePiece(makePiece(Pawn, color), move.from());
+            current_history_data.addPiece(makePiece(Knight, color), move.to());
+            current_history_data.pawn_key ^= Zobrist::pieces[makePiece(Pawn, color)][move.from()];
+            current_history_data.halfmove = 0;
             break;
 
         case PROMOTION_CAPTURE_BISHOP:
+            current_history_data.key ^= Zobrist::pieces[mailbox[move.to()]][move.to()];
+            current_history_data.removePiece(mailbox[move.to()], move.to());
             bitboards[mailbox[move.to()]] ^= get_single_bitboard(move.to());
             current_history_data.capture = mailbox[move.to()]; 
             current_history_data.castling |= get_single_bitboard(move.to());
@@ -206,9 +463,16 @@ void Chess::makeMove(Move move) {
             bitboards[makePiece(Pawn, color)] ^= get_single_bitboard(move.from());
             mailbox[move.from()] = NoPiece;
             mailbox[move.to()] = makePiece(Bishop, color);
+            current_history_data.key ^= Zobrist::pieces[makePiece(Pawn, color)][move.from()] ^ Zobrist::pieces[makePiece(Bishop, color)][move.to()];
+            current_history_data.removePiece(makePiece(Pawn, color), move.from());
+            current_history_data.addPiece(makePiece(Bishop, color), move.to());
+            current_history_data.pawn_key ^= Zobrist::pieces[makePiece(Pawn, color)][move.from()];
+            current_history_data.halfmove = 0;
             break;
 
         case PROMOTION_CAPTURE_ROOK:
+            current_history_data.key ^= Zobrist::pieces[mailbox[move.to()]][move.to()];
+            current_history_data.removePiece(mailbox[move.to()], move.to());
             bitboards[mailbox[move.to()]] ^= get_single_bitboard(move.to());
             current_history_data.capture = mailbox[move.to()]; 
             current_history_data.castling |= get_single_bitboard(move.to());
@@ -218,9 +482,16 @@ void Chess::makeMove(Move move) {
             bitboards[makePiece(Pawn, color)] ^= get_single_bitboard(move.from());
             mailbox[move.from()] = NoPiece;
             mailbox[move.to()] = makePiece(Rook, color);
+            current_history_data.key ^= Zobrist::pieces[makePiece(Pawn, color)][move.from()] ^ Zobrist::pieces[makePiece(Rook, color)][move.to()];
+            current_history_data.removePiece(makePiece(Pawn, color), move.from());
+            current_history_data.addPiece(makePiece(Rook, color), move.to());
+            current_history_data.pawn_key ^= Zobrist::pieces[makePiece(Pawn, color)][move.from()];
+            current_history_data.halfmove = 0;
             break;
 
         case PROMOTION_CAPTURE_QUEEN:
+            current_history_data.key ^= Zobrist::pieces[mailbox[move.to()]][move.to()];
+            current_history_data.removePiece(mailbox[move.to()], move.to());
             bitboards[mailbox[move.to()]] ^= get_single_bitboard(move.to());
             current_history_data.capture = mailbox[move.to()]; 
             current_history_data.castling |= get_single_bitboard(move.to());
@@ -230,14 +501,29 @@ void Chess::makeMove(Move move) {
             bitboards[makePiece(Pawn, color)] ^= get_single_bitboard(move.from());
             mailbox[move.from()] = NoPiece;
             mailbox[move.to()] = makePiece(Queen, color);
+            current_history_data.key ^= Zobrist::pieces[makePiece(Pawn, color)][move.from()] ^ Zobrist::pieces[makePiece(Queen, color)][move.to()];
+            current_history_data.removePiece(makePiece(Pawn, color), move.from());
+            current_history_data.addPiece(makePiece(Queen, color), move.to());
+            current_history_data.pawn_key ^= Zobrist::pieces[makePiece(Pawn, color)][move.from()];
+            current_history_data.halfmove = 0;
             break;
 
 	}
 
+    //Castling rights only need to be rehashed when they actually change
+    if (current_history_data.castling != history[depth].castling) {
+        current_history_data.key ^= Zobrist::castling[castling_rights(history[depth].castling)] ^
+                                    Zobrist::castling[castling_rights(current_history_data.castling)];
+    }
+
     //Advance depth and add history data in the new slot
     depth++;
     history[depth] = current_history_data;
 
+    if (accumulators) {
+        NNUE::update(*accumulators, *this, move, color, current_history_data.capture);
+    }
+
 }
 
 template<Color color>
@@ -336,59 +622,125 @@ void Chess::unmakeMove(Move move) {
 
     depth--;
     //No need to clear the history as it will just get overwritten when needed
+    //This also restores the key and halfmove clock
 }
 
-template<Color color>
-Move* Chess::genMove(Move* legal_moves) const {
-	Bitboard bb; //Temp bitboard used for whatever
-	Bitboard moves; //Temp bitboard to store moves
-    Square pos; //Temp int for storing positions
-
-	const Bitboard friendly = all_bitboards<color>();
-	const Bitboard enemy = all_bitboards<~color>();
-	const Bitboard all = friendly | enemy;
-	
-	const Square king_square = bitScanForward(get_bitboard(King, color));
-	
-	//Check for pins and checkers
-	Bitboard checkers = 0;
-	Bitboard pinned = 0;
+//Returns all the squares attacked by the enemy
+//The sliding attacks go through the friendly king so the king can't step back along the line of a check
+template<Color color, bool record>
+inline Bitboard Chess::danger_squares(Bitboard all, AttackInfo *info) const {
+	Bitboard bb;
+	Bitboard attacks;
 	Bitboard danger = 0;
 
-    //For masking moves to either being a quiet or a capture move
-    Bitboard quiet_mask;
-    Bitboard capture_mask;
-
 	danger |= pawn_attacks<~color>(get_bitboard(Pawn, ~color));
-	danger |= get_attacks<King>(bitScanForward(get_bitboard(King, ~color)), all);
+	attacks = get_attacks<King>(bitScanForward(get_bitboard(King, ~color)), all);
+	record_attacks<record>(info, ~color, King, attacks);
+	danger |= attacks;
 
 	//Diagonal attackers
 	bb = get_bitboard(Bishop, ~color) | get_bitboard(Queen, ~color);
 	while (bb) {
-        danger |= get_attacks<Bishop>(bitScanForward(bb), all ^ get_bitboard(King, color)); // xor with King so get xray attacks
+        attacks = get_attacks<Bishop>(bitScanForward(bb), all ^ get_bitboard(King, color)); // xor with King so get xray attacks
+        record_attacks<record>(info, ~color, getPieceType(mailbox[bitScanForward(bb)]), attacks);
+        danger |= attacks;
         bb &= bb - 1;
     }
 
 	//Straight attackers 
 	bb = get_bitboard(Rook, ~color) | get_bitboard(Queen, ~color);
 	while (bb) {
-        danger |= get_attacks<Rook>(bitScanForward(bb), all ^ get_bitboard(King, color)); // xor with King so get xray attacks
+        attacks = get_attacks<Rook>(bitScanForward(bb), all ^ get_bitboard(King, color)); // xor with King so get xray attacks
+        record_attacks<record>(info, ~color, getPieceType(mailbox[bitScanForward(bb)]), attacks);
+        danger |= attacks;
         bb &= bb - 1;
     }
 
 	//Knights
 	bb = get_bitboard(Knight, ~color);
 	while (bb) {
-        danger |= get_attacks<Knight>(bitScanForward(bb), all);
+        attacks = get_attacks<Knight>(bitScanForward(bb), all);
+        record_attacks<record>(info, ~color, Knight, attacks);
+        danger |= attacks;
         bb &= bb - 1;
     }
 
-	//Friendly king moves
-	bb = get_attacks<King>(king_square, all) & ~(danger | friendly); //Can't go in check or in spaces where friendly pieces are at
-	add_moves<QUIET>(king_square, bb & ~enemy, legal_moves);
-	add_moves<CAPTURE>(king_square, bb & enemy, legal_moves);
+	return danger;
+}
+
+//Clears the attack maps and sets up the king zones and mobility areas they're measured against
+inline void Chess::init_attacks(AttackInfo &info) const {
+    info = AttackInfo{};
+    for (Color side : {WHITE, BLACK}) {
+        const Bitboard king = get_bitboard(King, side);
+        info.king_zone[side] = king | get_attacks<King>(bitScanForward(king), 0);
+    }
+    info.mobility_area[WHITE] = ~(all_bitboards<WHITE>() | pawn_attacks<BLACK>(get_bitboard(Pawn, BLACK)));
+    info.mobility_area[BLACK] = ~(all_bitboards<BLACK>() | pawn_attacks<WHITE>(get_bitboard(Pawn, WHITE)));
+}
+
+template<bool record>
+inline void Chess::record_attacks(AttackInfo *info, Color side, PieceType piece, Bitboard attacks) const {
+    if constexpr (record) {
+        info->attacked_twice[side] |= info->attacked_by[side][NoPieceType] & attacks;
+        info->attacked_by[side][NoPieceType] |= attacks;
+        info->attacked_by[side][piece] |= attacks;
+        info->mobility[side][piece] += pop_count(attacks & info->mobility_area[side]);
+
+        const Bitboard zone_attacks = attacks & info->king_zone[~side];
+        if (zone_attacks && piece != King) {
+            info->king_attackers[side]++;
+            info->king_zone_attacks[side] += pop_count(zone_attacks);
+        }
+    }
+}
+
+//Pawns are done all at once. Each direction is added separately so squares two pawns attack count as attacked twice
+template<Color side>
+inline void Chess::record_pawn_attacks(AttackInfo &info) const {
+    const Bitboard pawns = get_bitboard(Pawn, side);
+    const Bitboard left = side == WHITE ? (pawns & ~LEFT_COLUMN) << 7 : (pawns & ~LEFT_COLUMN) >> 9;
+    const Bitboard right = side == WHITE ? (pawns & ~RIGHT_COLUMN) << 9 : (pawns & ~RIGHT_COLUMN) >> 7;
+    info.attacked_twice[side] |= left & right;
+    info.attacked_by[side][NoPieceType] |= left | right;
+    info.attacked_by[side][Pawn] |= left | right;
+}
+
+template<Color side>
+inline void Chess::record_piece_attacks(AttackInfo &info, Bitboard all, Bitboard pieces) const {
+    while (pieces) {
+        const Square pos = bitScanForward(pieces);
+        const PieceType piece = getPieceType(mailbox[pos]);
+        switch (piece) {
+            case Knight:
+                record_attacks<true>(&info, side, piece, get_attacks<Knight>(pos, all));
+                break;
+            case Bishop:
+                record_attacks<true>(&info, side, piece, get_attacks<Bishop>(pos, all));
+                break;
+            case Rook:
+                record_attacks<true>(&info, side, piece, get_attacks<Rook>(pos, all));
+                break;
+            case Queen:
+                record_attacks<true>(&info, side, piece, get_attacks<Bishop>(pos, all));
+                record_attacks<true>(&info, side, piece, get_attacks<Rook>(pos, all));
+                break;
+            default:
+                break;
+        }
+        pieces &= pieces - 1;
+    }
+}
+
+//Finds the enemy pieces checking the king and the friendly pieces pinned to it
+template<Color color>
+inline void Chess::checks_and_pins(Square king_square, Bitboard all, Bitboard friendly, Bitboard &checkers, Bitboard &pinned) const {
+	Bitboard bb;
+	Bitboard between;
+
+	checkers = 0;
+	pinned = 0;
 
-	//Get checkers
 	checkers |= get_attacks<Knight>(king_square, all) & get_bitboard(Knight, ~color); //Look for knights from the king position
 	checkers |= pawn_attacks<color>(get_bitboard(King, color)) & get_bitboard(Pawn, ~color);
 
@@ -396,17 +748,65 @@ Move* Chess::genMove(Move* legal_moves) const {
 	bb = ((rook_masks_horizontal[king_square] | rook_masks_vertical[king_square]) & (get_bitboard(Rook, ~color) | get_bitboard(Queen, ~color))) |
          ((bishop_masks_diag1[king_square] | bishop_masks_diag2[king_square]) & (get_bitboard(Bishop, ~color) | get_bitboard(Queen, ~color)));
 	while (bb) {
-		moves = connecting_masks[king_square][bitScanForward(bb)] & all; //moves is actually the pieces in between the king and the checker
-		switch (pop_count(moves)) {
+		between = connecting_masks[king_square][bitScanForward(bb)] & all; //The pieces in between the king and the checker
+		switch (pop_count(between)) {
 			case 0:
 				checkers |= bb & -bb;
 				break;
 			case 1:
-				pinned |= moves & friendly;
+				pinned |= between & friendly;
 				break;
 		}
         bb &= bb - 1; //Remove ls1b
 	}
+}
+
+template<Color color, GenType type, bool record>
+Move* Chess::genMove(Move* legal_moves, AttackInfo *info) const {
+	Bitboard bb; //Temp bitboard used for whatever
+	Bitboard moves; //Temp bitboard to store moves
+    Square pos; //Temp int for storing positions
+
+	const Bitboard friendly = all_bitboards<color>();
+	const Bitboard enemy = all_bitboards<~color>();
+	const Bitboard all = friendly | enemy;
+	
+	const Square king_square = bitScanForward(get_bitboard(King, color));
+	
+	//Check for pins and checkers
+	Bitboard checkers;
+	Bitboard pinned;
+	if constexpr (record) {
+		init_attacks(*info);
+		record_pawn_attacks<~color>(*info);
+	}
+	const Bitboard danger = danger_squares<color, record>(all, info);
+
+    //For masking moves to either being a quiet or a capture move
+    Bitboard quiet_mask;
+    Bitboard capture_mask;
+    Bitboard landing_mask; //Empty squares pawns can promote or en passant to, which still get generated with only captures
+
+	checks_and_pins<color>(king_square, all, friendly, checkers, pinned);
+
+	if constexpr (record) {
+		info->checkers = checkers;
+		info->pinned = pinned;
+		record_pawn_attacks<color>(*info);
+		record_attacks<record>(info, color, King, get_attacks<King>(king_square, all));
+
+		//Only unpinned pieces get their attacks recorded while generating moves, and none do after a double check or a pawn or knight check
+		const bool early_return = pop_count(checkers) == 2 ||
+			(checkers && (mailbox[bitScanForward(checkers)] == makePiece(Pawn, ~color) || mailbox[bitScanForward(checkers)] == makePiece(Knight, ~color)));
+		record_piece_attacks<color>(*info, all, early_return ? friendly : pinned);
+	}
+
+	//Friendly king moves
+	bb = get_attacks<King>(king_square, all) & ~(danger | friendly); //Can't go in check or in spaces where friendly pieces are at
+	if (type == ALL_MOVES || checkers) {
+		add_moves<QUIET>(king_square, bb & ~enemy, legal_moves);
+	}
+	add_moves<CAPTURE>(king_square, bb & enemy, legal_moves);
 
 	switch (pop_count(checkers)) {
 
@@ -449,6 +849,16 @@ Move* Chess::genMove(Move* legal_moves) const {
                         (get_attacks<Bishop>(pos, all) & (get_bitboard(Bishop, color) | get_bitboard(Queen, color))) |
                         (get_attacks<Rook>  (pos, all) & (get_bitboard(Rook,   color) | get_bitboard(Queen, color)))) & ~pinned;
 
+                    //Pawns taking a knight on the last rank promote
+                    if (checkers & promotion_row<color>()) {
+                        Bitboard promoting = bb & get_bitboard(Pawn, color);
+                        bb ^= promoting;
+                        while (promoting) {
+                            add_moves<PROMOTION_CAPTURE>(bitScanForward(promoting), checkers, legal_moves);
+                            promoting &= promoting - 1;
+                        }
+                    }
+
                     //Add capture moves to the vector
                     while (bb) {
                         *legal_moves++ = Move(bitScanForward(bb), pos, CAPTURE); // Will always only need to add one move per piece
@@ -460,6 +870,7 @@ Move* Chess::genMove(Move* legal_moves) const {
                 default:
                     quiet_mask = connecting_masks[king_square][pos]; //Only quiet moves are moving in between the checker and the king
                     capture_mask = checkers; //Only capture move is to capture the checker
+                    landing_mask = quiet_mask;
                     break;
             }
 
@@ -467,40 +878,44 @@ Move* Chess::genMove(Move* legal_moves) const {
 
 		//King is not in check
 		case 0:
-            quiet_mask = ~all; //Quiet moves are on empty spaces
+            //Quiet moves are on empty spaces. Masking them all out skips every quiet move when only captures are wanted
+            quiet_mask = type == ALL_MOVES ? ~all : Bitboard(0);
             capture_mask = enemy;
+            landing_mask = ~all;
 
-            //Castling is only possible when there's no check
+            if constexpr (type == ALL_MOVES) {
+                //Castling is only possible when there's no check
             
-            //castling_pieces is a mask that includes the white king and the castling rook
-            //king_castle_spaces is a mask that includes the spaces in between the castling rook and the king
+                //castling_pieces is a mask that includes the white king and the castling rook
+                //king_castle_spaces is a mask that includes the spaces in between the castling rook and the king
             
-            //history[depth].castling & castling_pieces will evaluate to 0 if the king and rook haven't moved
-            //(danger | all) & king_castle_spaces will evaulate to 0 if the king won't get into check or get blocked on the way it's castle position
-            //Castling is possible if ~piece_moved & ~danger which is logically equivalent to ~(piece_moved | danger) or !(piece_moved | danger) to cast to bool
+                //history[depth].castling & castling_pieces will evaluate to 0 if the king and rook haven't moved
+                //(danger | all) & king_castle_spaces will evaulate to 0 if the king won't get into check or get blocked on the way it's castle position
+                //Castling is possible if ~piece_moved & ~danger which is logically equivalent to ~(piece_moved | danger) or !(piece_moved | danger) to cast to bool
             
-            if (!((history[depth].castling & castling_pieces<color, CASTLE_SHORT>()) |
-                ((danger | all) & king_castle_spaces<color, CASTLE_SHORT>()))) {
+                if (!((history[depth].castling & castling_pieces<color, CASTLE_SHORT>()) |
+                    ((danger | all) & king_castle_spaces<color, CASTLE_SHORT>()))) {
+
+                    if constexpr (color == WHITE) {
+                        *legal_moves++ = Move(4, 6, CASTLE_SHORT);
+                    } else {
+                        *legal_moves++ = Move(60, 62, CASTLE_SHORT);
+                    }
 
-                if constexpr (color == WHITE) {
-                    *legal_moves++ = Move(4, 6, CASTLE_SHORT);
-                } else {
-                    *legal_moves++ = Move(60, 62, CASTLE_SHORT);
                 }
 
-            }
+                //For long castles, the space where the knight is doesn't have to be clear of checks for castling to be possible
+                //So it gets masked out by intersecting it with ~long_castle_knight<color>()
+                if (!((history[depth].castling & castling_pieces<color, CASTLE_LONG>()) |
+                    (((danger & ~long_castle_knight<color>()) | all) & king_castle_spaces<color, CASTLE_LONG>()))) {
 
-            //For long castles, the space where the knight is doesn't have to be clear of checks for castling to be possible
-            //So it gets masked out by intersecting it with ~long_castle_knight<color>()
-            if (!((history[depth].castling & castling_pieces<color, CASTLE_LONG>()) |
-                (((danger & ~long_castle_knight<color>()) | all) & king_castle_spaces<color, CASTLE_LONG>()))) {
+                    if constexpr (color == WHITE) {
+                        *legal_moves++ = Move(4, 2, CASTLE_LONG);
+                    } else {
+                        *legal_moves++ = Move(60, 58, CASTLE_LONG);
+                    }
 
-                if constexpr (color == WHITE) {
-                    *legal_moves++ = Move(4, 2, CASTLE_LONG);
-                } else {
-                    *legal_moves++ = Move(60, 58, CASTLE_LONG);
                 }
-
             }
 
 
@@ -536,7 +951,8 @@ Move* Chess::genMove(Move* legal_moves) const {
                 
                 //Pawn attacks
                 moves = pawn_attacks<color>(bb & -bb) & ray_masks[king_square][pos];
-                add_moves<CAPTURE>(bitScanForward(bb), moves & capture_mask, legal_moves);
+                add_moves<CAPTURE>(pos, moves & capture_mask & ~promotion_row<color>(), legal_moves);
+                add_moves<PROMOTION_CAPTURE>(pos, moves & capture_mask & promotion_row<color>(), legal_moves); //Taking the pinner on the last rank
 
                 //Handle en passants
                 if constexpr (color == WHITE) {
@@ -591,9 +1007,8 @@ Move* Chess::genMove(Move* legal_moves) const {
 	if constexpr (color == WHITE) {
 		bb = ((bitboards[WhitePawn] & ~pinned) << 8) & ~all; //Single pawn push
 		moves = ((bb & Bitboard(0xFF0000)) << 8) & quiet_mask; //Double pawn push generated off of single pawn push
-        bb &= quiet_mask;
-        promotions = bb & TOP_ROW;
-        bb &= ~TOP_ROW;
+        promotions = bb & landing_mask & TOP_ROW;
+        bb &= quiet_mask & ~TOP_ROW;
 		
 		while (bb) {
 			pos = bitScanForward(bb);
@@ -619,9 +1034,8 @@ Move* Chess::genMove(Move* legal_moves) const {
 	} else {
 		bb = ((bitboards[BlackPawn] & ~pinned) >> 8) & ~all; //Single pawn push
 		moves = ((bb & Bitboard(0xFF0000000000)) >> 8) & quiet_mask; //Double pawn push generated off of single pawn push
-        bb &= quiet_mask;
-        promotions = bb & BOTTOM_ROW;
-        bb &= ~BOTTOM_ROW;
+        promotions = bb & landing_mask & BOTTOM_ROW;
+        bb &= quiet_mask & ~BOTTOM_ROW;
 
 		while (bb) {
 			pos = bitScanForward(bb);
@@ -657,8 +1071,9 @@ Move* Chess::genMove(Move* legal_moves) const {
     }
 
     //Add en passants if applicable
-    if (history[depth].en_passant_square != 0) {
-        constexpr int8_t shift = color == WHITE ? 8 : -8;
+    //When in check from a slider, the en passant has to block the check by landing in between the checker and the king
+    constexpr int8_t shift = color == WHITE ? 8 : -8;
+    if (history[depth].en_passant_square != 0 && (get_single_bitboard(history[depth].en_passant_square + shift) & landing_mask)) {
         bb = (((get_single_bitboard(history[depth].en_passant_square) & ~LEFT_COLUMN) >> 1) | ((get_single_bitboard(history[depth].en_passant_square) & ~RIGHT_COLUMN) << 1))
             & get_bitboard(Pawn, color) & ~pinned;
         while (bb) {
@@ -679,6 +1094,7 @@ Move* Chess::genMove(Move* legal_moves) const {
     while (bb) {
         pos = bitScanForward(bb);
         moves = get_attacks<Knight>(pos, all);
+        record_attacks<record>(info, color, Knight, moves);
         add_moves<QUIET>(pos, moves & quiet_mask, legal_moves);
         add_moves<CAPTURE>(pos, moves & capture_mask, legal_moves);
         bb &= bb - 1;
@@ -689,6 +1105,7 @@ Move* Chess::genMove(Move* legal_moves) const {
     while (bb) {
         pos = bitScanForward(bb);
         moves = get_attacks<Bishop>(pos, all);
+        record_attacks<record>(info, color, getPieceType(mailbox[pos]), moves);
         add_moves<QUIET>(pos, moves & quiet_mask, legal_moves);
         add_moves<CAPTURE>(pos, moves & capture_mask, legal_moves);
         bb &= bb - 1;
@@ -699,6 +1116,7 @@ Move* Chess::genMove(Move* legal_moves) const {
     while (bb) {
         pos = bitScanForward(bb);
         moves = get_attacks<Rook>(pos, all);
+        record_attacks<record>(info, color, getPieceType(mailbox[pos]), moves);
         add_moves<QUIET>(pos, moves & quiet_mask, legal_moves);
         add_moves<CAPTURE>(pos, moves & capture_mask, legal_moves);
         bb &= bb - 1;
@@ -707,13 +1125,74 @@ Move* Chess::genMove(Move* legal_moves) const {
     return legal_moves;
 }
 
-template<Color color>
+template<Color color, GenType type>
 inline MoveArray Chess::getMoves() const {
     MoveArray moves;
-    moves.last = this->genMove<color>(moves.arr);
+    moves.count = this->genMove<color, type>(moves.arr) - moves.arr;
+    return moves;
+}
+
+template<Color color, GenType type>
+inline MoveArray Chess::getMovesAndAttacks(AttackInfo &info) const {
+    MoveArray moves;
+    moves.count = this->genMove<color, type, true>(moves.arr, &info) - moves.arr;
     return moves;
 }
 
+//Generates the moves then scores them in one pass over the list
+//The hash move goes first, then captures by most valuable victim then least valuable attacker, then queen promotions, then killers and history
+template<Color color, GenType type>
+inline ScoredMoveArray Chess::getScoredMoves(const MoveOrdering &ordering) const {
+    ScoredMoveArray scored;
+    Move moves[MOVE_VECTOR_SIZE];
+    Move *end = this->genMove<color, type>(moves);
+    scored.count = end - moves;
+
+    for (size_t i = 0; i < scored.count; i++) {
+        const Move move = moves[i];
+        int score;
+
+        if (move == ordering.hash_move) {
+            scored.arr[i] = ScoredMoveArray::pack(move, HASH_MOVE_SCORE);
+            continue;
+        }
+
+        switch (move.flag()) {
+            case CAPTURE:
+                score = CAPTURE_SCORE + 8 * getPieceType(mailbox[move.to()]) - getPieceType(mailbox[move.from()]);
+                break;
+            case EN_PASSANT:
+                score = CAPTURE_SCORE + 8 * Pawn - Pawn;
+                break;
+            case PROMOTION_CAPTURE_QUEEN:
+                score = CAPTURE_SCORE + 8 * getPieceType(mailbox[move.to()]) + 8 * Queen;
+                break;
+            case PROMOTION_QUEEN:
+                score = PROMOTION_SCORE;
+                break;
+            case PROMOTION_KNIGHT: case PROMOTION_BISHOP: case PROMOTION_ROOK:
+            case PROMOTION_CAPTURE_KNIGHT: case PROMOTION_CAPTURE_BISHOP: case PROMOTION_CAPTURE_ROOK:
+                score = UNDERPROMOTION_SCORE;
+                break;
+            default:
+                if (move == ordering.killers[0]) {
+                    score = KILLER_SCORE;
+                } else if (move == ordering.killers[1]) {
+                    score = KILLER_SCORE - 1;
+                } else if (ordering.history) {
+                    score = std::clamp<int>(ordering.history[move.from()][move.to()], -HISTORY_LIMIT, HISTORY_LIMIT);
+                } else {
+                    score = 0;
+                }
+                break;
+        }
+
+        scored.arr[i] = ScoredMoveArray::pack(move, score);
+    }
+
+    return scored;
+}
+
 template<Color color>
 inline bool Chess::inCheck() const {
     Bitboard bb;
@@ -747,4 +1226,722 @@ inline bool Chess::inCheck() const {
 
     return (get_bitboard(King, color) & danger) != Bitboard(0);
 
-}
\ No newline at end of file
+}
+
+//Returns true if the current position has occurred count times, including the current one
+//Only the positions since the last capture or pawn move can be repeats so the scan stops there
+//The side to move has to be the same so only every other ply needs to be checked, starting 4 plies back as that's the soonest a position can repeat
+inline bool Chess::isRepetition(int count) const {
+    const Bitboard key = history[depth].key;
+    const int last_irreversible = depth - std::min<int>(history[depth].halfmove, depth); //History from before the fen was set isn't there
+
+    for (int i = depth - 4; i >= last_irreversible; i -= 2) {
+        if (history[i].key == key && --count == 1) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+//Neither side can checkmate with only kings and minor pieces when there's at most one minor piece,
+//or when all the minor pieces are bishops on the same color squares
+inline bool Chess::isInsufficientMaterial() const {
+    if (bitboards[WhitePawn] | bitboards[BlackPawn] | bitboards[WhiteRook] | bitboards[BlackRook] | bitboards[WhiteQueen] | bitboards[BlackQueen]) {
+        return false;
+    }
+
+    const Bitboard knights = bitboards[WhiteKnight] | bitboards[BlackKnight];
+    const Bitboard bishops = bitboards[WhiteBishop] | bitboards[BlackBishop];
+
+    if (pop_count(knights | bishops) <= 1) {
+        return true;
+    }
+
+    return !knights && (!(bishops & LIGHT_SQUARES) || !(bishops & DARK_SQUARES));
+}
+
+//Same logic as genMove but returns as soon as any legal move is found instead of generating them all
+//The king is tried first as it's usually able to move, then the rest of the pieces from cheapest to check to most expensive
+template<Color color>
+bool Chess::hasLegalMove() const {
+    Bitboard bb;
+    Square pos;
+
+    const Bitboard friendly = all_bitboards<color>();
+    const Bitboard enemy = all_bitboards<~color>();
+    const Bitboard all = friendly | enemy;
+
+    const Square king_square = bitScanForward(get_bitboard(King, color));
+
+    if (get_attacks<King>(king_square, all) & ~(danger_squares<color>(all) | friendly)) {
+        return true;
+    }
+
+    Bitboard checkers;
+    Bitboard pinned;
+    checks_and_pins<color>(king_square, all, friendly, checkers, pinned);
+
+    //Squares a non king move can end on
+    Bitboard quiet_mask;
+    Bitboard capture_mask;
+
+    switch (pop_count(checkers)) {
+        case 2:
+            return false;
+
+        case 1:
+            pos = bitScanForward(checkers);
+            if (mailbox[pos] == makePiece(Pawn, ~color) || mailbox[pos] == makePiece(Knight, ~color)) {
+                quiet_mask = 0; //Can't block pawn or knight checks
+            } else {
+                quiet_mask = connecting_masks[king_square][pos];
+            }
+            capture_mask = checkers;
+            break;
+
+        default:
+            quiet_mask = ~all;
+            capture_mask = enemy;
+
+            //Pinned pieces moving along the pin. Pinned pieces can't do anything when in check
+            //Castling doesn't need to be checked as it can only happen if the king could also move one space
+            bb = pinned & ~get_bitboard(Knight, color);
+            while (bb) {
+                pos = bitScanForward(bb);
+                Bitboard moves;
+                switch (getPieceType(mailbox[pos])) {
+                    case Pawn:
+                        if constexpr (color == WHITE) {
+                            moves = (get_single_bitboard(pos) << 8) & quiet_mask;
+                        } else {
+                            moves = (get_single_bitboard(pos) >> 8) & quiet_mask;
+                        }
+                        moves |= pawn_attacks<color>(get_single_bitboard(pos)) & capture_mask;
+                        break;
+                    case Bishop:
+                        moves = get_attacks<Bishop>(pos, all) & (quiet_mask | capture_mask);
+                        break;
+                    case Rook:
+                        moves = get_attacks<Rook>(pos, all) & (quiet_mask | capture_mask);
+                        break;
+                    default:
+                        moves = get_attacks<Queen>(pos, all) & (quiet_mask | capture_mask);
+                        break;
+                }
+                if (moves & ray_masks[king_square][pos]) {
+                    return true;
+                }
+                bb &= bb - 1;
+            }
+            break;
+    }
+
+    const Bitboard target_mask = quiet_mask | capture_mask;
+
+    //Knights
+    bb = get_bitboard(Knight, color) & ~pinned;
+    while (bb) {
+        if (get_attacks<Knight>(bitScanForward(bb), all) & target_mask) {
+            return true;
+        }
+        bb &= bb - 1;
+    }
+
+    //Pawns can all be checked at once
+    bb = get_bitboard(Pawn, color) & ~pinned;
+    if constexpr (color == WHITE) {
+        if ((bb << 8) & ~all & quiet_mask) return true; //Double pushes can only be legal if the single push is also legal or it's blocking a check
+        if ((((bb << 8) & ~all & Bitboard(0xFF0000)) << 8) & quiet_mask) return true;
+    } else {
+        if ((bb >> 8) & ~all & quiet_mask) return true;
+        if ((((bb >> 8) & ~all & Bitboard(0xFF0000000000)) >> 8) & quiet_mask) return true;
+    }
+    if (pawn_attacks<color>(bb) & capture_mask) {
+        return true;
+    }
+
+    //Sliders
+    bb = (get_bitboard(Bishop, color) | get_bitboard(Queen, color)) & ~pinned;
+    while (bb) {
+        if (get_attacks<Bishop>(bitScanForward(bb), all) & target_mask) {
+            return true;
+        }
+        bb &= bb - 1;
+    }
+
+    bb = (get_bitboard(Rook, color) | get_bitboard(Queen, color)) & ~pinned;
+    while (bb) {
+        if (get_attacks<Rook>(bitScanForward(bb), all) & target_mask) {
+            return true;
+        }
+        bb &= bb - 1;
+    }
+
+    //En passant is rare enough to leave for last. It's legal if it captures the checking pawn or blocks the check,
+    //and the pawns leaving the row doesn't open up the king. Pinned pawns taking en passant along the pin are covered here too
+    if (history[depth].en_passant_square != 0) {
+        constexpr int8_t shift = color == WHITE ? 8 : -8;
+        const Square target = history[depth].en_passant_square + shift;
+
+        if ((get_single_bitboard(target) & quiet_mask) || (checkers & get_single_bitboard(history[depth].en_passant_square))) {
+            bb = (((get_single_bitboard(history[depth].en_passant_square) & ~LEFT_COLUMN) >> 1) | ((get_single_bitboard(history[depth].en_passant_square) & ~RIGHT_COLUMN) << 1))
+                & get_bitboard(Pawn, color);
+            while (bb) {
+                pos = bitScanForward(bb);
+                if ((!(pinned & (bb & -bb)) || (ray_masks[king_square][pos] & get_single_bitboard(target))) &&
+                    (sliding_moves(all ^ (bb & -bb) ^ get_single_bitboard(history[depth].en_passant_square), rook_masks_horizontal[king_square], get_single_bitboard(king_square))
+                    & (get_bitboard(Queen, ~color) | get_bitboard(Rook, ~color))) == Bitboard(0)) {
+                    return true;
+                }
+                bb &= bb - 1;
+            }
+        }
+    }
+
+    return false;
+}
+
+//Classifies the position for ending the game
+//Doesn't need a full move generation unless it's actually checkmate or stalemate
+template<Color color>
+GameState Chess::gameState() const {
+    if (isInsufficientMaterial()) {
+        return DRAW_INSUFFICIENT_MATERIAL;
+    }
+
+    //A position can't repeat if it was checkmate or stalemate the first time so this doesn't need to wait for the move check
+    if (isRepetition(3)) {
+        return DRAW_REPETITION;
+    }
+
+    if (!hasLegalMove<color>()) {
+        return inCheck<color>() ? CHECKMATE : STALEMATE;
+    }
+
+    if (isFiftyMove()) {
+        return DRAW_FIFTY_MOVE;
+    }
+
+    return ONGOING;
+}
+
+//Returns the pieces of both colors that attack a square with the given occupancy
+inline Bitboard Chess::attackers_to(Square sq, Bitboard occupancy) const {
+    return (pawn_attacks<BLACK>(get_single_bitboard(sq)) & bitboards[WhitePawn]) |
+           (pawn_attacks<WHITE>(get_single_bitboard(sq)) & bitboards[BlackPawn]) |
+           (knight_masks[sq] & (bitboards[WhiteKnight] | bitboards[BlackKnight])) |
+           (king_masks[sq] & (bitboards[WhiteKing] | bitboards[BlackKing])) |
+           (get_attacks<Bishop>(sq, occupancy) & (bitboards[WhiteBishop] | bitboards[BlackBishop] | bitboards[WhiteQueen] | bitboards[BlackQueen])) |
+           (get_attacks<Rook>(sq, occupancy) & (bitboards[WhiteRook] | bitboards[BlackRook] | bitboards[WhiteQueen] | bitboards[BlackQueen]));
+}
+
+inline PieceType Chess::piece_type_on(Square sq) const {
+    for (int piece = Pawn; piece <= King; piece++) {
+        if ((bitboards[piece] | bitboards[piece | 0b1000]) & get_single_bitboard(sq)) {
+            return PieceType(piece);
+        }
+    }
+    return NoPieceType;
+}
+
+//Returns a single bit bitboard of the least valuable piece out of the attackers and sets piece to its type
+//Returns 0 if there's no attackers of that color
+template<Color color>
+inline Bitboard Chess::least_valuable_attacker(Bitboard attackers, PieceType &piece) const {
+    for (int type = Pawn; type <= King; type++) {
+        Bitboard bb = attackers & bitboards[makePiece(PieceType(type), color)];
+        if (bb) {
+            piece = PieceType(type);
+            return bb & -bb;
+        }
+    }
+    return 0;
+}
+
+template<Color color>
+int Chess::see(Move move) const {
+    int gain[34]; //One entry per capture plus the one that couldn't happen
+    int d = 0;
+
+    Bitboard occupancy = all_bitboards<WHITE>() | all_bitboards<BLACK>();
+    PieceType attacker = piece_type_on(move.from());
+
+    //The value of what was captured and of the piece that will be sitting on the square after the move
+    gain[0] = piece_values[piece_type_on(move.to())];
+    if (move.flag() == EN_PASSANT) {
+        gain[0] = piece_values[Pawn];
+        occupancy ^= get_single_bitboard(color == WHITE ? move.to() - 8 : move.to() + 8);
+    } else if (move.flag() >= PROMOTION_KNIGHT) {
+        //Promotion flags go knight, bishop, rook, queen in the bits right after the capture bit
+        attacker = PieceType(Knight + ((move.flag() >> 12) & 0b11));
+        gain[0] += piece_values[attacker] - piece_values[Pawn];
+    }
+
+    occupancy ^= get_single_bitboard(move.from());
+    Bitboard attackers = attackers_to(move.to(), occupancy) & occupancy;
+    const Bitboard diagonal_sliders = bitboards[WhiteBishop] | bitboards[BlackBishop] | bitboards[WhiteQueen] | bitboards[BlackQueen];
+    const Bitboard straight_sliders = bitboards[WhiteRook] | bitboards[BlackRook] | bitboards[WhiteQueen] | bitboards[BlackQueen];
+
+    Color side = color;
+    Bitboard from_bb;
+    PieceType next;
+
+    while (true) {
+        d++;
+        side = ~side;
+
+        //Speculative score for the other side if they take the piece that just captured
+        gain[d] = piece_values[attacker] - gain[d - 1];
+
+        from_bb = side == WHITE ? least_valuable_attacker<WHITE>(attackers, next) : least_valuable_attacker<BLACK>(attackers, next);
+        if (!from_bb) {
+            break;
+        }
+
+        //Remove the capturing piece and add any sliders that were behind it
+        occupancy ^= from_bb;
+        if (next == Pawn || next == Bishop || next == Queen) {
+            attackers |= get_attacks<Bishop>(move.to(), occupancy) & diagonal_sliders;
+        }
+        if (next == Rook || next == Queen) {
+            attackers |= get_attacks<Rook>(move.to(), occupancy) & straight_sliders;
+        }
+        attackers &= occupancy;
+        attacker = next;
+    }
+
+    //Each side can choose to stop capturing so work back through the sequence
+    //The last score is dropped as it was for a capture that couldn't happen
+    while (--d) {
+        gain[d - 1] = -std::max(-gain[d - 1], gain[d]);
+    }
+
+    return gain[0];
+}
+
+//Same exchange as see but stops as soon as the result is known to be above or below the threshold
+template<Color color>
+bool Chess::seeGE(Move move, int threshold) const {
+    Bitboard occupancy = all_bitboards<WHITE>() | all_bitboards<BLACK>();
+    int captured = piece_values[piece_type_on(move.to())];
+    int moving = piece_values[piece_type_on(move.from())];
+
+    if (move.flag() == EN_PASSANT) {
+        captured = piece_values[Pawn];
+        occupancy ^= get_single_bitboard(color == WHITE ? move.to() - 8 : move.to() + 8);
+    } else if (move.flag() >= PROMOTION_KNIGHT) {
+        moving = piece_values[Knight + ((move.flag() >> 12) & 0b11)];
+        captured += moving - piece_values[Pawn];
+    }
+
+    //swap is how much the side that just moved is ahead of the threshold if the piece on the square gets taken
+    int swap = captured - threshold;
+    if (swap < 0) {
+        return false; //Even if the piece is never taken back it's not enough
+    }
+
+    swap = moving - swap;
+    if (swap <= 0) {
+        return true; //Even losing the piece is fine
+    }
+
+    occupancy ^= get_single_bitboard(move.from());
+    Bitboard attackers = attackers_to(move.to(), occupancy) & occupancy;
+    const Bitboard diagonal_sliders = bitboards[WhiteBishop] | bitboards[BlackBishop] | bitboards[WhiteQueen] | bitboards[BlackQueen];
+    const Bitboard straight_sliders = bitboards[WhiteRook] | bitboards[BlackRook] | bitboards[WhiteQueen] | bitboards[BlackQueen];
+
+    Color side = color;
+    bool result = true;
+    Bitboard from_bb;
+    PieceType next;
+
+    while (true) {
+        side = ~side;
+        attackers &= occupancy;
+
+        from_bb = side == WHITE ? least_valuable_attacker<WHITE>(attackers, next) : least_valuable_attacker<BLACK>(attackers, next);
+        if (!from_bb) {
+            break;
+        }
+
+        result = !result;
+
+        //The king can only capture if there's nothing left to take it back
+        if (next == King) {
+            Bitboard other = side == WHITE ? all_bitboards<BLACK>() : all_bitboards<WHITE>();
+            return (attackers & other) ? !result : result;
+        }
+
+        swap = piece_values[next] - swap;
+        if (swap < int(result)) {
+            break;
+        }
+
+        occupancy ^= from_bb;
+        if (next == Pawn || next == Bishop || next == Queen) {
+            attackers |= get_attacks<Bishop>(move.to(), occupancy) & diagonal_sliders;
+        }
+        if (next == Rook || next == Queen) {
+            attackers |= get_attacks<Rook>(move.to(), occupancy) & straight_sliders;
+        }
+    }
+
+    return result;
+}
+
+//Finds the moving piece with reverse attacks from the destination square, then only checks those pieces for pins and checks,
+//so no moves have to be generated except for castling and en passant
+template<Color color>
+Move Chess::fromSAN(std::string_view san) const {
+    //Check, mate and annotation markers don't change the move
+    while (!san.empty() && (san.back() == '+' || san.back() == '#' || san.back() == '!' || san.back() == '?')) {
+        san.remove_suffix(1);
+    }
+
+    //Castling is rare enough to just look for it in the legal moves
+    if (san == "O-O" || san == "0-0" || san == "O-O-O" || san == "0-0-0") {
+        const Flag flag = san.size() == 3 ? CASTLE_SHORT : CASTLE_LONG;
+        for (Move move : getMoves<color>()) {
+            if (move.flag() == flag) {
+                return move;
+            }
+        }
+        return Move();
+    }
+
+    //Promotions are written as e8=Q, or sometimes e8Q
+    PieceType promotion = NoPieceType;
+    if (san.size() >= 3 && std::string_view("NBRQ").find(san.back()) != std::string_view::npos) {
+        promotion = PieceType(Knight + std::string_view("NBRQ").find(san.back()));
+        san.remove_suffix(1);
+        if (san.back() == '=') {
+            san.remove_suffix(1);
+        }
+    }
+
+    if (san.size() < 2 || san[san.size() - 2] < 'a' || san[san.size() - 2] > 'h' || san.back() < '1' || san.back() > '8') {
+        return Move();
+    }
+    const Square to = (san.back() - '1') * 8 + (san[san.size() - 2] - 'a');
+    san.remove_suffix(2);
+
+    PieceType piece = Pawn;
+    if (!san.empty() && std::string_view("NBRQK").find(san.front()) != std::string_view::npos) {
+        piece = PieceType(Knight + std::string_view("NBRQK").find(san.front()));
+        san.remove_prefix(1);
+    }
+
+    const bool capture = !san.empty() && (san.back() == 'x' || san.back() == ':');
+    if (capture) {
+        san.remove_suffix(1);
+    }
+
+    //Whatever is left says which file or rank the piece comes from
+    Bitboard from_mask = ~Bitboard(0);
+    for (char c : san) {
+        if (c >= 'a' && c <= 'h') {
+            from_mask &= LEFT_COLUMN << (c - 'a');
+        } else if (c >= '1' && c <= '8') {
+            from_mask &= BOTTOM_ROW << (8 * (c - '1'));
+        } else {
+            return Move();
+        }
+    }
+
+    //Pawns have to promote when they reach the last rank and nothing else can
+    if ((promotion != NoPieceType) != (piece == Pawn && (get_single_bitboard(to) & promotion_row<color>()))) {
+        return Move();
+    }
+
+    const Bitboard friendly = all_bitboards<color>();
+    const Bitboard all = friendly | all_bitboards<~color>();
+    const Bitboard target = get_single_bitboard(to);
+    if (target & friendly) {
+        return Move();
+    }
+
+    //Pieces that could get to the square
+    Bitboard candidates;
+    constexpr int8_t forward = color == WHITE ? 8 : -8;
+    switch (piece) {
+        case Pawn:
+            if (capture) {
+                candidates = pawn_attacks<~color>(target);
+            } else if ((target & all) || (color == WHITE ? to < 16 : to >= 48)) {
+                candidates = 0; //Pushes have to land on an empty square in front of where a pawn can be
+            } else if (mailbox[to - forward] == makePiece(Pawn, color)) {
+                candidates = get_single_bitboard(to - forward);
+            } else if (mailbox[to - forward] == NoPiece && (target & (color == WHITE ? Bitboard(0xFF000000) : Bitboard(0xFF00000000)))) {
+                candidates = get_single_bitboard(to - 2 * forward);
+            } else {
+                candidates = 0;
+            }
+            break;
+        case Knight:
+            candidates = get_attacks<Knight>(to, all);
+            break;
+        case Bishop:
+            candidates = get_attacks<Bishop>(to, all);
+            break;
+        case Rook:
+            candidates = get_attacks<Rook>(to, all);
+            break;
+        case Queen:
+            candidates = get_attacks<Queen>(to, all);
+            break;
+        default:
+            candidates = get_attacks<King>(to, all);
+            break;
+    }
+    candidates &= get_bitboard(piece, color) & from_mask;
+
+    //En passant captures onto an empty square. Its legality is awkward so check it against the generated moves
+    if (piece == Pawn && capture && !(target & all)) {
+        for (Move move : getMoves<color>()) {
+            if (move.flag() == EN_PASSANT && move.to() == to && (get_single_bitboard(move.from()) & candidates)) {
+                return move;
+            }
+        }
+        return Move();
+    }
+
+    //Throw out candidates that would leave the king in check
+    const Square king_square = bitScanForward(get_bitboard(King, color));
+    Bitboard checkers, pinned;
+    checks_and_pins<color>(king_square, all, friendly, checkers, pinned);
+    if (piece == King) {
+        if (target & danger_squares<color>(all)) {
+            return Move();
+        }
+    } else {
+        if (pop_count(checkers) > 1 ||
+            (checkers && !(target & (checkers | connecting_masks[king_square][bitScanForward(checkers)])))) {
+            return Move();
+        }
+        Bitboard bb = candidates & pinned;
+        while (bb) {
+            if (!(ray_masks[king_square][bitScanForward(bb)] & target)) {
+                candidates ^= bb & -bb;
+            }
+            bb &= bb - 1;
+        }
+    }
+
+    if (pop_count(candidates) != 1) {
+        return Move(); //Nothing can get there or the move is ambiguous
+    }
+    const Square from = bitScanForward(candidates);
+
+    if (promotion != NoPieceType) {
+        const Flag base = (target & all) ? PROMOTION_CAPTURE_KNIGHT : PROMOTION_KNIGHT;
+        return Move(from, to, Flag(base | ((promotion - Knight) << 12)));
+    }
+    if (target & all) {
+        return Move(from, to, CAPTURE);
+    }
+    if (piece == Pawn && std::abs(from - to) == 16) {
+        return Move(from, to, DOUBLE_PUSH);
+    }
+    return Move(from, to, QUIET);
+}
+
+//Pieces of a side that attack a square, with the side's pieces given by type
+template<Color side>
+inline Bitboard Chess::attackers_after(Square sq, Bitboard occupancy, const Bitboard pieces[7]) {
+    return (pawn_attacks<~side>(get_single_bitboard(sq)) & pieces[Pawn]) |
+           (knight_masks[sq] & pieces[Knight]) |
+           (king_masks[sq] & pieces[King]) |
+           (get_attacks<Bishop>(sq, occupancy) & (pieces[Bishop] | pieces[Queen])) |
+           (get_attacks<Rook>(sq, occupancy) & (pieces[Rook] | pieces[Queen]));
+}
+
+//Whether a checking move by color is mate. Only called after a check, so only has to look for evasions:
+//king moves, then capturing or blocking a single checker with a piece that isn't pinned
+template<Color color>
+bool Chess::mated_after(Move move, Bitboard occupancy, const Bitboard ours[7], const Bitboard theirs[7]) const {
+    const Square king_square = bitScanForward(theirs[King]);
+    const Bitboard checkers = attackers_after<color>(king_square, occupancy, ours);
+
+    //Whether their king is safe after one of their pieces moves from from to to, taking whatever of ours is on to
+    auto safe = [&](Bitboard from, Bitboard to, Bitboard captured) {
+        Bitboard remaining[7];
+        for (int type = Pawn; type <= King; type++) {
+            remaining[type] = ours[type] & ~captured;
+        }
+        const Bitboard king = (from & theirs[King]) ? to : theirs[King];
+        return !attackers_after<color>(bitScanForward(king), (occupancy & ~from & ~captured) | to, remaining);
+    };
+
+    Bitboard their_pieces = 0;
+    for (int type = Pawn; type <= King; type++) {
+        their_pieces |= theirs[type];
+    }
+
+    Bitboard bb = king_masks[king_square] & ~their_pieces;
+    while (bb) {
+        if (safe(theirs[King], bb & -bb, bb & -bb)) {
+            return false;
+        }
+        bb &= bb - 1;
+    }
+
+    if (pop_count(checkers) > 1) {
+        return true;
+    }
+
+    //Every square that stops the check, the checker first
+    const Square checker = bitScanForward(checkers);
+    constexpr int8_t forward = color == WHITE ? -8 : 8; //Their pawns' direction
+    Bitboard targets = checkers | connecting_masks[king_square][checker];
+    while (targets) {
+        const Square target = bitScanForward(targets);
+        const Bitboard target_bb = targets & -targets;
+        targets &= targets - 1;
+
+        Bitboard movers = (knight_masks[target] & theirs[Knight]) |
+                          (get_attacks<Bishop>(target, occupancy) & (theirs[Bishop] | theirs[Queen])) |
+                          (get_attacks<Rook>(target, occupancy) & (theirs[Rook] | theirs[Queen]));
+        if (target_bb & checkers) {
+            movers |= pawn_attacks<color>(target_bb) & theirs[Pawn];
+        } else {
+            if (theirs[Pawn] & get_single_bitboard(target - forward)) {
+                movers |= get_single_bitboard(target - forward);
+            } else if (!(occupancy & get_single_bitboard(target - forward)) &&
+                       (target_bb & (color == WHITE ? Bitboard(0xFF00000000) : Bitboard(0xFF000000)))) {
+                movers |= theirs[Pawn] & get_single_bitboard(target - 2 * forward);
+            }
+        }
+
+        while (movers) {
+            if (safe(movers & -movers, target_bb, target_bb & checkers)) {
+                return false;
+            }
+            movers &= movers - 1;
+        }
+    }
+
+    //A pawn that just gave check with a double push can be taken en passant
+    if (move.flag() == DOUBLE_PUSH && checker == move.to()) {
+        const Bitboard passed = get_single_bitboard(move.to() + forward);
+        Bitboard movers = pawn_attacks<color>(passed) & theirs[Pawn];
+        while (movers) {
+            if (safe(movers & -movers, passed, checkers)) {
+                return false;
+            }
+            movers &= movers - 1;
+        }
+    }
+
+    return true;
+}
+
+//Disambiguation only looks at the other pieces of the same type that attack the destination, and checks are found by
+//building the bitboards of the position after the move instead of making it
+template<Color color>
+size_t Chess::toSAN(Move move, char *out) const {
+    char *end = out;
+    const Square from = move.from();
+    const Square to = move.to();
+    const Bitboard from_bb = get_single_bitboard(from);
+    const Bitboard to_bb = get_single_bitboard(to);
+    const PieceType type = getPieceType(mailbox[from]);
+    const PieceType placed = move.isPromotion() ? PieceType(Knight + ((move.flag() >> 12) & 0b11)) : type;
+
+    const Bitboard friendly = all_bitboards<color>();
+    const Bitboard all = friendly | all_bitboards<~color>();
+
+    if (move.flag() == CASTLE_SHORT || move.flag() == CASTLE_LONG) {
+        *end++ = 'O';
+        *end++ = '-';
+        *end++ = 'O';
+        if (move.flag() == CASTLE_LONG) {
+            *end++ = '-';
+            *end++ = 'O';
+        }
+    } else if (type == Pawn) {
+        if (move.isCapture()) {
+            *end++ = 'a' + (from & 7);
+            *end++ = 'x';
+        }
+        *end++ = 'a' + (to & 7);
+        *end++ = '1' + (to >> 3);
+        if (move.isPromotion()) {
+            *end++ = '=';
+            *end++ = "NBRQ"[placed - Knight];
+        }
+    } else {
+        *end++ = "NBRQK"[type - Knight];
+
+        //Other pieces of the same type that could also go there, leaving out pinned ones that can't
+        Bitboard others = 0;
+        switch (type) {
+            case Knight: others = get_attacks<Knight>(to, all); break;
+            case Bishop: others = get_attacks<Bishop>(to, all); break;
+            case Rook:   others = get_attacks<Rook>(to, all);   break;
+            case Queen:  others = get_attacks<Queen>(to, all);  break;
+            default: break; //There's only one king
+        }
+        others &= get_bitboard(type, color) & ~from_bb;
+        if (others) {
+            const Square king_square = bitScanForward(get_bitboard(King, color));
+            Bitboard checkers, pinned;
+            checks_and_pins<color>(king_square, all, friendly, checkers, pinned);
+            Bitboard bb = others & pinned;
+            while (bb) {
+                if (!(ray_masks[king_square][bitScanForward(bb)] & to_bb)) {
+                    others ^= bb & -bb;
+                }
+                bb &= bb - 1;
+            }
+        }
+
+        if (others) {
+            if (!(others & (LEFT_COLUMN << (from & 7)))) {
+                *end++ = 'a' + (from & 7);
+            } else if (!(others & (BOTTOM_ROW << (from & ~7)))) {
+                *end++ = '1' + (from >> 3);
+            } else {
+                *end++ = 'a' + (from & 7);
+                *end++ = '1' + (from >> 3);
+            }
+        }
+
+        if (move.isCapture()) {
+            *end++ = 'x';
+        }
+        *end++ = 'a' + (to & 7);
+        *end++ = '1' + (to >> 3);
+    }
+
+    //The position after the move
+    Bitboard captured = 0;
+    if (move.flag() == EN_PASSANT) {
+        captured = get_single_bitboard(color == WHITE ? to - 8 : to + 8);
+    } else if (move.isCapture()) {
+        captured = to_bb;
+    }
+    Bitboard occupancy = (all & ~from_bb & ~captured) | to_bb;
+
+    Bitboard ours[7], theirs[7];
+    for (int piece = Pawn; piece <= King; piece++) {
+        ours[piece] = get_bitboard(PieceType(piece), color);
+        theirs[piece] = get_bitboard(PieceType(piece), ~color) & ~captured;
+    }
+    ours[type] &= ~from_bb;
+    ours[placed] |= to_bb;
+
+    if (move.flag() == CASTLE_SHORT || move.flag() == CASTLE_LONG) {
+        //The rook goes to the square the king crosses
+        const Bitboard rook = move.flag() == CASTLE_SHORT ? from_bb << 3 | from_bb << 1 : from_bb >> 4 | from_bb >> 1;
+        ours[Rook] ^= rook;
+        occupancy ^= rook;
+    }
+
+    if (attackers_after<color>(bitScanForward(theirs[King]), occupancy, ours)) {
+        *end++ = mated_after<color>(move, occupancy, ours, theirs) ? '#' : '+';
+    }
+
+    *end = '\0';
+    return end - out;
+}
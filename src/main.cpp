@@ -1,26 +1,69 @@
 #include "game.h"
 #include "uci.h"
+#include "playout.h"
+#include "nnue.h"
+#include "pgn.h"
+#include "training.h"
+#include "selfplay.h"
+#include "polyglot.h"
+#include "book_builder.h"
+#include "position_index.h"
+#include "tablebase.h"
+#include "perft.h"
 #include <iostream>
 #include <string>
 #include <sstream>
 
 using std::string, std::skipws;
 
-int main() {
+int main(int argc, char **argv) {
     Magic::initializeTables();
+
+    //Batch jobs are run straight from the command line instead of through UCI
+    if (argc > 1) {
+        string args;
+        for (int i = 2; i < argc; i++) {
+            args += string(argv[i]) + ' ';
+        }
+        std::istringstream stream(args);
+
+        if (string(argv[1]) == "playouts") return Playout::command(stream);
+        if (string(argv[1]) == "nnuebench") return NNUE::command(stream);
+        if (string(argv[1]) == "pgn") return PGN::command(stream);
+        if (string(argv[1]) == "data") return Training::command(stream);
+        if (string(argv[1]) == "selfplay") return Selfplay::command(stream);
+        if (string(argv[1]) == "book") return Polyglot::command(stream);
+        if (string(argv[1]) == "buildbook") return BookBuilder::command(stream);
+        if (string(argv[1]) == "index") return PositionIndex::indexCommand(stream);
+        if (string(argv[1]) == "query") return PositionIndex::queryCommand(stream);
+        if (string(argv[1]) == "tbgen") return Tablebase::command(stream);
+        if (string(argv[1]) == "tbprobe") return Tablebase::probeCommand(stream);
+        if (string(argv[1]) == "legalcheck") return legalCheckCommand(stream);
+
+        std::cout << "Unknown command \"" << argv[1] << "\".\n";
+        return 1;
+    }
+
     Chess game;
     Color color = WHITE;
 
     string cmd, fcmd; //fcmd is the first word in the command (cmd)
     do {
-        if (!getline(std::cin, cmd))
-            cmd = "quit"; //Break on EOF
+        if (!getline(std::cin, cmd)) {
+            UCI::wait(); //Let anything still running finish on EOF so piped input gets all its output
+            break;
+        }
 
         std::istringstream stream(cmd);
         stream >> skipws >> fcmd;
 
         if (fcmd == "go") UCI::go(stream, game, color);
+        else if (fcmd == "stop" || fcmd == "quit") UCI::stop();
+        else if (fcmd == "isready") std::cout << "readyok" << std::endl;
+        else if (fcmd == "uci") UCI::uci();
+        else if (fcmd == "ucinewgame") UCI::newGame();
         else if (fcmd == "position") UCI::position(stream, game, color);
+        else if (fcmd == "setoption") UCI::setoption(stream);
         else if (fcmd == "d") game.print();
 
         stream.clear();
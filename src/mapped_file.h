@@ -0,0 +1,53 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+//Read only view of a whole file through the page cache, so large files like game dumps
+//don't have to be read into memory first and every thread can look at them without copying
+class MappedFile {
+  public:
+    //Hint for the kernel's readahead. Books and tablebases are probed all over the place so readahead only wastes cache
+    enum Access {
+        SEQUENTIAL,
+        RANDOM
+    };
+
+    MappedFile() = default;
+    explicit MappedFile(const std::string &path, Access access = SEQUENTIAL) {
+        open(path, access);
+    }
+    ~MappedFile() {
+        close();
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile &operator=(const MappedFile&) = delete;
+
+    //Returns false if the file can't be opened. Empty files open fine with a size of 0
+    bool open(const std::string &path, Access access = SEQUENTIAL);
+    void close();
+
+    inline bool isOpen() const {
+        return bytes != nullptr;
+    }
+    inline const char *data() const {
+        return bytes;
+    }
+    inline size_t size() const {
+        return length;
+    }
+    inline std::string_view view() const {
+        return std::string_view(bytes, length);
+    }
+
+  private:
+    const char *bytes = nullptr;
+    size_t length = 0;
+    bool mapped = false; //Empty files point at a static empty string instead of a mapping
+
+#ifdef _WIN32
+    void *file = nullptr;
+    void *mapping = nullptr;
+#endif
+};
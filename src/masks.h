@@ -11,6 +11,8 @@ const Bitboard TOP_TWO = 0xFFFF000000000000;
 const Bitboard BOTTOM_TWO = 0xFFFF;
 const Bitboard RIGHT_TWO = 0xC0C0C0C0C0C0C0C0;
 const Bitboard LEFT_TWO= 0x303030303030303;
+const Bitboard LIGHT_SQUARES = 0x55AA55AA55AA55AA;
+const Bitboard DARK_SQUARES = 0xAA55AA55AA55AA55;
 
 extern const Bitboard rook_masks[64];
 extern const Bitboard rook_masks_edge[64];
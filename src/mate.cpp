@@ -0,0 +1,288 @@
+#include "mate.h"
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <iostream>
+
+namespace {
+    typedef std::chrono::steady_clock Clock;
+
+    constexpr uint32_t INF = 1 << 30; //Proof or disproof number of a position that's been decided
+    constexpr size_t TABLE_SIZE = 1 << 21; //Entries in the hash table, always a power of two
+
+    inline uint32_t add(uint32_t a, uint32_t b) {
+        return std::min(a + b, INF);
+    }
+
+    //Proof and disproof numbers are always from the attacker's point of view
+    //pn is how many more positions need to be proven for a mate and dn is the same for there being no mate
+    struct Entry {
+        uint64_t key;
+        uint32_t pn;
+        uint32_t dn;
+        int depth; //Plies left when this was stored
+    };
+
+    struct Solver {
+        Chess game;
+        Color attacker;
+        std::vector<Entry> table;
+        uint64_t nodes = 0;
+        const std::atomic<bool> &stop;
+        bool stopped = false;
+
+        Solver(const Chess &game, Color attacker, const std::atomic<bool> &stop) : game(game), attacker(attacker), table(TABLE_SIZE), stop(stop) {}
+
+        //A mate in fewer plies is still a mate with more plies to spare, and no mate in more plies means no mate in fewer
+        //so decided results are used across depths
+        inline bool lookup(int depth, uint32_t &pn, uint32_t &dn) const {
+            const uint64_t key = game.getKey();
+            const Entry &entry = table[key & (TABLE_SIZE - 1)];
+            if (entry.key != key || !(entry.depth == depth || (entry.pn == 0 && entry.depth <= depth) || (entry.dn == 0 && entry.depth >= depth))) {
+                return false;
+            }
+            pn = entry.pn;
+            dn = entry.dn;
+            return true;
+        }
+
+        inline void store(int depth, uint32_t pn, uint32_t dn) {
+            const uint64_t key = game.getKey();
+            table[key & (TABLE_SIZE - 1)] = Entry{key, pn, dn, depth};
+        }
+    };
+
+    //Proof numbers for a position that hasn't been searched yet
+    //A defender with fewer moves is easier to mate so that's the proof number, which puts checks first
+    template<Color color>
+    void initial_numbers(Solver &s, int depth, uint32_t &pn, uint32_t &dn) {
+        if (s.lookup(depth, pn, dn)) {
+            return;
+        }
+
+        //Out of plies, so it's only a mate if the defender is already mated
+        if (depth <= 0) {
+            const bool mated = color != s.attacker && s.game.inCheck<color>() && !s.game.hasLegalMove<color>();
+            pn = mated ? 0 : INF;
+            dn = mated ? INF : 0;
+            s.store(depth, pn, dn);
+            return;
+        }
+
+        if (color == s.attacker) {
+            //The attacker having no moves is never a mate for them
+            pn = s.game.hasLegalMove<color>() ? 1 : INF;
+            dn = pn == 1 ? 1 : 0;
+        } else {
+            const size_t moves = s.game.getMoves<color>().size(); //Only evasions when in check from the fast paths in genMove
+            if (moves == 0) {
+                pn = s.game.inCheck<color>() ? 0 : INF;
+                dn = pn ? 0 : INF;
+            } else {
+                pn = moves;
+                dn = 1;
+            }
+        }
+        s.store(depth, pn, dn);
+    }
+
+    //Searches until the position's proof number reaches pn_threshold or its disproof number reaches dn_threshold
+    //The attacker picks moves so an OR node is proven by any child and an AND node needs all of them
+    template<Color color>
+    void mid(Solver &s, int depth, uint32_t pn_threshold, uint32_t dn_threshold, uint32_t &pn, uint32_t &dn) {
+        Chess &game = s.game;
+        constexpr size_t STOP_CHECK = 1024;
+        if (++s.nodes % STOP_CHECK == 0 && s.stop.load(std::memory_order_relaxed)) {
+            s.stopped = true;
+        }
+
+        const bool or_node = color == s.attacker;
+
+        const MoveArray moves = game.getMoves<color>();
+        if (moves.size() == 0 || depth <= 0) {
+            initial_numbers<color>(s, depth, pn, dn);
+            return;
+        }
+
+        //Children's numbers are kept here between iterations so only the child that was just searched changes
+        //At OR nodes checks go first so ties go to them. With one ply left nothing else can mate so the rest are dropped
+        Move children[MOVE_VECTOR_SIZE];
+        uint32_t child_pn[MOVE_VECTOR_SIZE], child_dn[MOVE_VECTOR_SIZE];
+        size_t count = 0;
+        Move quiet[MOVE_VECTOR_SIZE];
+        size_t quiet_count = 0;
+
+        for (Move move : moves) {
+            game.makeMove<color>(move);
+            if (!or_node || game.inCheck<~color>()) {
+                initial_numbers<~color>(s, depth - 1, child_pn[count], child_dn[count]);
+                children[count++] = move;
+            } else if (depth > 1) {
+                quiet[quiet_count++] = move;
+            }
+            game.unmakeMove<color>(move);
+        }
+        for (size_t i = 0; i < quiet_count; i++) {
+            game.makeMove<color>(quiet[i]);
+            initial_numbers<~color>(s, depth - 1, child_pn[count], child_dn[count]);
+            game.unmakeMove<color>(quiet[i]);
+            children[count++] = quiet[i];
+        }
+
+        if (count == 0) {
+            pn = INF;
+            dn = 0;
+            s.store(depth, pn, dn);
+            return;
+        }
+
+        while (true) {
+            //Gather the children's numbers and the best and second best child to search
+            pn = or_node ? INF : 0;
+            dn = or_node ? 0 : INF;
+            size_t best = 0;
+            uint32_t best_value = INF + 1, second_value = INF;
+
+            for (size_t i = 0; i < count; i++) {
+                if (or_node) {
+                    pn = std::min(pn, child_pn[i]);
+                    dn = add(dn, child_dn[i]);
+                } else {
+                    pn = add(pn, child_pn[i]);
+                    dn = std::min(dn, child_dn[i]);
+                }
+
+                //OR nodes go for the easiest proof and AND nodes for the easiest disproof
+                const uint32_t value = or_node ? child_pn[i] : child_dn[i];
+                if (value < best_value) {
+                    second_value = best_value;
+                    best_value = value;
+                    best = i;
+                } else if (value < second_value) {
+                    second_value = value;
+                }
+            }
+
+            if (pn >= pn_threshold || dn >= dn_threshold || s.stopped) {
+                s.store(depth, pn, dn);
+                return;
+            }
+
+            //The child is searched until it stops being the best or the thresholds here are reached
+            //Letting it go a bit past the second best (the 1 + epsilon trick) stops the search flipping between two children
+            const uint32_t second_threshold = add(second_value, second_value + 1);
+            uint32_t child_pn_threshold, child_dn_threshold;
+            if (or_node) {
+                child_pn_threshold = std::min(pn_threshold, second_threshold);
+                child_dn_threshold = add(dn_threshold - dn, child_dn[best]);
+            } else {
+                child_pn_threshold = add(pn_threshold - pn, child_pn[best]);
+                child_dn_threshold = std::min(dn_threshold, second_threshold);
+            }
+
+            game.makeMove<color>(children[best]);
+            mid<~color>(s, depth - 1, child_pn_threshold, child_dn_threshold, child_pn[best], child_dn[best]);
+            game.unmakeMove<color>(children[best]);
+        }
+    }
+
+    template<Color color>
+    bool prove(Solver &s, int depth) {
+        uint32_t pn, dn;
+        if (!s.lookup(depth, pn, dn) || (pn && dn)) {
+            mid<color>(s, depth, INF, INF, pn, dn);
+        }
+        return pn == 0 && !s.stopped;
+    }
+
+    //Walks down the proof of a mate in exactly depth plies. The attacker keeps it that short and the defender keeps it that long
+    template<Color color>
+    void mating_line(Solver &s, int depth, std::vector<Move> &line) {
+        if (depth <= 0 || s.stopped) {
+            return;
+        }
+
+        Chess &game = s.game;
+        MoveArray moves = game.getMoves<color>();
+        Move chosen;
+
+        if (color == s.attacker) {
+            //Any move that mates in the plies left will do. Check the table first since it has the moves that were proven
+            for (int pass = 0; pass < 2 && !chosen.raw(); pass++) {
+                for (Move move : moves) {
+                    uint32_t pn = INF, dn = 0;
+                    game.makeMove<color>(move);
+                    const bool mates = pass == 0 ? s.lookup(depth - 1, pn, dn) && pn == 0 : prove<~color>(s, depth - 1);
+                    game.unmakeMove<color>(move);
+                    if (mates) {
+                        chosen = move;
+                        break;
+                    }
+                }
+            }
+        } else {
+            //Every reply gets mated in time, so find one that can't be mated any faster
+            for (Move move : moves) {
+                game.makeMove<color>(move);
+                const bool faster = depth - 3 >= 1 && prove<~color>(s, depth - 3);
+                game.unmakeMove<color>(move);
+                if (!faster) {
+                    chosen = move;
+                    break;
+                }
+            }
+        }
+
+        if (!chosen.raw() || s.stopped) {
+            return;
+        }
+        line.push_back(chosen);
+        game.makeMove<color>(chosen);
+        mating_line<~color>(s, depth - 1, line);
+        game.unmakeMove<color>(chosen);
+    }
+
+    template<Color color>
+    Move solve(Solver &s, int max_moves, Clock::time_point start) {
+        for (int moves = 1; moves <= max_moves; moves++) {
+            const int depth = 2 * moves - 1;
+            if (!prove<color>(s, depth)) {
+                if (s.stopped) {
+                    break;
+                }
+                continue;
+            }
+
+            std::vector<Move> line;
+            mating_line<color>(s, depth, line);
+
+            const int64_t time = std::max<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count(), 1);
+            std::cout << "info depth " << depth << " score mate " << moves << " nodes " << s.nodes << " nps " << s.nodes * 1000 / time
+                      << " time " << time << " pv";
+            for (Move move : line) {
+                std::cout << ' ' << move.UCI();
+            }
+            std::cout << std::endl;
+            return line.empty() ? Move() : line[0];
+        }
+
+        if (s.stopped) {
+            std::cout << "info string stopped before finding a mate" << std::endl;
+        } else {
+            std::cout << "info string no mate in " << max_moves << " found" << std::endl;
+        }
+        return Move();
+    }
+}
+
+namespace Mate {
+    Move go(const Chess &game, Color color, int moves, const std::atomic<bool> &stop) {
+        std::unique_ptr<Solver> solver = std::make_unique<Solver>(game, color, stop); //Too big for the stack
+        const Clock::time_point start = Clock::now();
+
+        const Move best = color == WHITE ? solve<WHITE>(*solver, moves, start) : solve<BLACK>(*solver, moves, start);
+        std::cout << "bestmove " << (best.raw() ? best.UCI() : "0000") << std::endl;
+        return best;
+    }
+}
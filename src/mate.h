@@ -0,0 +1,10 @@
+#pragma once
+#include "game.h"
+#include <atomic>
+
+namespace Mate {
+    //Depth-first proof-number search for a forced mate in at most moves moves
+    //Tries mate in 1, 2... so the first one proven is the shortest, then prints its line and the first move
+    //Setting stop from another thread ends the search early
+    Move go(const Chess &game, Color color, int moves, const std::atomic<bool> &stop);
+}
@@ -0,0 +1,258 @@
+#include "mcts.h"
+#include "playout.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+
+namespace {
+    typedef std::chrono::steady_clock Clock;
+
+    constexpr float EXPLORATION = 1.41f; //UCT exploration constant
+    constexpr uint32_t VIRTUAL_LOSS = 3; //Visits a thread adds as losses on its way down so others pick different moves
+    constexpr uint32_t EXPAND_VISITS = VIRTUAL_LOSS + 1; //A leaf gets its children once it has finished a playout
+    constexpr uint64_t MAX_NODES = uint64_t(1) << 24;
+    constexpr uint64_t NODES_PER_PLAYOUT = 40; //Roughly the branching factor since each playout expands at most one node
+
+    enum NodeState : uint8_t {
+        UNEXPANDED,
+        EXPANDING, //Another thread is adding its children, treat it as a leaf until it's done
+        EXPANDED,
+        TERMINAL_LOSS, //Side to move is checkmated
+        TERMINAL_DRAW
+    };
+
+    struct Node {
+        std::atomic<uint32_t> visits; //Includes virtual losses from threads below this node
+        std::atomic<uint32_t> score; //Half points for the side that played the move into this node
+        std::atomic<uint32_t> first_child;
+        std::atomic<uint16_t> child_count;
+        std::atomic<uint8_t> state;
+        Move move;
+
+        inline void init(Move m) {
+            visits.store(0, std::memory_order_relaxed);
+            score.store(0, std::memory_order_relaxed);
+            first_child.store(0, std::memory_order_relaxed);
+            child_count.store(0, std::memory_order_relaxed);
+            state.store(UNEXPANDED, std::memory_order_relaxed);
+            move = m;
+        }
+    };
+
+    //All the nodes come out of one block. Children of a node are next to each other so a node just stores where they start
+    struct Tree {
+        std::unique_ptr<Node[]> nodes;
+        uint64_t capacity;
+        std::atomic<uint64_t> used {0};
+
+        explicit Tree(uint64_t size) : nodes(new Node[size]), capacity(size) {}
+
+        //Returns 0 if the tree is full, which is never a valid child since the root is there
+        inline uint32_t allocate(uint32_t count) {
+            const uint64_t index = used.fetch_add(count, std::memory_order_relaxed);
+            return index + count <= capacity ? uint32_t(index) : 0;
+        }
+    };
+
+    struct ThreadData {
+        Tree *tree;
+        Chess game;
+        Xorshift rng;
+
+        ThreadData(Tree *tree, const Chess &game, uint64_t seed) : tree(tree), game(game), rng(seed) {}
+    };
+
+    template<Color color>
+    void expand(ThreadData &t, Node &node) {
+        uint8_t expected = UNEXPANDED;
+        if (!node.state.compare_exchange_strong(expected, EXPANDING, std::memory_order_acquire)) {
+            return;
+        }
+
+        const Chess &game = t.game;
+        MoveArray moves = game.getMoves<color>();
+        if (moves.size() == 0) {
+            node.state.store(game.inCheck<color>() ? TERMINAL_LOSS : TERMINAL_DRAW, std::memory_order_release);
+            return;
+        }
+        if (game.isFiftyMove() || game.isInsufficientMaterial() || game.isRepetition()) {
+            node.state.store(TERMINAL_DRAW, std::memory_order_release);
+            return;
+        }
+
+        const uint32_t first = t.tree->allocate(moves.size());
+        if (!first) {
+            node.state.store(UNEXPANDED, std::memory_order_release); //Out of room, stays a leaf
+            return;
+        }
+
+        for (size_t i = 0; i < moves.size(); i++) {
+            t.tree->nodes[first + i].init(moves[i]);
+        }
+        node.first_child.store(first, std::memory_order_relaxed);
+        node.child_count.store(moves.size(), std::memory_order_relaxed);
+        node.state.store(EXPANDED, std::memory_order_release); //Publishes the children
+    }
+
+    //UCT. Unvisited children go first, then the best win rate plus a bonus for being looked at less
+    inline uint32_t select(const Tree &tree, const Node &node) {
+        const uint32_t first = node.first_child.load(std::memory_order_relaxed);
+        const uint16_t count = node.child_count.load(std::memory_order_relaxed);
+        const float log_visits = std::log(float(std::max<uint32_t>(node.visits.load(std::memory_order_relaxed), 1)));
+
+        uint32_t best = first;
+        float best_value = -1;
+        for (uint32_t i = first; i < first + count; i++) {
+            const uint32_t visits = tree.nodes[i].visits.load(std::memory_order_relaxed);
+            if (visits == 0) {
+                return i;
+            }
+
+            const float value = tree.nodes[i].score.load(std::memory_order_relaxed) / (2.0f * visits) +
+                                EXPLORATION * std::sqrt(log_visits / visits);
+            if (value > best_value) {
+                best_value = value;
+                best = i;
+            }
+        }
+        return best;
+    }
+
+    //One iteration from a node down to a leaf, a playout from there, and the result back up
+    //Returns the result for the side to move at the node
+    template<Color color>
+    int descend(ThreadData &t, uint32_t index) {
+        Node &node = t.tree->nodes[index];
+
+        uint8_t state = node.state.load(std::memory_order_acquire);
+        if (state == UNEXPANDED && node.visits.load(std::memory_order_relaxed) >= EXPAND_VISITS) {
+            expand<color>(t, node);
+            state = node.state.load(std::memory_order_acquire);
+        }
+
+        switch (state) {
+            case TERMINAL_LOSS:
+                return PLAYOUT_LOSS;
+            case TERMINAL_DRAW:
+                return PLAYOUT_DRAW;
+            case EXPANDED:
+                break;
+            default:
+                return randomPlayout<color>(t.game, t.rng);
+        }
+
+        const uint32_t child_index = select(*t.tree, node);
+        Node &child = t.tree->nodes[child_index];
+        child.visits.fetch_add(VIRTUAL_LOSS, std::memory_order_relaxed);
+
+        t.game.makeMove<color>(child.move);
+        const int result = PLAYOUT_WIN - descend<~color>(t, child_index);
+        t.game.unmakeMove<color>(child.move);
+
+        //Swap the virtual loss for the real result
+        child.visits.fetch_add(1 - VIRTUAL_LOSS, std::memory_order_relaxed);
+        child.score.fetch_add(result, std::memory_order_relaxed);
+        return result;
+    }
+
+    template<Color color>
+    void search(ThreadData &t, std::atomic<uint64_t> &started, uint64_t playouts, const std::atomic<bool> &stop) {
+        Node &root = t.tree->nodes[0];
+        while (!stop.load(std::memory_order_relaxed) && started.fetch_add(1, std::memory_order_relaxed) < playouts) {
+            root.visits.fetch_add(1, std::memory_order_relaxed);
+            descend<color>(t, 0);
+        }
+    }
+}
+
+namespace MCTS {
+    Move go(const Chess &game, Color color, uint64_t playouts, size_t threads, const std::atomic<bool> &stop) {
+        threads = std::max<size_t>(threads, 1);
+        Tree tree(std::min(playouts * NODES_PER_PLAYOUT + 1, MAX_NODES));
+        tree.nodes[tree.allocate(1)].init(Move());
+
+        std::atomic<uint64_t> started {0};
+        const Clock::time_point start = Clock::now();
+
+        //Too big for the stack
+        std::vector<std::unique_ptr<ThreadData>> data;
+        for (size_t i = 0; i < threads; i++) {
+            data.push_back(std::make_unique<ThreadData>(&tree, game, i + 1));
+        }
+
+        //Expand the root up front so every thread starts off picking between its moves
+        if (color == WHITE) {
+            expand<WHITE>(*data[0], tree.nodes[0]);
+        } else {
+            expand<BLACK>(*data[0], tree.nodes[0]);
+        }
+
+        auto run = [&](ThreadData *t) {
+            if (color == WHITE) {
+                search<WHITE>(*t, started, playouts, stop);
+            } else {
+                search<BLACK>(*t, started, playouts, stop);
+            }
+        };
+
+        std::vector<std::thread> helpers;
+        for (size_t i = 1; i < threads; i++) {
+            helpers.emplace_back(run, data[i].get());
+        }
+        run(data[0].get());
+        for (std::thread &helper : helpers) {
+            helper.join();
+        }
+
+        const int64_t time = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count();
+        const Node &root = tree.nodes[0];
+        const uint64_t done = root.visits.load();
+
+        //Root moves from most to least visited
+        std::vector<const Node*> children;
+        for (uint32_t i = 0; i < root.child_count.load(); i++) {
+            children.push_back(&tree.nodes[root.first_child.load() + i]);
+        }
+        std::sort(children.begin(), children.end(), [](const Node *a, const Node *b) {
+            return a->visits.load() > b->visits.load();
+        });
+
+        for (const Node *child : children) {
+            const uint32_t visits = child->visits.load();
+            std::cout << "info string " << child->move.UCI() << " visits " << visits << " winrate " << std::fixed << std::setprecision(1)
+                      << (visits ? 50.0 * child->score.load() / visits : 0.0) << '%' << '\n';
+        }
+
+        //Principal variation is the most visited child all the way down
+        std::cout << "info nodes " << done << " nps " << done * 1000 / std::max<int64_t>(time, 1) << " time " << time << " pv";
+        const Node *node = &root;
+        while (node->state.load() == EXPANDED) {
+            const Node *best = nullptr;
+            for (uint32_t i = 0; i < node->child_count.load(); i++) {
+                const Node *child = &tree.nodes[node->first_child.load() + i];
+                if (!best || child->visits.load() > best->visits.load()) {
+                    best = child;
+                }
+            }
+            if (!best->visits.load()) {
+                break;
+            }
+            std::cout << ' ' << best->move.UCI();
+            node = best;
+        }
+        std::cout << '\n';
+
+        std::cout << "info string " << done << " playouts in " << time << " ms, " << done * 1000 / std::max<int64_t>(time, 1)
+                  << " playouts/s with " << threads << (threads == 1 ? " thread" : " threads") << ", "
+                  << std::min<uint64_t>(tree.used.load(), tree.capacity) << " tree nodes\n";
+
+        const Move best = children.empty() ? Move() : children[0]->move;
+        std::cout << "bestmove " << (best.raw() ? best.UCI() : "0000") << std::endl;
+        return best;
+    }
+}
@@ -0,0 +1,11 @@
+#pragma once
+#include "game.h"
+#include <atomic>
+
+namespace MCTS {
+    //Monte-Carlo tree search with UCT selection and random playouts
+    //Every thread walks the same tree, using virtual loss to spread out over different lines
+    //Prints the root moves with their visits and win rates, a playout rate, then the most visited move
+    //Setting stop from another thread ends the search early
+    Move go(const Chess &game, Color color, uint64_t playouts, size_t threads, const std::atomic<bool> &stop);
+}
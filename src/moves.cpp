@@ -18,6 +18,6 @@ const std::string flag_to_string[3] = {
 
 std::ostream &operator<<(std::ostream &out, Move move) {
     std::string str;
-    str += move.UCI() + ' ' + flag_to_string[move.flag() >> 12];
+    str += move.UCI() + ' ' + flag_to_string[move.isCapture() ? 2 : 1]; //Only quiet moves and captures have names
     return out << str;
 }
\ No newline at end of file
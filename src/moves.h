@@ -3,6 +3,7 @@
 #include "piece.h"
 #include "masks.h"
 #include "magic.h"
+#include <utility>
 
 typedef uint8_t Square;
 
@@ -30,6 +31,12 @@ enum Flag : uint16_t {
     PROMOTION_CAPTURE_QUEEN  = 0b1111000000000000
 };
 
+//What the move generator should generate
+enum GenType {
+    ALL_MOVES,
+    CAPTURES //Captures, promotions and en passant. Gives every evasion when in check since those are all that's legal
+};
+
 struct Move {
   private:
     // | flag |   old_c   |   new_c   |
@@ -40,6 +47,9 @@ struct Move {
   public:
     inline Move() : move(0) {}
 
+    //Rebuilds a move from the value given by raw()
+    inline explicit Move(uint16_t raw) : move(raw) {}
+
     inline Move(Square from, Square to) {
         move = QUIET | (from << 6) | to;
     }
@@ -68,8 +78,31 @@ struct Move {
         return Flag(move & 0b1111000000000000);
     }
 
+    inline bool isCapture() const {
+        return flag() == CAPTURE || flag() == EN_PASSANT || flag() >= PROMOTION_CAPTURE_KNIGHT;
+    }
+
+    inline bool isPromotion() const {
+        return flag() >= PROMOTION_KNIGHT;
+    }
+
+    inline uint16_t raw() const {
+        return move;
+    }
+
+    inline bool operator==(Move other) const {
+        return move == other.move;
+    }
+
+    inline bool operator!=(Move other) const {
+        return move != other.move;
+    }
+
     inline std::string UCI() const {
-        //Still needs logic for special moves
+        if (flag() >= PROMOTION_KNIGHT) {
+            //Promotion flags go knight, bishop, rook, queen in the two lowest bits of the flag
+            return index_to_string[from()] + index_to_string[to()] + "nbrq"[(flag() >> 12) & 0b11];
+        }
         return index_to_string[from()] + index_to_string[to()];
     }
 
@@ -80,18 +113,27 @@ constexpr size_t MOVE_VECTOR_SIZE = 256;
 struct MoveArray {
   private:
     Move arr[MOVE_VECTOR_SIZE];
-    Move *last;
+    size_t count; //Stored as a count rather than an end pointer so the struct can be copied and returned safely
   public:
     inline const Move* begin() const {
         return arr;
     }
 
-    inline Move* end() const {
-        return last;
+    inline const Move* end() const {
+        return arr + count;
+    }
+
+    //For reordering the moves in place
+    inline Move* begin() {
+        return arr;
+    }
+
+    inline Move* end() {
+        return arr + count;
     }
 
     inline size_t size() const {
-        return last - arr;
+        return count;
     }
 
     inline Move &operator[](int index) {
@@ -102,6 +144,68 @@ struct MoveArray {
 
 };
 
+//Tables from the caller that are used to score quiet moves
+struct MoveOrdering {
+    Move hash_move; //Best move from an earlier search of the position, always searched first
+    Move killers[2]; //Quiet moves that recently caused cutoffs at the same ply
+    const int16_t (*history)[64] = nullptr; //History scores indexed by from and to square, optional
+};
+
+//Score ranges for ordering, highest gets searched first
+constexpr int16_t HASH_MOVE_SCORE = 30000;
+constexpr int16_t CAPTURE_SCORE = 20000; //Plus MVV-LVA
+constexpr int16_t PROMOTION_SCORE = 18000; //Queen promotions, other promotions go to the bottom
+constexpr int16_t KILLER_SCORE = 16000; //Minus the killer's slot
+constexpr int16_t HISTORY_LIMIT = 15000; //History scores get clamped to +-this
+constexpr int16_t UNDERPROMOTION_SCORE = -16000;
+
+//Moves with a score packed into 32 bits each, move in the bottom 16 and score in the top 16
+//The score is offset to be unsigned so the packed entries can be compared directly as integers
+//Moves get picked out in order with a selection sort that only goes as far as the moves that are actually used
+struct ScoredMoveArray {
+  private:
+    uint32_t arr[MOVE_VECTOR_SIZE];
+    size_t count;
+    size_t picked; //Moves before this have already been returned by next()
+
+    static inline uint32_t pack(Move move, int16_t score) {
+        return (uint32_t(uint16_t(score + 32768)) << 16) | move.raw();
+    }
+
+  public:
+    inline ScoredMoveArray() : count(0), picked(0) {}
+
+    inline size_t size() const {
+        return count;
+    }
+
+    inline bool empty() const {
+        return picked == count;
+    }
+
+    inline Move operator[](int index) const {
+        return Move(uint16_t(arr[index]));
+    }
+
+    inline int16_t score(int index) const {
+        return int16_t(int(arr[index] >> 16) - 32768);
+    }
+
+    //Returns the best move that hasn't been picked yet. Check empty() first
+    inline Move next() {
+        size_t best = picked;
+        for (size_t i = picked + 1; i < count; i++) {
+            if (arr[i] > arr[best]) {
+                best = i;
+            }
+        }
+        std::swap(arr[picked], arr[best]);
+        return Move(uint16_t(arr[picked++]));
+    }
+
+    friend class Chess;
+};
+
 inline Bitboard sliding_moves(Bitboard occupancy, Bitboard mask, Bitboard piece_square_bitboard) {
     return (((occupancy & mask) - piece_square_bitboard) ^
         bswap_64(bswap_64(occupancy & mask) - bswap_64(piece_square_bitboard))) & mask;
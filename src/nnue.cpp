@@ -0,0 +1,400 @@
+#include "nnue.h"
+#include "playout.h"
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+
+#if defined(__AVX2__)
+    #include <immintrin.h>
+    #define NNUE_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define NNUE_SSE2
+#endif
+
+using std::cout;
+
+namespace {
+    struct Network {
+        alignas(64) int16_t feature_weights[NNUE::FEATURES][NNUE::HIDDEN];
+        alignas(64) int16_t feature_biases[NNUE::HIDDEN];
+        alignas(64) int16_t output_weights[2 * NNUE::HIDDEN]; //Stored as int8 in the file and widened when loading
+        int32_t output_bias;
+    };
+
+    std::unique_ptr<Network> network; //Too big for static storage in every build that doesn't use it
+
+    constexpr uint32_t MAGIC = 0x45554E4E; //"NNUE" read as little endian
+    constexpr int MAX_CHANGES = 32; //Most features a refresh or a move can add or remove at once
+    constexpr int MAX_EVAL = 20000; //Keeps a badly scaled network well away from the search's mate scores
+
+    //Input index of a piece on a square, seen from one side with its king on king_square
+    //Black's view is flipped vertically with the colours swapped, so both sides see the board the same way
+    inline int feature(Color perspective, Square king_square, Piece piece, Square sq) {
+        if (perspective == BLACK) {
+            king_square ^= 56;
+            sq ^= 56;
+        }
+        const int piece_index = (getPieceType(piece) - Pawn) + (getPieceColor(piece) == perspective ? 0 : 5);
+        return (king_square * 10 + piece_index) * 64 + sq;
+    }
+
+    inline Square king_square(const Chess &game, Color color) {
+        return bitScanForward(game.getBitboard(makePiece(King, color)));
+    }
+
+    //Kernels. dst = src + the added weight columns - the removed ones. dst and src can be the same
+#if defined(NNUE_AVX2)
+    typedef __m256i vec;
+    constexpr int LANES = 16;
+    inline vec vec_load(const int16_t *p) { return _mm256_load_si256(reinterpret_cast<const vec*>(p)); }
+    inline void vec_store(int16_t *p, vec v) { _mm256_store_si256(reinterpret_cast<vec*>(p), v); }
+    inline vec vec_add16(vec a, vec b) { return _mm256_add_epi16(a, b); }
+    inline vec vec_sub16(vec a, vec b) { return _mm256_sub_epi16(a, b); }
+    inline vec vec_clamp16(vec v) { return _mm256_min_epi16(_mm256_max_epi16(v, _mm256_setzero_si256()), _mm256_set1_epi16(NNUE::QA)); }
+    inline vec vec_madd16(vec a, vec b) { return _mm256_madd_epi16(a, b); }
+    inline vec vec_add32(vec a, vec b) { return _mm256_add_epi32(a, b); }
+    inline vec vec_zero() { return _mm256_setzero_si256(); }
+    inline int32_t vec_sum32(vec v) {
+        __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0b01001110));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0b10110001));
+        return _mm_cvtsi128_si32(sum);
+    }
+#elif defined(NNUE_SSE2)
+    typedef __m128i vec;
+    constexpr int LANES = 8;
+    inline vec vec_load(const int16_t *p) { return _mm_load_si128(reinterpret_cast<const vec*>(p)); }
+    inline void vec_store(int16_t *p, vec v) { _mm_store_si128(reinterpret_cast<vec*>(p), v); }
+    inline vec vec_add16(vec a, vec b) { return _mm_add_epi16(a, b); }
+    inline vec vec_sub16(vec a, vec b) { return _mm_sub_epi16(a, b); }
+    inline vec vec_clamp16(vec v) { return _mm_min_epi16(_mm_max_epi16(v, _mm_setzero_si128()), _mm_set1_epi16(NNUE::QA)); }
+    inline vec vec_madd16(vec a, vec b) { return _mm_madd_epi16(a, b); }
+    inline vec vec_add32(vec a, vec b) { return _mm_add_epi32(a, b); }
+    inline vec vec_zero() { return _mm_setzero_si128(); }
+    inline int32_t vec_sum32(vec v) {
+        v = _mm_add_epi32(v, _mm_shuffle_epi32(v, 0b01001110));
+        v = _mm_add_epi32(v, _mm_shuffle_epi32(v, 0b10110001));
+        return _mm_cvtsi128_si32(v);
+    }
+#endif
+
+#if defined(NNUE_AVX2) || defined(NNUE_SSE2)
+    void apply(int16_t *dst, const int16_t *src, const int *added, int add_count, const int *removed, int remove_count) {
+        for (int i = 0; i < NNUE::HIDDEN; i += LANES) {
+            vec v = vec_load(src + i);
+            for (int j = 0; j < add_count; j++) {
+                v = vec_add16(v, vec_load(network->feature_weights[added[j]] + i));
+            }
+            for (int j = 0; j < remove_count; j++) {
+                v = vec_sub16(v, vec_load(network->feature_weights[removed[j]] + i));
+            }
+            vec_store(dst + i, v);
+        }
+    }
+
+    //Clipped ReLU on both accumulators and the dot product with the output weights
+    int32_t output(const int16_t *us, const int16_t *them) {
+        vec sum = vec_zero();
+        for (int i = 0; i < NNUE::HIDDEN; i += LANES) {
+            sum = vec_add32(sum, vec_madd16(vec_clamp16(vec_load(us + i)), vec_load(network->output_weights + i)));
+            sum = vec_add32(sum, vec_madd16(vec_clamp16(vec_load(them + i)), vec_load(network->output_weights + NNUE::HIDDEN + i)));
+        }
+        return vec_sum32(sum) + network->output_bias;
+    }
+#else
+    void apply(int16_t *dst, const int16_t *src, const int *added, int add_count, const int *removed, int remove_count) {
+        for (int i = 0; i < NNUE::HIDDEN; i++) {
+            int16_t v = src[i];
+            for (int j = 0; j < add_count; j++) {
+                v += network->feature_weights[added[j]][i];
+            }
+            for (int j = 0; j < remove_count; j++) {
+                v -= network->feature_weights[removed[j]][i];
+            }
+            dst[i] = v;
+        }
+    }
+
+    int32_t output(const int16_t *us, const int16_t *them) {
+        int32_t sum = network->output_bias;
+        for (int i = 0; i < NNUE::HIDDEN; i++) {
+            sum += std::clamp<int32_t>(us[i], 0, NNUE::QA) * network->output_weights[i];
+            sum += std::clamp<int32_t>(them[i], 0, NNUE::QA) * network->output_weights[NNUE::HIDDEN + i];
+        }
+        return sum;
+    }
+#endif
+
+    //Brings the accumulator for one side up to date after its king moved, starting from the cached one for the new king square
+    void refresh_cached(NNUE::Accumulators &accumulators, const Chess &game, Color perspective, int16_t *dst) {
+        const Square king = king_square(game, perspective);
+        NNUE::Accumulators::CacheEntry &entry = accumulators.cache[perspective][king];
+        int added[MAX_CHANGES], removed[MAX_CHANGES];
+        int add_count = 0, remove_count = 0;
+
+        for (Piece piece : {WhitePawn, WhiteKnight, WhiteBishop, WhiteRook, WhiteQueen,
+                            BlackPawn, BlackKnight, BlackBishop, BlackRook, BlackQueen}) {
+            const Bitboard now = game.getBitboard(piece);
+            Bitboard bb = now & ~entry.pieces[piece];
+            while (bb) {
+                added[add_count++] = feature(perspective, king, piece, bitScanForward(bb));
+                bb &= bb - 1;
+            }
+            bb = entry.pieces[piece] & ~now;
+            while (bb) {
+                removed[remove_count++] = feature(perspective, king, piece, bitScanForward(bb));
+                bb &= bb - 1;
+            }
+            entry.pieces[piece] = now;
+        }
+
+        apply(entry.values, entry.values, added, add_count, removed, remove_count);
+        std::memcpy(dst, entry.values, sizeof(entry.values));
+    }
+}
+
+namespace NNUE {
+    Accumulators::Accumulators() {
+        for (auto &side : cache) {
+            for (CacheEntry &entry : side) {
+                std::memcpy(entry.values, network->feature_biases, sizeof(entry.values));
+                std::fill(std::begin(entry.pieces), std::end(entry.pieces), Bitboard(0));
+            }
+        }
+    }
+
+    void refresh(Accumulators &accumulators, const Chess &game) {
+        Accumulator &accumulator = accumulators.stack[game.getDepth()];
+        for (Color perspective : {WHITE, BLACK}) {
+            const Square king = king_square(game, perspective);
+            int added[MAX_CHANGES];
+            int add_count = 0;
+            for (Square sq = 0; sq < 64; sq++) {
+                const Piece piece = game.getSquare(sq);
+                if (piece != NoPiece && getPieceType(piece) != King) {
+                    added[add_count++] = feature(perspective, king, piece, sq);
+                }
+            }
+            apply(accumulator.values[perspective], network->feature_biases, added, add_count, nullptr, 0);
+        }
+    }
+
+    void update(Accumulators &accumulators, const Chess &game, Move move, Color color, Piece capture) {
+        const Accumulator &src = accumulators.stack[game.getDepth() - 1];
+        Accumulator &dst = accumulators.stack[game.getDepth()];
+
+        //Pieces that left or arrived on a square. Kings aren't features so they never show up here
+        Piece added_pieces[2], removed_pieces[3];
+        Square added_squares[2], removed_squares[3];
+        int add_count = 0, remove_count = 0;
+        auto add = [&](Piece piece, Square sq) {
+            added_pieces[add_count] = piece;
+            added_squares[add_count++] = sq;
+        };
+        auto remove = [&](Piece piece, Square sq) {
+            removed_pieces[remove_count] = piece;
+            removed_squares[remove_count++] = sq;
+        };
+
+        const Piece moved = move.flag() >= PROMOTION_KNIGHT ? makePiece(Pawn, color) : game.getSquare(move.to());
+        bool king_moved = getPieceType(moved) == King;
+        const Square back_rank = color == WHITE ? 0 : 56;
+
+        switch (move.flag()) {
+            case EN_PASSANT:
+                remove(capture, color == WHITE ? move.to() - 8 : move.to() + 8);
+                add(moved, move.to());
+                remove(moved, move.from());
+                break;
+
+            case CASTLE_SHORT:
+                add(makePiece(Rook, color), back_rank + 5);
+                remove(makePiece(Rook, color), back_rank + 7);
+                king_moved = true;
+                break;
+
+            case CASTLE_LONG:
+                add(makePiece(Rook, color), back_rank + 3);
+                remove(makePiece(Rook, color), back_rank);
+                king_moved = true;
+                break;
+
+            default:
+                //Quiet moves, captures and promotions. The piece on the to square is the promoted piece for promotions
+                if (capture != NoPiece) {
+                    remove(capture, move.to());
+                }
+                if (!king_moved) {
+                    add(game.getSquare(move.to()), move.to());
+                    remove(moved, move.from());
+                }
+                break;
+        }
+
+        for (Color perspective : {WHITE, BLACK}) {
+            if (king_moved && perspective == color) {
+                refresh_cached(accumulators, game, perspective, dst.values[perspective]);
+                continue;
+            }
+
+            const Square king = king_square(game, perspective);
+            int added[2], removed[3];
+            for (int i = 0; i < add_count; i++) {
+                added[i] = feature(perspective, king, added_pieces[i], added_squares[i]);
+            }
+            for (int i = 0; i < remove_count; i++) {
+                removed[i] = feature(perspective, king, removed_pieces[i], removed_squares[i]);
+            }
+            apply(dst.values[perspective], src.values[perspective], added, add_count, removed, remove_count);
+        }
+    }
+
+    bool load(const std::string &path) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) {
+            cout << "Unable to open \"" << path << "\".\n";
+            return false;
+        }
+
+        uint32_t header[3];
+        file.read(reinterpret_cast<char*>(header), sizeof(header));
+        if (!file || header[0] != MAGIC || header[1] != HIDDEN || header[2] != FEATURES) {
+            cout << "\"" << path << "\" isn't a network with " << HIDDEN << " hidden neurons.\n";
+            return false;
+        }
+
+        std::unique_ptr<Network> loaded = std::make_unique<Network>();
+        int8_t output_weights[2 * HIDDEN];
+        file.read(reinterpret_cast<char*>(loaded->feature_biases), sizeof(loaded->feature_biases));
+        file.read(reinterpret_cast<char*>(loaded->feature_weights), sizeof(loaded->feature_weights));
+        file.read(reinterpret_cast<char*>(output_weights), sizeof(output_weights));
+        file.read(reinterpret_cast<char*>(&loaded->output_bias), sizeof(loaded->output_bias));
+        if (!file) {
+            cout << "\"" << path << "\" is too short.\n";
+            return false;
+        }
+
+        std::copy(std::begin(output_weights), std::end(output_weights), loaded->output_weights);
+        network = std::move(loaded);
+        return true;
+    }
+
+    void randomize(uint64_t seed) {
+        Xorshift rng(seed);
+        auto random = [&rng](int range) {
+            return int16_t(int(rng.below(2 * range + 1)) - range);
+        };
+
+        network = std::make_unique<Network>();
+        for (auto &column : network->feature_weights) {
+            for (int16_t &weight : column) {
+                weight = random(32);
+            }
+        }
+        for (int16_t &bias : network->feature_biases) {
+            bias = random(64);
+        }
+        for (int16_t &weight : network->output_weights) {
+            weight = random(QB);
+        }
+        network->output_bias = random(QA * QB);
+    }
+
+    bool isLoaded() {
+        return network != nullptr;
+    }
+
+    const char *kernel() {
+#if defined(NNUE_AVX2)
+        return "AVX2";
+#elif defined(NNUE_SSE2)
+        return "SSE2";
+#else
+        return "scalar";
+#endif
+    }
+
+    int evaluate(const Chess &game, Color color) {
+        const Accumulator &accumulator = game.getAccumulators()->stack[game.getDepth()];
+        const int score = int64_t(output(accumulator.values[color], accumulator.values[~color])) * OUTPUT_SCALE / (QA * QB);
+        return std::clamp(score, -MAX_EVAL, MAX_EVAL);
+    }
+
+    int command(std::istringstream &stream) {
+        std::string arg, path;
+        uint64_t total_moves = 1000000;
+        uint64_t seed = 1;
+
+        while (stream >> std::skipws >> arg) {
+            std::string value;
+            stream >> std::skipws >> value;
+            try {
+                if (arg == "file") {
+                    path = value;
+                } else if (arg == "moves") {
+                    total_moves = std::stoull(value);
+                } else if (arg == "seed") {
+                    seed = std::stoull(value);
+                } else {
+                    cout << "Unknown option \"" << arg << "\".\n";
+                    return 1;
+                }
+            } catch (std::invalid_argument) {
+                cout << "Invalid value for " << arg << ". \"" << value << "\" was recived.\n";
+                return 1;
+            }
+        }
+
+        if (path.empty()) {
+            randomize(seed);
+        } else if (!load(path)) {
+            return 1;
+        }
+
+        //Random games, evaluating after every move once with the incremental update and once with a full refresh
+        std::unique_ptr<Accumulators> accumulators = std::make_unique<Accumulators>();
+        std::unique_ptr<Chess> game = std::make_unique<Chess>();
+        Xorshift rng(seed);
+        int64_t checksum = 0;
+        double incremental_time = 0;
+        double refresh_time = 0;
+        typedef std::chrono::steady_clock Clock;
+
+        Color color = WHITE;
+        game->setAccumulators(accumulators.get());
+        for (uint64_t i = 0; i < total_moves; i++) {
+            MoveArray moves = color == WHITE ? game->getMoves<WHITE>() : game->getMoves<BLACK>();
+            if (moves.size() == 0 || game->getDepth() >= MAX_PLAYOUT_PLIES) {
+                //Start a new game. The move that ended this one was already counted
+                *game = Chess();
+                game->setAccumulators(accumulators.get());
+                color = WHITE;
+                moves = game->getMoves<WHITE>();
+            }
+            const Move move = moves[rng.below(moves.size())];
+
+            Clock::time_point start = Clock::now();
+            color == WHITE ? game->makeMove<WHITE>(move) : game->makeMove<BLACK>(move);
+            color = ~color;
+            checksum += evaluate(*game, color);
+            incremental_time += std::chrono::duration<double>(Clock::now() - start).count();
+
+            start = Clock::now();
+            refresh(*accumulators, *game);
+            checksum -= evaluate(*game, color);
+            refresh_time += std::chrono::duration<double>(Clock::now() - start).count();
+        }
+
+        cout << (path.empty() ? "Random network" : path) << ", " << kernel() << " kernels, " << total_moves << " moves\n";
+        cout << "Incremental: " << uint64_t(total_moves / incremental_time) << " evals/s\n";
+        cout << "Refresh:     " << uint64_t(total_moves / refresh_time) << " evals/s\n";
+        if (checksum != 0) {
+            cout << "Incremental and refreshed evaluations differ\n";
+            return 1;
+        }
+        return 0;
+    }
+}
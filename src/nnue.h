@@ -0,0 +1,54 @@
+#pragma once
+#include "game.h"
+#include <sstream>
+#include <string>
+
+//Small efficiently updatable neural network evaluation
+//The inputs are HalfKP features: every piece other than the kings on its square, relative to one side's king
+//Each side has its own accumulator, the first layer's output, which makeMove keeps up to date with a few adds and subtracts
+//Both accumulators go through a clipped ReLU into a single output, side to move first
+namespace NNUE {
+    constexpr int FEATURES = 64 * 10 * 64; //King square * piece * square
+    constexpr int HIDDEN = 256;
+
+    //Quantization. Accumulators are clipped to [0, QA] and the output weights are scaled by QB
+    constexpr int QA = 127;
+    constexpr int QB = 64;
+    constexpr int OUTPUT_SCALE = 400; //Centipawns for an output of 1.0
+
+    struct alignas(64) Accumulator {
+        int16_t values[2][HIDDEN]; //Indexed by the side the features are seen from
+    };
+
+    //One accumulator for every ply of the game, indexed by Chess::getDepth()
+    //unmakeMove doesn't have to do anything as the accumulator for the earlier ply is still there
+    //Only create these once a network is loaded, as the refresh cache starts from its biases
+    class Accumulators {
+      public:
+        Accumulator stack[MAX_GAME_LENGTH];
+
+        //Refresh cache for king moves. Holds the accumulator and the pieces it was last computed for with the king on each square,
+        //so a refresh only needs the pieces that changed since then instead of every piece on the board
+        struct alignas(64) CacheEntry {
+            int16_t values[HIDDEN];
+            Bitboard pieces[15];
+        } cache[2][64];
+
+        Accumulators();
+    };
+
+    //Weight file layout, all little endian:
+    //"NNUE", uint32 HIDDEN, uint32 FEATURES, int16 feature biases[HIDDEN], int16 feature weights[FEATURES][HIDDEN],
+    //int8 output weights[2 * HIDDEN] (side to move first), int32 output bias
+    bool load(const std::string &path);
+    void randomize(uint64_t seed); //Random weights for benchmarking without a trained network
+    bool isLoaded();
+    const char *kernel(); //Which SIMD code got compiled in
+
+    //Needs accumulators attached to the game with Chess::setAccumulators
+    int evaluate(const Chess &game, Color color);
+
+    //Command line micro-benchmark. Reads options as name value pairs like UCI:
+    //file <weights> moves <n> seed <n>
+    int command(std::istringstream &stream);
+}
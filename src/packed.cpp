@@ -0,0 +1,145 @@
+#include "packed.h"
+
+#if defined(__AVX2__) && defined(__BMI2__)
+    #include <immintrin.h>
+    #define PACKED_AVX2
+#endif
+
+namespace {
+    constexpr Bitboard FOURTH_ROW = BOTTOM_ROW << 24;
+    constexpr Bitboard FIFTH_ROW = BOTTOM_ROW << 32;
+
+    //Squares holding each of the 16 piece codes
+    inline void split_codes(const PackedPosition &packed, Bitboard codes[16]) {
+#if defined(PACKED_AVX2)
+        //Spread the codes out to a byte each, then a compare per code gives which occupied squares have it
+        //and pdep puts those bits onto the squares themselves
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(packed.pieces));
+        const __m128i nibble = _mm_set1_epi8(0x0F);
+        const __m128i low = _mm_and_si128(bytes, nibble);
+        const __m128i high = _mm_and_si128(_mm_srli_epi16(bytes, 4), nibble);
+        const __m256i spread = _mm256_set_m128i(_mm_unpackhi_epi8(low, high), _mm_unpacklo_epi8(low, high));
+
+        //Codes past the last piece are 0 so they have to be masked off
+        const int count = pop_count(packed.occupancy);
+        const uint64_t used = count >= 32 ? 0xFFFFFFFF : (uint64_t(1) << count) - 1;
+        for (int code = 0; code < 16; code++) {
+            const uint64_t mask = uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(spread, _mm256_set1_epi8(char(code)))));
+            codes[code] = _pdep_u64(mask & used, packed.occupancy);
+        }
+#else
+        for (int code = 0; code < 16; code++) {
+            codes[code] = 0;
+        }
+        Bitboard bb = packed.occupancy;
+        for (int i = 0; bb && i < 32; i++) {
+            codes[(packed.pieces[i >> 1] >> ((i & 1) * 4)) & 0xF] |= bb & -bb;
+            bb &= bb - 1;
+        }
+#endif
+    }
+}
+
+namespace Packed {
+    void decode(const PackedPosition &packed, Board &board) {
+        Bitboard codes[16];
+        split_codes(packed, codes);
+
+        for (int piece = 0; piece < 15; piece++) {
+            board.bitboards[piece] = codes[piece];
+        }
+        //Codes that aren't pieces
+        board.bitboards[EN_PASSANT_PAWN] = board.bitboards[CASTLING_ROOK] = board.bitboards[8] = 0;
+
+        const Bitboard passed = codes[EN_PASSANT_PAWN];
+        board.bitboards[WhitePawn] |= passed & FOURTH_ROW;
+        board.bitboards[BlackPawn] |= passed & FIFTH_ROW;
+        board.en_passant_square = passed ? bitScanForward(passed) : 0;
+
+        const Bitboard rooks = codes[CASTLING_ROOK];
+        board.bitboards[WhiteRook] |= rooks & BOTTOM_ROW;
+        board.bitboards[BlackRook] |= rooks & ~BOTTOM_ROW;
+        board.castling = uint8_t(((rooks >> 7) & 1) | ((rooks & 1) << 1) | ((rooks >> 61) & 0b100) | (((rooks >> 56) & 1) << 3));
+
+        board.bitboards[BlackKing] |= codes[BLACK_TO_MOVE_KING];
+        board.color = codes[BLACK_TO_MOVE_KING] ? BLACK : WHITE;
+        board.halfmove = packed.halfmove;
+    }
+
+    void decodeBatch(const PackedPosition *packed, size_t count, Board *boards) {
+        for (size_t i = 0; i < count; i++) {
+            decode(packed[i], boards[i]);
+        }
+    }
+
+    const char *kernel() {
+#if defined(PACKED_AVX2)
+        return "AVX2+BMI2";
+#else
+        return "scalar";
+#endif
+    }
+}
+
+PackedPosition Chess::getPacked(Color color) const {
+    PackedPosition packed = {};
+    const History &current = history[depth];
+    const uint8_t rights = castling_rights(current.castling);
+
+    Bitboard bb = 0;
+    for (int piece = 0; piece < 15; piece++) {
+        bb |= bitboards[piece];
+    }
+    packed.occupancy = bb;
+
+    for (int i = 0; bb && i < 32; i++) {
+        const Square sq = bitScanForward(bb);
+        uint8_t code = mailbox[sq];
+        if (current.en_passant_square && sq == current.en_passant_square) {
+            code = Packed::EN_PASSANT_PAWN;
+        } else if ((code == WhiteRook && ((sq == 7 && (rights & 1)) || (sq == 0 && (rights & 2)))) ||
+                   (code == BlackRook && ((sq == 63 && (rights & 4)) || (sq == 56 && (rights & 8))))) {
+            code = Packed::CASTLING_ROOK;
+        } else if (code == BlackKing && color == BLACK) {
+            code = Packed::BLACK_TO_MOVE_KING;
+        }
+        packed.pieces[i >> 1] |= code << ((i & 1) * 4);
+        bb &= bb - 1;
+    }
+
+    packed.halfmove = current.halfmove;
+    return packed;
+}
+
+Color Chess::setPacked(const PackedPosition &packed) {
+    Packed::Board board;
+    Packed::decode(packed, board);
+
+    for (Square sq = 0; sq < 64; sq++) {
+        mailbox[sq] = NoPiece;
+    }
+    for (int piece = 0; piece < 15; piece++) {
+        bitboards[piece] = board.bitboards[piece];
+        for (Bitboard bb = bitboards[piece]; bb; bb &= bb - 1) {
+            mailbox[bitScanForward(bb)] = Piece(piece);
+        }
+    }
+
+    //Castling is tracked by whether the king and rook squares have been moved from or captured on, see History
+    history[depth] = History();
+    History &current = history[depth];
+    current.castling = ~Bitboard(0);
+    if (board.castling & 1) current.castling &= ~Bitboard(0x90);
+    if (board.castling & 2) current.castling &= ~Bitboard(0x11);
+    if (board.castling & 4) current.castling &= ~(Bitboard(0x90) << 56);
+    if (board.castling & 8) current.castling &= ~(Bitboard(0x11) << 56);
+    current.en_passant_square = board.en_passant_square;
+    current.halfmove = board.halfmove;
+
+    computeKey(board.color);
+    computeScores();
+    if (accumulators) {
+        NNUE::refresh(*accumulators, *this);
+    }
+    return board.color;
+}
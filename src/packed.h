@@ -0,0 +1,40 @@
+#pragma once
+#include "game.h"
+#include <cstddef>
+
+//Positions packed into 32 bytes for storing lots of them
+//The occupied squares are a bitboard, followed by a 4 bit code for the piece on each occupied square from a1 up
+//The codes are the Piece values, with the ones that aren't pieces standing in for the rest of the state:
+//  0  a pawn that can be taken en passant, white on the fourth rank and black on the fifth
+//  7  a rook that can still castle, white on the first rank and black on the eighth
+//  15 the black king when black is to move
+//Chess::getPacked and Chess::setPacked convert a game, the Packed namespace decodes them without one
+struct PackedPosition {
+    Bitboard occupancy;
+    uint8_t pieces[16]; //Two codes a byte, the first one in the low 4 bits
+    uint16_t halfmove;
+    uint8_t reserved[6]; //Zero. Free for formats that store something with each position
+};
+static_assert(sizeof(PackedPosition) == 32, "PackedPosition should be 32 bytes");
+
+namespace Packed {
+    constexpr uint8_t EN_PASSANT_PAWN = 0;
+    constexpr uint8_t CASTLING_ROOK = 7;
+    constexpr uint8_t BLACK_TO_MOVE_KING = 15;
+
+    //Position decoded into bitboards only, for when a whole Chess is more than what's needed
+    struct Board {
+        Bitboard bitboards[15]; //Indexed by Piece like Chess
+        Color color; //Side to move
+        uint8_t castling; //Castling rights, bits are KQkq from the lowest up like castling_rights()
+        Square en_passant_square; //Pawn that can be taken en passant like History, or 0 for none
+        uint16_t halfmove;
+    };
+
+    void decode(const PackedPosition &packed, Board &board);
+
+    //Decodes count positions at once. With AVX2 and BMI2 enabled each piece code takes one compare and one pdep
+    void decodeBatch(const PackedPosition *packed, size_t count, Board *boards);
+
+    const char *kernel(); //Which decoder got compiled in
+}
@@ -0,0 +1,99 @@
+#include "pawns.h"
+#include <memory>
+
+namespace {
+    constexpr size_t TABLE_SIZE = 1 << 14; //Entries per thread, a power of 2
+
+    //Penalties and bonuses as {middlegame, endgame}
+    constexpr int DOUBLED[2] = {-10, -25};
+    constexpr int ISOLATED[2] = {-12, -15};
+    constexpr int BACKWARD[2] = {-8, -12};
+    constexpr int PASSED_MG[8] = {0, 5, 8, 15, 25, 45, 70, 0}; //Indexed by rank from the pawn's side
+    constexpr int PASSED_EG[8] = {0, 10, 15, 25, 45, 75, 120, 0};
+    constexpr int SHIELD_CLOSE = 15; //Shield pawn one rank in front of the king's back rank
+    constexpr int SHIELD_FAR = 8; //Two ranks in front
+
+    struct Table {
+        Pawns::Entry entries[TABLE_SIZE] = {}; //A key of 0 with all zero scores is correct for positions without pawns
+    };
+
+    thread_local std::unique_ptr<Table> table; //Allocated the first time a thread evaluates
+
+    template<Color color>
+    inline Bitboard front_span(Bitboard pawns) {
+        return color == WHITE ? north_front_span(pawns) : south_front_span(pawns);
+    }
+
+    template<Color color>
+    inline Bitboard attack_span(Bitboard pawns) {
+        return color == WHITE ? north_attack_span(pawns) : south_attack_span(pawns);
+    }
+
+    //Scores one side's pawns with the terms that only depend on pawns, positive being good for that side
+    template<Color color>
+    void evaluate(const Chess &game, Pawns::Entry &entry, int &mg, int &eg) {
+        const Bitboard ours = game.getBitboard(makePiece(Pawn, color));
+        const Bitboard theirs = game.getBitboard(makePiece(Pawn, ~color));
+        const Bitboard their_attacks = pawn_attacks<~color>(theirs);
+
+        //Pawns with another of ours behind them on the same file
+        const int doubled = pop_count(ours & front_span<~color>(ours));
+
+        //No pawns of ours on either neighbouring file
+        const Bitboard files = file_fill(ours);
+        const Bitboard isolated = ours & ~(east_one(files) | west_one(files));
+
+        //Can't safely push as an enemy pawn controls the stop square and none of ours can ever come up to defend it
+        const Bitboard stops = color == WHITE ? ours << 8 : ours >> 8;
+        const Bitboard backward_stops = stops & their_attacks & ~attack_span<color>(ours);
+        const Bitboard backward = (color == WHITE ? backward_stops >> 8 : backward_stops << 8) & ~isolated;
+
+        //No enemy pawns in front or on the neighbouring files in front, and not behind one of our own
+        const Bitboard passed = ours & ~(front_span<~color>(theirs) | attack_span<~color>(theirs) | front_span<~color>(ours));
+        entry.passed |= passed;
+
+        mg += doubled * DOUBLED[0] + pop_count(isolated) * ISOLATED[0] + pop_count(backward) * BACKWARD[0];
+        eg += doubled * DOUBLED[1] + pop_count(isolated) * ISOLATED[1] + pop_count(backward) * BACKWARD[1];
+
+        Bitboard bb = passed;
+        while (bb) {
+            const int rank = color == WHITE ? bitScanForward(bb) / 8 : 7 - bitScanForward(bb) / 8;
+            mg += PASSED_MG[rank];
+            eg += PASSED_EG[rank];
+            bb &= bb - 1;
+        }
+
+        //Shield for a king on each file, counting our pawns on that file and the ones next to it
+        const Bitboard close_rank = color == WHITE ? Bitboard(0xFF00) : Bitboard(0xFF) << 48;
+        const Bitboard far_rank = color == WHITE ? Bitboard(0xFF0000) : Bitboard(0xFF) << 40;
+        for (int file = 0; file < 8; file++) {
+            const Bitboard file_mask = Bitboard(0x101010101010101) << file;
+            const Bitboard zone = file_mask | east_one(file_mask) | west_one(file_mask);
+            entry.shield[color][file] = int8_t(pop_count(ours & zone & close_rank) * SHIELD_CLOSE +
+                                               pop_count(ours & zone & far_rank) * SHIELD_FAR);
+        }
+    }
+}
+
+namespace Pawns {
+    const Entry &probe(const Chess &game) {
+        if (!table) {
+            table = std::make_unique<Table>();
+        }
+
+        const Bitboard key = game.getPawnKey();
+        Entry &entry = table->entries[key & (TABLE_SIZE - 1)];
+        if (entry.key == key) {
+            return entry;
+        }
+
+        int white_mg = 0, white_eg = 0, black_mg = 0, black_eg = 0;
+        entry.key = key;
+        entry.passed = 0;
+        evaluate<WHITE>(game, entry, white_mg, white_eg);
+        evaluate<BLACK>(game, entry, black_mg, black_eg);
+        entry.mg = int16_t(white_mg - black_mg);
+        entry.eg = int16_t(white_eg - black_eg);
+        return entry;
+    }
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include "game.h"
+
+//Pawn structure evaluation, cached by the pawn key since it rarely changes between nearby positions
+namespace Pawns {
+    struct Entry {
+        Bitboard key;
+        int16_t mg; //Passed, isolated, doubled and backward pawns from white's point of view
+        int16_t eg;
+        int8_t shield[2][8]; //Middlegame bonus for each side's pawns in front of its king, indexed by color then the king's file
+        Bitboard passed; //Both sides' passed pawns
+    };
+
+    //Looks up the pawn structure of the game, evaluating and storing it on a miss
+    //Each thread has its own table so nothing needs to be locked
+    const Entry &probe(const Chess &game);
+}
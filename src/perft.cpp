@@ -1,6 +1,9 @@
 #include "perft.h"
 #include <chrono>
 #include <algorithm> 
+#include <memory>
+
+static const std::atomic<bool> *stop_flag;
 
 template<Color color>
 uint64_t search(int depth, Chess *game) {
@@ -8,6 +11,11 @@ uint64_t search(int depth, Chess *game) {
         return 1;
     }
 
+    //Checking at the leaves would slow them down, so only check further up where it's cheap
+    if (depth >= 2 && stop_flag->load(std::memory_order_relaxed)) {
+        return 0;
+    }
+
     MoveArray moves = game->getMoves<color>();
 
     uint64_t positions = 0;
@@ -22,7 +30,7 @@ uint64_t search(int depth, Chess *game) {
 }
 
 template<Color color>
-uint64_t search(int depth, Chess game, bool extra_info = true) {
+uint64_t search(int depth, Chess &game, bool extra_info = true) {
     if (depth == 0) {
         return 1;
     }
@@ -38,6 +46,9 @@ uint64_t search(int depth, Chess game, bool extra_info = true) {
         positions += move_positions;
         moves_in_pos.push_back(move.UCI() + ": " + std::to_string(move_positions));
     }
+    if (stop_flag->load(std::memory_order_relaxed)) {
+        return positions; //The counts are only partial so don't print them
+    }
     std::sort(moves_in_pos.begin(), moves_in_pos.end());
     for (std::string pos : moves_in_pos) {
         std::cout << pos << std::endl;
@@ -46,8 +57,9 @@ uint64_t search(int depth, Chess game, bool extra_info = true) {
     return positions;
 }
 
-void perft(Chess game, Color color, unsigned int depth) {
+void perft(Chess game, Color color, unsigned int depth, const std::atomic<bool> &stop) {
     bool single_count = false;
+    stop_flag = &stop;
 
     if (!single_count) {
         game.print();
@@ -55,6 +67,10 @@ void perft(Chess game, Color color, unsigned int depth) {
             auto start = std::chrono::high_resolution_clock::now();
             auto positions = color == WHITE ? search<WHITE>(i, game) : search<BLACK>(i, game);
             auto end = std::chrono::high_resolution_clock::now();
+            if (stop.load(std::memory_order_relaxed)) {
+                std::cout << "Stopped at depth " << i << std::endl;
+                return;
+            }
             std::chrono::duration<double, std::milli> sec = end - start;
             std::cout << '\n';
             std::cout << std::fixed << (positions / (sec.count() / 1000.0)) << " nps\n";
@@ -66,4 +82,65 @@ void perft(Chess game, Color color, unsigned int depth) {
         auto positions = color == WHITE ? search<WHITE>(depth, &game) : search<BLACK>(depth, &game);
         std::cout << positions << std::endl;
     }
-}
\ No newline at end of file
+}
+
+template<Color color>
+uint64_t check_legal(int depth, Chess &game, uint64_t &mismatches) {
+    MoveArray moves = game.getMoves<color>();
+    if (game.hasLegalMove<color>() != (moves.size() != 0)) {
+        mismatches++;
+        std::cout << "Mismatch: " << game.getFen() << (color == WHITE ? " w" : " b") << '\n';
+    }
+    if (depth == 0) {
+        return 1;
+    }
+
+    uint64_t positions = 1;
+    for (Move move : moves) {
+        game.makeMove<color>(move);
+        positions += check_legal<~color>(depth-1, game, mismatches);
+        game.unmakeMove<color>(move);
+    }
+    return positions;
+}
+
+int legalCheckCommand(std::istringstream &stream) {
+    std::string fen, arg;
+    int depth = 3;
+    std::vector<std::string> args;
+    while (stream >> std::skipws >> arg) {
+        args.push_back(arg);
+    }
+
+    for (size_t i = 0; i < args.size(); i++) {
+        arg = args[i];
+        if (arg == "fen") {
+            //The fen goes until the next option
+            while (i + 1 < args.size() && args[i + 1] != "depth") {
+                fen += args[++i] + ' ';
+            }
+            continue;
+        }
+
+        const std::string value = i + 1 < args.size() ? args[++i] : "";
+        try {
+            if (arg == "depth") {
+                depth = std::stoi(value);
+            } else {
+                std::cout << "Unknown option \"" << arg << "\".\n";
+                return 1;
+            }
+        } catch (std::invalid_argument) {
+            std::cout << "Invalid value for " << arg << ". \"" << value << "\" was recived.\n";
+            return 1;
+        }
+    }
+
+    std::unique_ptr<Chess> game = std::make_unique<Chess>(); //Too big for the stack
+    const Color color = game->setFen(fen.empty() ? starting_pos : fen);
+    uint64_t mismatches = 0;
+    const uint64_t positions = color == WHITE ? check_legal<WHITE>(depth, *game, mismatches) : check_legal<BLACK>(depth, *game, mismatches);
+    std::cout << "Positions: " << positions << '\n';
+    std::cout << "Mismatches: " << mismatches << std::endl;
+    return mismatches != 0;
+}
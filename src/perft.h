@@ -1,4 +1,12 @@
 #pragma once
 #include "game.h"
+#include <atomic>
+#include <sstream>
 
-void perft(Chess game, Color color, unsigned int depth);
\ No newline at end of file
+//Setting stop from another thread ends the perft early
+void perft(Chess game, Color color, unsigned int depth, const std::atomic<bool> &stop);
+
+//Command line entry point for testing the move generator. Walks every position up to depth plies from the fen
+//and checks hasLegalMove agrees with getMoves, printing the positions where it doesn't. Reads options like UCI:
+//fen <fen> depth <n>
+int legalCheckCommand(std::istringstream &stream);
\ No newline at end of file
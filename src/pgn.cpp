@@ -0,0 +1,413 @@
+#include "pgn.h"
+#include "mapped_file.h"
+#include "evaluate.h"
+#include "training.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define PGN_SSE2
+#endif
+
+using std::cout;
+
+namespace {
+    constexpr std::string_view GAME_START = "[Event ";
+
+    inline bool is_space(char c) {
+        return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+    }
+
+    inline bool is_game_start(const char *data, size_t size, size_t pos) {
+        return (pos == 0 || data[pos - 1] == '\n') && size - pos >= GAME_START.size() &&
+            std::memcmp(data + pos, GAME_START.data(), GAME_START.size()) == 0;
+    }
+
+    inline std::string_view trim(std::string_view text) {
+        while (!text.empty() && is_space(text.front())) {
+            text.remove_prefix(1);
+        }
+        while (!text.empty() && is_space(text.back())) {
+            text.remove_suffix(1);
+        }
+        return text;
+    }
+
+    inline PGN::Result parse_result(std::string_view text) {
+        if (text == "1-0") return PGN::WHITE_WIN;
+        if (text == "0-1") return PGN::BLACK_WIN;
+        if (text == "1/2-1/2") return PGN::DRAW;
+        return PGN::UNKNOWN_RESULT;
+    }
+
+    inline bool is_result_token(std::string_view token) {
+        return token == "*" || parse_result(token) != PGN::UNKNOWN_RESULT;
+    }
+
+    //Plays out one game, calling the callback before every move and once more at the end
+    //Everything gets taken back afterwards so the board can be reused for the next game without setting it up from scratch
+    void play_game(Chess &game, std::string &loaded, Color &start_color, const PGN::Game &info, size_t thread, int max_plies,
+                   const PGN::Callback &callback, PGN::Stats &stats, std::string &error) {
+        if (info.fen != loaded) {
+            loaded = info.fen;
+            start_color = game.setFen(loaded.empty() ? starting_pos : loaded);
+        }
+
+        Move played[MAX_GAME_LENGTH];
+        Color color = start_color;
+        int ply = 0;
+        PGN::Tokenizer tokens(info.movetext);
+        std::string_view san;
+
+        while ((!max_plies || ply < max_plies) && tokens.next(san)) {
+            if (game.getDepth() >= MAX_GAME_LENGTH - 1) {
+                error = "too many moves";
+                break;
+            }
+
+            const Move move = color == WHITE ? game.fromSAN<WHITE>(san) : game.fromSAN<BLACK>(san);
+            if (move == Move()) {
+                error = "can't play \"" + std::string(san) + "\" after " + std::to_string(ply) + " plies";
+                break;
+            }
+
+            callback(PGN::Position{game, color, move, ply, info, thread});
+            stats.positions++;
+            if (color == WHITE) {
+                game.makeMove<WHITE>(move);
+            } else {
+                game.makeMove<BLACK>(move);
+            }
+            played[ply++] = move;
+            color = ~color;
+        }
+
+        if (error.empty()) {
+            callback(PGN::Position{game, color, Move(), ply, info, thread});
+            stats.positions++;
+        } else {
+            stats.errors++;
+        }
+        stats.games++;
+
+        for (int i = ply - 1; i >= 0; i--) {
+            color = ~color;
+            if (color == WHITE) {
+                game.unmakeMove<WHITE>(played[i]);
+            } else {
+                game.unmakeMove<BLACK>(played[i]);
+            }
+        }
+    }
+
+    //Per-thread state for the command, padded so threads don't share cache lines
+    struct alignas(64) ThreadState {
+        uint64_t checksum = 0;
+        Move last; //Move played from the last position, for chaining the training data
+        std::unique_ptr<Training::Writer> writer;
+    };
+}
+
+namespace PGN {
+    std::string_view Game::tag(std::string_view name) const {
+        size_t pos = 0;
+        while (pos < tags.size()) {
+            size_t end = tags.find('\n', pos);
+            if (end == std::string_view::npos) {
+                end = tags.size();
+            }
+            const std::string_view line = trim(tags.substr(pos, end - pos));
+            pos = end + 1;
+
+            //[Name "Value"]
+            if (line.size() < name.size() + 4 || line[0] != '[' || line.compare(1, name.size(), name) != 0 ||
+                line[name.size() + 1] != ' ') {
+                continue;
+            }
+            const size_t first = line.find('"', name.size() + 1);
+            const size_t last = line.rfind('"');
+            if (first == std::string_view::npos || last <= first) {
+                return std::string_view();
+            }
+            return line.substr(first + 1, last - first - 1);
+        }
+        return std::string_view();
+    }
+
+    Game parseGame(std::string_view text, size_t offset) {
+        Game game;
+        game.offset = offset;
+
+        //Tags are the lines at the start that begin with [
+        size_t pos = 0;
+        size_t tags_start = std::string_view::npos;
+        while (true) {
+            while (pos < text.size() && is_space(text[pos])) {
+                pos++;
+            }
+            if (pos >= text.size() || text[pos] != '[') {
+                break;
+            }
+            if (tags_start == std::string_view::npos) {
+                tags_start = pos;
+            }
+            pos = text.find('\n', pos);
+            if (pos == std::string_view::npos) {
+                pos = text.size();
+            }
+        }
+
+        if (tags_start != std::string_view::npos) {
+            game.tags = text.substr(tags_start, pos - tags_start);
+        }
+        game.movetext = text.substr(pos);
+        game.fen = game.tag("FEN");
+        game.result = parse_result(game.tag("Result"));
+
+        //Fall back to the result at the end of the movetext
+        if (game.result == UNKNOWN_RESULT) {
+            const std::string_view moves = trim(game.movetext);
+            const size_t space = moves.find_last_of(" \t\r\n");
+            game.result = parse_result(space == std::string_view::npos ? moves : moves.substr(space + 1));
+        }
+        return game;
+    }
+
+    bool Tokenizer::next(std::string_view &san) {
+        while (pos < text.size()) {
+            const char c = text[pos];
+            if (is_space(c)) {
+                pos++;
+                continue;
+            }
+
+            //Comments
+            if (c == '{' || c == ';' || (c == '%' && (pos == 0 || text[pos - 1] == '\n'))) {
+                pos = text.find(c == '{' ? '}' : '\n', pos);
+                pos = pos == std::string_view::npos ? text.size() : pos + 1;
+                continue;
+            }
+
+            //Variations can be nested, only the main line is played
+            if (c == '(') {
+                variation++;
+                pos++;
+                continue;
+            }
+            if (c == ')') {
+                variation = std::max(variation - 1, 0);
+                pos++;
+                continue;
+            }
+
+            size_t end = pos;
+            while (end < text.size() && !is_space(text[end]) && text[end] != '{' && text[end] != '}' &&
+                   text[end] != '(' && text[end] != ')' && text[end] != ';') {
+                end++;
+            }
+            std::string_view token = text.substr(pos, end - pos);
+            pos = end;
+
+            if (variation || token[0] == '$') {
+                continue;
+            }
+            if (is_result_token(token)) {
+                pos = text.size();
+                return false;
+            }
+
+            //Move numbers like 12. or 12... which can be stuck to the move. 0-0 is castling with zeros instead
+            if (token.compare(0, 3, "0-0") != 0) {
+                while (!token.empty() && token.front() >= '0' && token.front() <= '9') {
+                    token.remove_prefix(1);
+                }
+            }
+            while (!token.empty() && token.front() == '.') {
+                token.remove_prefix(1);
+            }
+
+            if (!token.empty()) {
+                san = token;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    size_t findGame(const char *data, size_t size, size_t from) {
+        size_t pos = from;
+
+#if defined(PGN_SSE2)
+        //Look for [ 16 bytes at a time. Only the few at the start of a line can start a game
+        const __m128i bracket = _mm_set1_epi8('[');
+        for (; pos + 16 <= size; pos += 16) {
+            const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+            Bitboard mask = uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, bracket)));
+            while (mask) {
+                const size_t found = pos + bitScanForward(mask);
+                if (is_game_start(data, size, found)) {
+                    return found;
+                }
+                mask &= mask - 1;
+            }
+        }
+#endif
+
+        for (; pos < size; pos++) {
+            if (data[pos] == '[' && is_game_start(data, size, pos)) {
+                return pos;
+            }
+        }
+        return size;
+    }
+
+    void Stats::add(const Stats &other) {
+        games += other.games;
+        positions += other.positions;
+        errors += other.errors;
+    }
+
+    Stats replay(std::string_view data, const Options &options, const Callback &callback) {
+        const size_t threads = std::max<size_t>(options.threads, 1);
+        const size_t chunk_size = std::max<size_t>(options.chunk_size, 1);
+        std::atomic<size_t> next {0};
+        std::vector<Stats> results(threads);
+        std::mutex print_mutex;
+        size_t printed = 0;
+
+        auto work = [&](size_t id) {
+            Stats &stats = results[id];
+            std::unique_ptr<Chess> game = std::make_unique<Chess>(); //Too big for the stack
+            std::string loaded; //FEN the board was last set up from, empty for the starting position which the constructor sets up
+            Color start_color = WHITE;
+            std::string error;
+
+            //A thread plays every game that starts in its chunk, even if the game carries on into the next one
+            for (size_t begin = next.fetch_add(chunk_size); begin < data.size(); begin = next.fetch_add(chunk_size)) {
+                const size_t end = std::min(begin + chunk_size, data.size());
+
+                //Anything before the first [Event tag is treated as a game too, for files of bare movetext
+                size_t start = begin == 0 ? 0 : findGame(data.data(), data.size(), begin);
+                while (start < end) {
+                    const size_t stop = findGame(data.data(), data.size(), start + 1);
+                    const Game info = parseGame(data.substr(start, stop - start), start);
+                    start = stop;
+
+                    if (info.tags.empty() && trim(info.movetext).empty()) {
+                        continue;
+                    }
+
+                    error.clear();
+                    play_game(*game, loaded, start_color, info, id, options.max_plies, callback, stats, error);
+                    if (!error.empty()) {
+                        std::lock_guard<std::mutex> lock(print_mutex);
+                        if (printed++ < options.max_errors) {
+                            cout << "Game at byte " << info.offset << ": " << error << '\n';
+                        }
+                    }
+                }
+            }
+        };
+
+        std::vector<std::thread> helpers;
+        for (size_t i = 1; i < threads; i++) {
+            helpers.emplace_back(work, i);
+        }
+        work(0);
+        for (std::thread &helper : helpers) {
+            helper.join();
+        }
+
+        Stats stats;
+        for (const Stats &result : results) {
+            stats.add(result);
+        }
+        return stats;
+    }
+
+    int command(std::istringstream &stream) {
+        Options options;
+        std::string path, out_path;
+        std::string arg, value;
+        while (stream >> std::skipws >> arg) {
+            stream >> value;
+            try {
+                if (arg == "file") {
+                    path = value;
+                } else if (arg == "out") {
+                    out_path = value;
+                } else if (arg == "threads") {
+                    options.threads = std::stoull(value);
+                } else {
+                    cout << "Unknown option \"" << arg << "\".\n";
+                    return 1;
+                }
+            } catch (std::invalid_argument) {
+                cout << "Invalid value for " << arg << ". \"" << value << "\" was recived.\n";
+                return 1;
+            }
+        }
+
+        MappedFile file;
+        if (path.empty() || !file.open(path)) {
+            cout << "Unable to open \"" << path << "\".\n";
+            return 1;
+        }
+
+        std::vector<ThreadState> states(std::max<size_t>(options.threads, 1));
+
+        //Every position can also be written out as training data scored by the static evaluation
+        std::ofstream out;
+        std::mutex out_mutex;
+        if (!out_path.empty()) {
+            out.open(out_path, std::ios::binary);
+            if (!out) {
+                cout << "Unable to open \"" << out_path << "\".\n";
+                return 1;
+            }
+            for (ThreadState &state : states) {
+                state.writer = std::make_unique<Training::Writer>(out, &out_mutex);
+            }
+        }
+
+        //XOR of the keys of every position, which doesn't depend on the order the games are played in
+        auto callback = [&](const Position &position) {
+            ThreadState &state = states[position.thread];
+            state.checksum ^= position.game.getKey();
+            if (state.writer) {
+                const int result = position.info.result == WHITE_WIN ? 1 : position.info.result == BLACK_WIN ? -1 : 0;
+                state.writer->add(position.game, position.color, Eval::evaluate(position.game, position.color), result,
+                                  position.ply ? state.last : Move());
+                state.last = position.move;
+            }
+        };
+
+        const auto start = std::chrono::steady_clock::now();
+        const Stats stats = replay(file.view(), options, callback);
+        const int64_t time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+
+        uint64_t checksum = 0;
+        for (ThreadState &state : states) {
+            checksum ^= state.checksum;
+            state.writer.reset(); //Writes the last chunk
+        }
+
+        cout << "Games: " << stats.games << " in " << time << " ms (" << uint64_t(stats.games * 60000 / std::max<int64_t>(time, 1)) << " games/min)\n";
+        cout << "Positions: " << stats.positions << '\n';
+        cout << "Errors: " << stats.errors << '\n';
+        cout << "Checksum: " << std::hex << std::setw(16) << std::setfill('0') << checksum << std::dec << std::setfill(' ') << std::endl;
+        if (!out_path.empty()) {
+            cout << "Training data written to " << out_path << " (" << out.tellp() << " bytes)" << std::endl;
+        }
+        return 0;
+    }
+}
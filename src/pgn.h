@@ -0,0 +1,85 @@
+#pragma once
+#include "game.h"
+#include <functional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+//Reader for PGN game collections
+//The file is memory mapped and split into chunks by byte offset. Each thread takes the games that start in its chunk,
+//so nothing has to scan the whole file before the threads can start
+namespace PGN {
+    enum Result {
+        WHITE_WIN,
+        BLACK_WIN,
+        DRAW,
+        UNKNOWN_RESULT
+    };
+
+    struct Game {
+        std::string_view tags; //Every tag line, for looking up with tag()
+        std::string_view movetext;
+        std::string_view fen; //Empty when the game starts from the normal starting position
+        Result result = UNKNOWN_RESULT; //From the Result tag, or the end of the movetext if there isn't one
+        size_t offset = 0; //Byte offset of the game in the file
+
+        //Value of a tag like White or ECO, or an empty string if the game doesn't have it
+        std::string_view tag(std::string_view name) const;
+    };
+
+    //Splits a game's text into tags and movetext
+    Game parseGame(std::string_view text, size_t offset = 0);
+
+    //Gives the moves of the main line one at a time, skipping move numbers, comments, variations, NAGs and the result
+    class Tokenizer {
+      public:
+        explicit Tokenizer(std::string_view movetext) : text(movetext) {}
+
+        //Returns false once there are no more moves
+        bool next(std::string_view &san);
+
+      private:
+        std::string_view text;
+        size_t pos = 0;
+        int variation = 0; //How deep inside parentheses the tokenizer is
+    };
+
+    //Start of the first game at or after from, or size if there isn't one
+    //A game starts at an [Event tag at the beginning of a line
+    size_t findGame(const char *data, size_t size, size_t from);
+
+    //Handed to the callback for every position of every game, starting from the first position and ending with the last one
+    struct Position {
+        const Chess &game;
+        Color color; //Side to move
+        Move move; //Move played from here, Move() after the last move
+        int ply; //Moves played so far in this game
+        const Game &info;
+        size_t thread; //So callbacks can keep per-thread state without locking
+    };
+
+    //Called from every thread at once
+    using Callback = std::function<void(const Position&)>;
+
+    struct Options {
+        size_t threads = 1;
+        size_t chunk_size = 1 << 20; //Bytes of the file handed to a thread at a time
+        size_t max_errors = 5; //How many errors get printed, the rest are only counted
+        int max_plies = 0; //Games stop being played after this many plies, without reading the rest of the moves. 0 plays them all
+    };
+
+    struct Stats {
+        uint64_t games = 0;
+        uint64_t positions = 0;
+        uint64_t errors = 0; //Games with a move that couldn't be read or isn't legal. Their positions up to the error still count
+        void add(const Stats &other);
+    };
+
+    //Replays every game in data, calling callback for each position
+    Stats replay(std::string_view data, const Options &options, const Callback &callback);
+
+    //Command line entry point. Reads options as name value pairs like UCI:
+    //file <pgn> threads <n> out <training data>
+    int command(std::istringstream &stream);
+}
@@ -38,6 +38,10 @@ enum Piece : uint8_t {
     BlackKing = 14
 };
 
+//Piece values in centipawns used for exchanges, indexed by PieceType
+//The king is worth more than everything else combined so trading it off is never good
+constexpr int piece_values[8] = {0, 100, 320, 330, 500, 900, 20000, 0};
+
 constexpr Piece makePiece(PieceType piece, Color color) {
     return Piece((color << 3) | piece);
 }
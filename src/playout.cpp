@@ -0,0 +1,282 @@
+#include "playout.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <thread>
+#include <iostream>
+#include <iomanip>
+
+using std::cout;
+
+namespace {
+    constexpr const char *ending_names[Playout::ENDING_COUNT] = {"checkmate", "stalemate", "fifty move", "insufficient material", "ply cap"};
+    constexpr int HISTOGRAM_BUCKET = 20; //Plies per line of the printed length histogram
+
+    //Captures are weighted by what they take and queen promotions like taking a queen, everything else is 1
+    inline uint32_t move_weight(const Chess &game, Move move) {
+        switch (move.flag()) {
+            case CAPTURE:
+                return 1 + piece_values[getPieceType(game.getSquare(move.to()))] / 100;
+            case EN_PASSANT:
+                return 2;
+            case PROMOTION_QUEEN: case PROMOTION_CAPTURE_QUEEN:
+                return 10;
+            default:
+                return 1;
+        }
+    }
+
+    template<Color color>
+    inline Move pick_move(const Chess &game, MoveArray &moves, Xorshift &rng, bool weighted) {
+        if (!weighted) {
+            return moves[rng.below(moves.size())];
+        }
+
+        uint32_t cumulative[MOVE_VECTOR_SIZE];
+        uint32_t total = 0;
+        for (size_t i = 0; i < moves.size(); i++) {
+            total += move_weight(game, moves[i]);
+            cumulative[i] = total;
+        }
+        const uint32_t r = rng.below(total);
+        return moves[std::upper_bound(cumulative, cumulative + moves.size(), r) - cumulative];
+    }
+
+    //Plays one game to the end and then takes every move back so the position can be reused
+    //Sets decisive and the winner if somebody got mated
+    Playout::Ending play_game(Chess &game, Color color, Xorshift &rng, const Playout::Options &options, int &plies, bool &decisive, Color &winner) {
+        Move played[MAX_GAME_LENGTH];
+        const int max_plies = std::min<int>(options.max_plies, MAX_GAME_LENGTH - 1 - game.getDepth());
+        Playout::Ending ending = Playout::PLY_CAP;
+        plies = 0;
+        decisive = false;
+
+        while (true) {
+            MoveArray moves = color == WHITE ? game.getMoves<WHITE>() : game.getMoves<BLACK>();
+            if (moves.size() == 0) {
+                if (color == WHITE ? game.inCheck<WHITE>() : game.inCheck<BLACK>()) {
+                    ending = Playout::CHECKMATE;
+                    decisive = true;
+                    winner = ~color;
+                } else {
+                    ending = Playout::STALEMATE;
+                }
+                break;
+            }
+            if (game.isFiftyMove()) {
+                ending = Playout::FIFTY_MOVE;
+                break;
+            }
+            if (game.isInsufficientMaterial()) {
+                ending = Playout::INSUFFICIENT_MATERIAL;
+                break;
+            }
+            if (plies >= max_plies) {
+                break;
+            }
+
+            const Move move = color == WHITE ? pick_move<WHITE>(game, moves, rng, options.weighted) : pick_move<BLACK>(game, moves, rng, options.weighted);
+            if (color == WHITE) {
+                game.makeMove<WHITE>(move);
+            } else {
+                game.makeMove<BLACK>(move);
+            }
+            played[plies++] = move;
+            color = ~color;
+        }
+
+        for (int i = plies - 1; i >= 0; i--) {
+            color = ~color;
+            if (color == WHITE) {
+                game.unmakeMove<WHITE>(played[i]);
+            } else {
+                game.unmakeMove<BLACK>(played[i]);
+            }
+        }
+        return ending;
+    }
+
+    void print_stats(const Playout::Stats &stats, int64_t time) {
+        const double games = std::max<uint64_t>(stats.games, 1);
+        cout << std::fixed << std::setprecision(2);
+        cout << "Games: " << stats.games << " in " << time << " ms (" << uint64_t(stats.games * 1000 / std::max<int64_t>(time, 1)) << " games/s)\n";
+        cout << "White wins: " << stats.white_wins << " (" << 100 * stats.white_wins / games << "%)\n";
+        cout << "Black wins: " << stats.black_wins << " (" << 100 * stats.black_wins / games << "%)\n";
+        cout << "Draws: " << stats.draws << " (" << 100 * stats.draws / games << "%)\n";
+        cout << "Average length: " << stats.plies / games << " plies\n\n";
+
+        for (int i = 0; i < Playout::ENDING_COUNT; i++) {
+            cout << std::left << std::setw(23) << ending_names[i] << std::right << std::setw(12) << stats.endings[i]
+                 << std::setw(8) << 100 * stats.endings[i] / games << "%\n";
+        }
+
+        cout << "\nLength histogram\n";
+        for (size_t start = 0; start < stats.lengths.size(); start += HISTOGRAM_BUCKET) {
+            uint64_t count = 0;
+            for (size_t i = start; i < std::min(start + HISTOGRAM_BUCKET, stats.lengths.size()); i++) {
+                count += stats.lengths[i];
+            }
+            if (count) {
+                cout << std::setw(4) << start << '-' << std::left << std::setw(6) << start + HISTOGRAM_BUCKET - 1 << std::right
+                     << std::setw(12) << count << std::setw(8) << 100 * count / games << "%\n";
+            }
+        }
+        cout << std::endl;
+    }
+}
+
+namespace Playout {
+    void Stats::add(const Stats &other) {
+        games += other.games;
+        white_wins += other.white_wins;
+        black_wins += other.black_wins;
+        draws += other.draws;
+        plies += other.plies;
+        for (int i = 0; i < ENDING_COUNT; i++) {
+            endings[i] += other.endings[i];
+        }
+        lengths.resize(std::max(lengths.size(), other.lengths.size()));
+        for (size_t i = 0; i < other.lengths.size(); i++) {
+            lengths[i] += other.lengths[i];
+        }
+    }
+
+    Stats run(const std::vector<std::string> &fens, const Options &options) {
+        const uint64_t total = fens.size() * options.games;
+        const size_t threads = std::max<size_t>(options.threads, 1);
+        std::atomic<uint64_t> next {0};
+        std::vector<Stats> results(threads);
+
+        auto work = [&](size_t id) {
+            Stats &stats = results[id];
+            stats.lengths.assign(options.max_plies + 1, 0);
+            std::unique_ptr<Chess> game = std::make_unique<Chess>(); //Too big for the stack
+            size_t loaded = fens.size(); //Which position is set up, so it's only parsed again when it changes
+            Color start_color = WHITE;
+
+            //Games are handed out in chunks to keep the counter from bouncing between cores
+            constexpr uint64_t CHUNK = 64;
+            for (uint64_t first = next.fetch_add(CHUNK); first < total; first = next.fetch_add(CHUNK)) {
+                for (uint64_t index = first; index < std::min(first + CHUNK, total); index++) {
+                    const size_t position = index / options.games;
+                    if (position != loaded) {
+                        *game = Chess();
+                        start_color = game->setFen(fens[position]);
+                        loaded = position;
+                    }
+
+                    Xorshift rng = Xorshift::forStream(options.seed, index);
+                    int plies;
+                    bool decisive;
+                    Color winner = WHITE;
+                    const Ending ending = play_game(*game, start_color, rng, options, plies, decisive, winner);
+
+                    stats.games++;
+                    stats.plies += plies;
+                    stats.endings[ending]++;
+                    stats.lengths[plies]++;
+                    if (!decisive) {
+                        stats.draws++;
+                    } else if (winner == WHITE) {
+                        stats.white_wins++;
+                    } else {
+                        stats.black_wins++;
+                    }
+                }
+            }
+        };
+
+        std::vector<std::thread> helpers;
+        for (size_t i = 1; i < threads; i++) {
+            helpers.emplace_back(work, i);
+        }
+        work(0);
+        for (std::thread &helper : helpers) {
+            helper.join();
+        }
+
+        Stats stats;
+        for (const Stats &result : results) {
+            stats.add(result);
+        }
+        return stats;
+    }
+
+    int command(std::istringstream &stream) {
+        Options options;
+        std::vector<std::string> fens;
+        std::vector<std::string> args;
+        std::string arg;
+        while (stream >> std::skipws >> arg) {
+            args.push_back(arg);
+        }
+
+        auto is_option = [](const std::string &arg) {
+            return arg == "file" || arg == "fen" || arg == "games" || arg == "plies" || arg == "threads" || arg == "seed" || arg == "weighted";
+        };
+
+        for (size_t i = 0; i < args.size(); i++) {
+            arg = args[i];
+            if (arg == "weighted") {
+                options.weighted = true;
+                continue;
+            }
+
+            if (arg == "fen") {
+                //The fen goes until the next option
+                std::string fen;
+                while (i + 1 < args.size() && !is_option(args[i + 1])) {
+                    fen += args[++i] + ' ';
+                }
+                fens.push_back(fen);
+                continue;
+            }
+
+            const std::string value = i + 1 < args.size() ? args[++i] : "";
+            try {
+                if (arg == "file") {
+                    std::ifstream file(value);
+                    if (!file) {
+                        cout << "Unable to open \"" << value << "\".\n";
+                        return 1;
+                    }
+                    std::string line;
+                    while (std::getline(file, line)) {
+                        if (!line.empty() && line[0] != '#') {
+                            fens.push_back(line);
+                        }
+                    }
+                } else if (arg == "games") {
+                    options.games = std::stoull(value);
+                } else if (arg == "plies") {
+                    options.max_plies = std::max(std::stoi(value), 1);
+                } else if (arg == "threads") {
+                    options.threads = std::stoull(value);
+                } else if (arg == "seed") {
+                    options.seed = std::stoull(value);
+                } else {
+                    cout << "Unknown option \"" << arg << "\".\n";
+                    return 1;
+                }
+            } catch (std::invalid_argument) {
+                cout << "Invalid value for " << arg << ". \"" << value << "\" was recived.\n";
+                return 1;
+            }
+        }
+
+        if (fens.empty()) {
+            fens.push_back(starting_pos);
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        const Stats stats = run(fens, options);
+        const int64_t time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+
+        cout << fens.size() << (fens.size() == 1 ? " position, " : " positions, ") << options.games << " games each, seed " << options.seed
+             << ", " << (options.weighted ? "weighted" : "uniform") << " moves\n";
+        print_stats(stats, time);
+        return 0;
+    }
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include "game.h"
+#include <sstream>
+#include <string>
+#include <vector>
+
+//Small fast generator for random playouts. Each thread should have its own
+//xorshift64* from Marsaglia and Vigna, which only needs a non-zero seed
+struct Xorshift {
+    uint64_t state;
+
+    explicit inline Xorshift(uint64_t seed) : state(seed ? seed : 0x9E3779B97F4A7C15) {}
+
+    //Independent generator for each (seed, stream) pair, so work can be split up any way and still give the same numbers
+    //Mixes them with the splitmix64 finalizer so nearby seeds and streams don't give similar sequences
+    static inline Xorshift forStream(uint64_t seed, uint64_t stream) {
+        uint64_t z = seed + (stream + 1) * 0x9E3779B97F4A7C15;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+        return Xorshift(z ^ (z >> 31));
+    }
+
+    inline uint64_t next() {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return state * 0x2545F4914F6CDD1D;
+    }
+
+    //Uniform enough in [0, n) for picking moves
+    inline uint32_t below(uint32_t n) {
+        return uint32_t(((next() >> 32) * n) >> 32);
+    }
+};
+
+//Result of a game from the point of view of one side, counted in half points
+enum PlayoutResult : int {
+    PLAYOUT_LOSS = 0,
+    PLAYOUT_DRAW = 1,
+    PLAYOUT_WIN = 2
+};
+
+constexpr int MAX_PLAYOUT_PLIES = 400; //Playouts longer than this are called a draw
+
+/**
+ * Plays uniformly random legal moves until the game ends and undoes them all again
+ * Returns the result for the side to move. plies is how many more moves can be played before it's called a draw
+*/
+template<Color color>
+PlayoutResult randomPlayout(Chess &game, Xorshift &rng, int plies = MAX_PLAYOUT_PLIES) {
+    MoveArray moves = game.getMoves<color>();
+    if (moves.size() == 0) {
+        return game.inCheck<color>() ? PLAYOUT_LOSS : PLAYOUT_DRAW;
+    }
+
+    if (plies <= 0 || game.getDepth() >= MAX_GAME_LENGTH - 1 ||
+        game.isFiftyMove() || game.isInsufficientMaterial() || game.isRepetition(3)) {
+        return PLAYOUT_DRAW;
+    }
+
+    const Move move = moves[rng.below(moves.size())];
+    game.makeMove<color>(move);
+    const PlayoutResult result = PlayoutResult(PLAYOUT_WIN - randomPlayout<~color>(game, rng, plies - 1));
+    game.unmakeMove<color>(move);
+    return result;
+}
+
+namespace Playout {
+    //How a random game ended
+    enum Ending {
+        CHECKMATE,
+        STALEMATE,
+        FIFTY_MOVE,
+        INSUFFICIENT_MATERIAL,
+        PLY_CAP,
+        ENDING_COUNT
+    };
+
+    struct Options {
+        uint64_t games = 10000; //Per position
+        int max_plies = MAX_PLAYOUT_PLIES;
+        bool weighted = false; //Favour captures and queen promotions over quiet moves instead of picking uniformly
+        uint64_t seed = 1;
+        size_t threads = 1;
+    };
+
+    struct Stats {
+        uint64_t games = 0;
+        uint64_t white_wins = 0;
+        uint64_t black_wins = 0;
+        uint64_t draws = 0;
+        uint64_t plies = 0;
+        uint64_t endings[ENDING_COUNT] = {};
+        std::vector<uint64_t> lengths; //Number of games that lasted each number of plies
+
+        void add(const Stats &other);
+    };
+
+    //Plays options.games random games from each position, split over the threads
+    //Every game gets its own generator from the seed and its index so the results don't depend on the thread count
+    Stats run(const std::vector<std::string> &fens, const Options &options);
+
+    //Command line entry point. Reads options as name value pairs like UCI:
+    //file <fen list> fen <fen> games <n> plies <n> threads <n> seed <n> weighted
+    int command(std::istringstream &stream);
+}
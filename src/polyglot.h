@@ -0,0 +1,83 @@
+#pragma once
+#include "game.h"
+#include "mapped_file.h"
+#include <array>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+//Polyglot opening books. A book is a file of 16 byte big endian entries sorted by position key,
+//each holding one move for the position and a weight for how often it should be played
+//
+//Books are read straight out of a read only mapping of the file so nothing is copied or loaded up front,
+//and since the pages belong to the page cache every process using the same book shares them
+namespace Polyglot {
+    //The key of a position is the xor of these keys for everything in it, laid out as:
+    //  64 * kind + square for each piece, where kind goes black pawn, white pawn, black knight, ... white king
+    //  CASTLING_OFFSET + 0 to 3 for each castling right, white short, white long, black short, black long
+    //  EN_PASSANT_OFFSET + file if a pawn of the side to move stands next to a pawn that just moved two squares
+    //  TURN_OFFSET if white is to move
+    constexpr size_t KEY_COUNT = 781;
+    constexpr size_t CASTLING_OFFSET = 768;
+    constexpr size_t EN_PASSANT_OFFSET = 772;
+    constexpr size_t TURN_OFFSET = 780;
+
+    //The keys start out as the standard Polyglot Random64 table. loadKeys replaces them with 781 hex numbers from a file
+    //for books made with some other table
+    bool loadKeys(const std::string &path);
+    const std::array<uint64_t, KEY_COUNT> &keys();
+
+    struct Entry {
+        uint64_t key;
+        uint16_t move; //Polyglot encoding, see encodeMove
+        uint16_t weight;
+        uint32_t learn; //Unused
+    };
+    constexpr size_t ENTRY_SIZE = 16;
+
+    //Polyglot moves are the to square in the low 6 bits, the from square in the next 6 and the promotion piece
+    //(1 knight to 4 queen) above that. The squares are numbered like ours. Castling is the king taking its own rook
+    uint16_t encodeMove(Move move);
+    //Finds the legal move with that encoding, or Move() if there isn't one
+    Move decodeMove(const Chess &game, Color color, uint16_t move);
+
+    struct BookMove {
+        Move move;
+        uint16_t weight;
+    };
+
+    class Book {
+      public:
+        bool open(const std::string &path); //Returns false if the file can't be opened or isn't a whole number of entries
+        void close();
+
+        inline bool isOpen() const {
+            return file.isOpen();
+        }
+        inline size_t size() const {
+            return count;
+        }
+
+        Entry entry(size_t index) const; //Decoded from the file's big endian
+
+        //Range of entry indices with this key, empty if the position isn't in the book
+        std::pair<size_t, size_t> find(uint64_t key) const;
+
+        //Book moves for the position that are legal, in the order the book has them
+        std::vector<BookMove> moves(const Chess &game, Color color) const;
+        //Picks a book move with chance proportional to its weight, using random as the dice roll. Move() if there's none
+        Move pick(const Chess &game, Color color, uint64_t random) const;
+
+      private:
+        uint64_t key_at(size_t index) const;
+
+        MappedFile file;
+        const unsigned char *entries = nullptr;
+        size_t count = 0;
+    };
+
+    //Command line entry point. Reads options as name value pairs like UCI:
+    //file <book> fen <fen> keys <Random64 file>
+    int command(std::istringstream &stream);
+}
@@ -0,0 +1,322 @@
+#include "position_index.h"
+#include "external_sort.h"
+#include "pgn.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+
+using std::cout;
+
+namespace {
+    constexpr uint64_t MAX_GAME_OFFSET = uint64_t(1) << 48;
+    constexpr size_t WRITE_BUFFER = 1 << 16; //Entries written at a time
+    constexpr size_t DEFAULT_LIMIT = 20; //Hits printed by query
+
+    //Per-thread entries waiting to be sorted, padded so threads don't share cache lines
+    struct alignas(64) ThreadBuffer {
+        std::vector<PositionIndex::Entry> entries;
+    };
+
+    //Writes sorted entries after the header and remembers the fence keys on the way
+    class IndexWriter {
+      public:
+        explicit IndexWriter(std::ofstream &out) : out(out) {
+            buffer.reserve(WRITE_BUFFER);
+        }
+
+        inline void add(const PositionIndex::Entry &entry) {
+            if (count % PositionIndex::FENCE_INTERVAL == 0) {
+                fences.push_back(entry.key);
+            }
+            buffer.push_back(entry);
+            count++;
+            if (buffer.size() == WRITE_BUFFER) {
+                flush();
+            }
+        }
+
+        //Writes the fences and fills in the header
+        void finish(uint64_t source_size) {
+            flush();
+            out.write(reinterpret_cast<const char*>(fences.data()), std::streamsize(fences.size() * sizeof(uint64_t)));
+
+            PositionIndex::Header header;
+            std::memcpy(header.magic, PositionIndex::MAGIC, sizeof(header.magic));
+            header.fence_interval = PositionIndex::FENCE_INTERVAL;
+            header.entries = count;
+            header.fences = fences.size();
+            header.source_size = source_size;
+            out.seekp(0);
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        }
+
+      private:
+        void flush() {
+            out.write(reinterpret_cast<const char*>(buffer.data()), std::streamsize(buffer.size() * sizeof(PositionIndex::Entry)));
+            buffer.clear();
+        }
+
+        std::ofstream &out;
+        std::vector<PositionIndex::Entry> buffer;
+        std::vector<uint64_t> fences;
+        uint64_t count = 0;
+    };
+}
+
+namespace PositionIndex {
+    bool build(const std::string &pgn, const std::string &out, size_t threads, size_t memory, BuildStats &stats) {
+        threads = std::max<size_t>(threads, 1);
+        MappedFile file;
+        if (!file.open(pgn)) {
+            cout << "Unable to open \"" << pgn << "\".\n";
+            return false;
+        }
+        if (file.size() >= MAX_GAME_OFFSET) {
+            cout << "\"" << pgn << "\" is too big to index.\n";
+            return false;
+        }
+
+        //Each thread sorts and spills its entries when it has its share of the memory
+        const size_t share = std::max<size_t>(memory * 1024 * 1024 / sizeof(Entry) / threads, 1024);
+        std::vector<ThreadBuffer> buffers(threads);
+        for (ThreadBuffer &buffer : buffers) {
+            buffer.entries.reserve(share);
+        }
+        ExternalSort::Runs<Entry> runs(out, threads);
+
+        PGN::Options options;
+        options.threads = threads;
+        auto callback = [&](const PGN::Position &position) {
+            std::vector<Entry> &entries = buffers[position.thread].entries;
+            entries.push_back(Entry{position.game.getPolyglotKey(position.color), (position.info.offset << 16) | uint64_t(position.ply)});
+            if (entries.size() >= share) {
+                runs.spill(position.thread, entries);
+            }
+        };
+        const PGN::Stats pgn_stats = PGN::replay(file.view(), options, callback);
+        stats.games = pgn_stats.games;
+        stats.positions = pgn_stats.positions;
+        stats.errors = pgn_stats.errors;
+
+        std::ofstream index(out, std::ios::binary | std::ios::trunc);
+        if (!index) {
+            cout << "Unable to open \"" << out << "\".\n";
+            return false;
+        }
+        const Header placeholder = {};
+        index.write(reinterpret_cast<const char*>(&placeholder), sizeof(placeholder));
+        IndexWriter writer(index);
+
+        bool merged = true;
+        if (!runs.count()) {
+            //Everything fit in memory, so the threads' entries are sorted together in one go
+            std::vector<Entry> entries;
+            entries.reserve(stats.positions);
+            for (ThreadBuffer &buffer : buffers) {
+                entries.insert(entries.end(), buffer.entries.begin(), buffer.entries.end());
+                std::vector<Entry>().swap(buffer.entries);
+            }
+            ExternalSort::radixSort(entries, threads);
+            for (const Entry &entry : entries) {
+                writer.add(entry);
+            }
+        } else {
+            ExternalSort::runParallel(threads, [&](size_t thread) {
+                if (!buffers[thread].entries.empty()) {
+                    runs.spill(thread, buffers[thread].entries);
+                }
+                std::vector<Entry>().swap(buffers[thread].entries);
+            });
+            stats.runs = runs.count();
+            merged = runs.merge(memory * 1024 * 1024, [&](const Entry &entry) {
+                writer.add(entry);
+            });
+            runs.clear();
+        }
+
+        writer.finish(file.size());
+        if (!merged) {
+            cout << "Unable to read back the spilled runs.\n";
+        }
+        return merged && bool(index);
+    }
+
+    bool Index::open(const std::string &path) {
+        close();
+        if (!file.open(path, MappedFile::RANDOM) || file.size() < sizeof(Header)) {
+            file.close();
+            return false;
+        }
+
+        std::memcpy(&head, file.data(), sizeof(head));
+        const uint64_t expected = sizeof(Header) + head.entries * sizeof(Entry) + head.fences * sizeof(uint64_t);
+        if (std::memcmp(head.magic, MAGIC, sizeof(MAGIC)) != 0 || !head.fence_interval || expected != file.size() ||
+            head.fences != (head.entries + head.fence_interval - 1) / head.fence_interval) {
+            close();
+            return false;
+        }
+
+        //The mapping starts on a page boundary and the header is a multiple of 16 bytes, so both arrays are aligned
+        entries = reinterpret_cast<const Entry*>(file.data() + sizeof(Header));
+        fences = reinterpret_cast<const uint64_t*>(file.data() + sizeof(Header) + head.entries * sizeof(Entry));
+        return true;
+    }
+
+    void Index::close() {
+        file.close();
+        head = {};
+        entries = nullptr;
+        fences = nullptr;
+    }
+
+    std::vector<Hit> Index::find(uint64_t key) const {
+        std::vector<Hit> hits;
+        if (!head.entries) {
+            return hits;
+        }
+
+        //The first fence at or past the key ends the block the key's first entry is in
+        const size_t fence = std::lower_bound(fences, fences + head.fences, key) - fences;
+        const uint64_t begin = fence ? (fence - 1) * uint64_t(head.fence_interval) : 0;
+        const uint64_t end = std::min<uint64_t>(fence * uint64_t(head.fence_interval) + 1, head.entries);
+        const Entry *first = std::lower_bound(entries + begin, entries + end, key, [](const Entry &entry, uint64_t key) {
+            return entry.key < key;
+        });
+
+        for (const Entry *entry = first; entry < entries + head.entries && entry->key == key; entry++) {
+            hits.push_back(Hit{entry->game(), entry->ply()});
+        }
+        std::sort(hits.begin(), hits.end(), [](const Hit &a, const Hit &b) {
+            return a.game < b.game || (a.game == b.game && a.ply < b.ply);
+        });
+        return hits;
+    }
+
+    int indexCommand(std::istringstream &stream) {
+        std::string pgn, out;
+        size_t threads = 1;
+        size_t memory = 1024;
+        std::string arg, value;
+        while (stream >> std::skipws >> arg) {
+            stream >> value;
+            try {
+                if (arg == "file") {
+                    pgn = value;
+                } else if (arg == "out") {
+                    out = value;
+                } else if (arg == "threads") {
+                    threads = std::stoull(value);
+                } else if (arg == "memory") {
+                    memory = std::max<size_t>(std::stoull(value), 1);
+                } else {
+                    cout << "Unknown option \"" << arg << "\".\n";
+                    return 1;
+                }
+            } catch (std::invalid_argument) {
+                cout << "Invalid value for " << arg << ". \"" << value << "\" was recived.\n";
+                return 1;
+            }
+        }
+        if (pgn.empty() || out.empty()) {
+            cout << "Both file and out are needed.\n";
+            return 1;
+        }
+
+        BuildStats stats;
+        const auto start = std::chrono::steady_clock::now();
+        if (!build(pgn, out, threads, memory, stats)) {
+            return 1;
+        }
+        const int64_t time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+
+        cout << "Games: " << stats.games << " in " << time << " ms (" << uint64_t(stats.games * 60000 / std::max<int64_t>(time, 1)) << " games/min)\n";
+        cout << "Positions: " << stats.positions << '\n';
+        cout << "Errors: " << stats.errors << '\n';
+        cout << "Runs spilled: " << stats.runs << '\n';
+        cout << "Index written to " << out << std::endl;
+        return 0;
+    }
+
+    int queryCommand(std::istringstream &stream) {
+        std::string path, pgn_path, fen;
+        size_t limit = DEFAULT_LIMIT;
+        std::vector<std::string> args;
+        std::string arg;
+        while (stream >> std::skipws >> arg) {
+            args.push_back(arg);
+        }
+
+        for (size_t i = 0; i < args.size(); i++) {
+            arg = args[i];
+            if (arg == "fen") {
+                //The fen goes until the next option
+                while (i + 1 < args.size() && args[i + 1] != "index" && args[i + 1] != "pgn" && args[i + 1] != "limit") {
+                    fen += args[++i] + ' ';
+                }
+                continue;
+            }
+
+            const std::string value = i + 1 < args.size() ? args[++i] : "";
+            try {
+                if (arg == "index") {
+                    path = value;
+                } else if (arg == "pgn") {
+                    pgn_path = value;
+                } else if (arg == "limit") {
+                    limit = std::stoull(value);
+                } else {
+                    cout << "Unknown option \"" << arg << "\".\n";
+                    return 1;
+                }
+            } catch (std::invalid_argument) {
+                cout << "Invalid value for " << arg << ". \"" << value << "\" was recived.\n";
+                return 1;
+            }
+        }
+
+        Index index;
+        if (path.empty() || !index.open(path)) {
+            cout << "Unable to open \"" << path << "\" as an index.\n";
+            return 1;
+        }
+        MappedFile pgn;
+        if (!pgn_path.empty()) {
+            if (!pgn.open(pgn_path, MappedFile::RANDOM)) {
+                cout << "Unable to open \"" << pgn_path << "\".\n";
+                return 1;
+            }
+            if (pgn.size() != index.header().source_size) {
+                cout << "Warning: \"" << pgn_path << "\" isn't the size of the file that was indexed.\n";
+            }
+        }
+
+        std::unique_ptr<Chess> game = std::make_unique<Chess>(); //Too big for the stack
+        const Color color = game->setFen(fen.empty() ? starting_pos : fen);
+
+        const auto start = std::chrono::steady_clock::now();
+        const std::vector<Hit> hits = index.find(game->getPolyglotKey(color));
+        const int64_t time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+        size_t games = 0;
+        for (size_t i = 0; i < hits.size(); i++) {
+            games += i == 0 || hits[i].game != hits[i - 1].game;
+        }
+        cout << "Positions: " << hits.size() << " in " << games << " games (" << std::fixed << std::setprecision(3) << time / 1000.0 << " ms)\n";
+
+        for (size_t i = 0; i < hits.size() && i < limit; i++) {
+            cout << "Game at byte " << hits[i].game << ", ply " << hits[i].ply;
+            if (pgn.isOpen() && hits[i].game < pgn.size()) {
+                const size_t end = PGN::findGame(pgn.data(), pgn.size(), hits[i].game + 1);
+                const PGN::Game info = PGN::parseGame(pgn.view().substr(hits[i].game, end - hits[i].game), hits[i].game);
+                cout << ": " << info.tag("White") << " - " << info.tag("Black") << ' ' << info.tag("Result");
+            }
+            cout << '\n';
+        }
+        cout << std::flush;
+        return 0;
+    }
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include "game.h"
+#include "mapped_file.h"
+#include <sstream>
+#include <string>
+#include <vector>
+
+//Index from positions to the games in a PGN file that reach them
+//
+//The file is a Header, then one Entry for every position of every game sorted by hash key, then a fence table
+//holding the key of every FENCE_INTERVAL-th entry. A lookup binary searches the fences, which are small enough
+//to stay in cache, and then only the one block of entries they point to, so a query touches a few pages of the file
+//Numbers are stored in the machine's byte order
+namespace PositionIndex {
+    constexpr char MAGIC[4] = {'P', 'I', 'X', '2'}; //PIX1 files were keyed with a table of our own
+    constexpr uint32_t FENCE_INTERVAL = 256; //Entries between fences, 4 KB of them
+
+    struct Header {
+        char magic[4];
+        uint32_t fence_interval;
+        uint64_t entries;
+        uint64_t fences;
+        uint64_t source_size; //Bytes in the PGN file that was indexed, to notice if it's changed since
+    };
+
+    struct Entry {
+        //Chess::getPolyglotKey of the position with the standard keys. Unlike getKey it only counts the en passant square
+        //if the pawn can be taken, so a query from a fen written either way finds it
+        uint64_t key;
+        uint64_t game_ply; //Byte offset of the game in the PGN file in the top 48 bits and the ply in the bottom 16
+
+        inline uint64_t game() const {
+            return game_ply >> 16;
+        }
+        inline int ply() const {
+            return int(game_ply & 0xFFFF);
+        }
+    };
+    static_assert(sizeof(Entry) == 16, "Entries are written as raw bytes");
+
+    struct Hit {
+        uint64_t game; //Byte offset of the game in the PGN file
+        int ply; //Plies played before the position was reached
+    };
+
+    struct BuildStats {
+        uint64_t games = 0;
+        uint64_t positions = 0;
+        uint64_t errors = 0;
+        uint64_t runs = 0; //Sorted runs spilled to disk
+    };
+
+    //Indexes every position of every game in the PGN file. Each thread collects entries until its share of memory
+    //megabytes is used, then sorts them and spills them to disk, so the archive can be bigger than memory
+    //Returns false if a file can't be opened or written
+    bool build(const std::string &pgn, const std::string &out, size_t threads, size_t memory, BuildStats &stats);
+
+    class Index {
+      public:
+        bool open(const std::string &path); //Returns false if it can't be opened or isn't an index
+        void close();
+
+        inline bool isOpen() const {
+            return entries != nullptr;
+        }
+        inline const Header &header() const {
+            return head;
+        }
+
+        //Every game and ply with a position with this key, sorted by game and then ply
+        std::vector<Hit> find(uint64_t key) const;
+
+      private:
+        MappedFile file;
+        Header head = {};
+        const Entry *entries = nullptr;
+        const uint64_t *fences = nullptr;
+    };
+
+    //Command line entry points. Read options as name value pairs like UCI:
+    //file <pgn> out <index> threads <n> memory <mb>
+    int indexCommand(std::istringstream &stream);
+    //index <index> fen <fen> pgn <pgn> limit <n>
+    int queryCommand(std::istringstream &stream);
+}
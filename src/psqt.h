@@ -0,0 +1,22 @@
+#pragma once
+#include "bits.h"
+#include "piece.h"
+#include <array>
+
+//Piece square tables for a tapered evaluation, with the material value of the piece already added in
+//Indexed by Piece then square. White pieces are positive and black pieces are negative
+namespace PSQT {
+    extern const std::array<std::array<int16_t, 64>, 15> mg; //Middlegame
+    extern const std::array<std::array<int16_t, 64>, 15> eg; //Endgame
+
+    //How much each piece type counts towards the game being a middlegame, indexed by PieceType
+    constexpr int phase[8] = {0, 0, 1, 1, 2, 4, 0, 0};
+    constexpr int MAX_PHASE = 24; //Phase of the starting position
+
+    constexpr int16_t mg_values[8] = {0, 82, 337, 365, 477, 1025, 0, 0};
+    constexpr int16_t eg_values[8] = {0, 94, 281, 297, 512, 936, 0, 0};
+
+    //Signed material balance of each Piece using piece_values. Kings are left out since both sides always have one
+    constexpr int16_t material[15] = {0, 100, 320, 330, 500, 900, 0, 0,
+                                      0, -100, -320, -330, -500, -900, 0};
+}
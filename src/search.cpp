@@ -0,0 +1,502 @@
+#include "search.h"
+#include "evaluate.h"
+#include "tt.h"
+#include "nnue.h"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+
+namespace {
+    typedef std::chrono::steady_clock Clock;
+
+    TranspositionTable TT;
+    size_t thread_count = 1;
+
+    constexpr int64_t MOVE_OVERHEAD = 10; //Milliseconds kept back from the clock for talking to the GUI
+    constexpr int DELTA_MARGIN = 200; //How far a capture can beat its material gain by, for delta pruning
+
+    //Helper threads skip some depths so they're spread out over the next few depths instead of all searching the same one
+    //Thread i searches a depth unless ((depth + SKIP_PHASE[i]) / SKIP_SIZE[i]) is odd
+    constexpr int SKIP_SIZE[20]  = {1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4};
+    constexpr int SKIP_PHASE[20] = {0, 1, 0, 1, 2, 3, 0, 1, 2, 3, 4, 5, 0, 1, 2, 3, 4, 5, 6, 7};
+
+    struct ThreadData;
+
+    struct SharedData {
+        Search::Limits limits;
+        Clock::time_point start;
+        int64_t soft_time = 0; //Don't start another depth past this. 0 means no limit
+        int64_t hard_time = 0; //Stop the search past this. 0 means no limit
+        const std::atomic<bool> *external_stop; //Set by whoever started the search to end it
+        TranspositionTable *tt;
+        std::atomic<bool> stop {false};
+        std::vector<std::unique_ptr<ThreadData>> threads;
+        bool print; //Only the main thread prints, and only if this is set
+    };
+
+    //Everything a search thread owns. Each thread gets its own copy of the position
+    struct ThreadData {
+        size_t id; //0 is the main thread
+        SharedData *shared;
+        Chess game;
+        std::unique_ptr<NNUE::Accumulators> accumulators; //Only when a network is loaded
+        std::atomic<uint64_t> nodes {0}; //Only written by this thread but read by the main thread for limits and info
+
+        Move best_move;
+        int best_score = 0;
+        int completed_depth = 0;
+
+        //Triangular principal variation table, pv[ply] holds the line from that ply
+        Move pv[MAX_PLY + 1][MAX_PLY + 1];
+        int pv_length[MAX_PLY + 1];
+
+        Move killers[MAX_PLY + 1][2];
+        int16_t history[2][64][64] = {};
+    };
+
+    inline int64_t elapsed(const SharedData &shared) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - shared.start).count();
+    }
+
+    inline uint64_t total_nodes(const SharedData &shared) {
+        uint64_t nodes = 0;
+        for (const std::unique_ptr<ThreadData> &thread : shared.threads) {
+            nodes += thread->nodes.load(std::memory_order_relaxed);
+        }
+        return nodes;
+    }
+
+    //Counts a node and has the main thread check the limits every so often as it's slow compared to searching a node
+    inline void count_node(ThreadData &t) {
+        const uint64_t nodes = t.nodes.load(std::memory_order_relaxed) + 1;
+        t.nodes.store(nodes, std::memory_order_relaxed);
+
+        if (t.id == 0 && (nodes & 1023) == 0) {
+            const Search::Limits &limits = t.shared->limits;
+            if ((limits.nodes && total_nodes(*t.shared) >= limits.nodes) ||
+                (t.shared->hard_time && elapsed(*t.shared) >= t.shared->hard_time) ||
+                t.shared->external_stop->load(std::memory_order_relaxed)) {
+                t.shared->stop.store(true, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    inline bool stopped(const ThreadData &t) {
+        return t.shared->stop.load(std::memory_order_relaxed);
+    }
+
+    //Mate scores are stored relative to the position rather than the root so they're right wherever the position comes up
+    inline int score_to_tt(int score, int ply) {
+        return score > MATE_BOUND ? score + ply : score < -MATE_BOUND ? score - ply : score;
+    }
+
+    inline int score_from_tt(int score, int ply) {
+        return score > MATE_BOUND ? score - ply : score < -MATE_BOUND ? score + ply : score;
+    }
+
+    //History gets pulled towards the bonus so it stays in range without needing to be rescaled
+    inline void update_history(int16_t &entry, int bonus) {
+        entry += bonus - entry * std::abs(bonus) / HISTORY_LIMIT;
+    }
+
+    //Material a capture or promotion wins before any recapture
+    inline int material_gain(const Chess &game, Move move) {
+        int gain = move.flag() == EN_PASSANT ? piece_values[Pawn] : piece_values[getPieceType(game.getSquare(move.to()))];
+        if (move.isPromotion()) {
+            gain += piece_values[Queen] - piece_values[Pawn];
+        }
+        return gain;
+    }
+
+    //Keeps searching captures and promotions past the end of the main search until the position is quiet
+    //so the evaluation isn't taken in the middle of an exchange
+    template<Color color>
+    int quiescence(ThreadData &t, int ply, int alpha, int beta) {
+        Chess &game = t.game;
+        t.pv_length[ply] = ply;
+
+        count_node(t);
+        if (stopped(t)) {
+            return 0;
+        }
+
+        if (ply >= MAX_PLY) {
+            return Eval::evaluate(game, color);
+        }
+
+        //When in check every evasion gets searched since standing pat isn't an option
+        const bool in_check = game.inCheck<color>();
+        int best = -INFINITE_SCORE;
+        int stand_pat = 0;
+
+        if (!in_check) {
+            stand_pat = Eval::evaluate(game, color);
+            if (stand_pat >= beta) {
+                return stand_pat;
+            }
+            alpha = std::max(alpha, stand_pat);
+            best = stand_pat;
+        }
+
+        ScoredMoveArray moves = game.getScoredMoves<color, CAPTURES>(MoveOrdering());
+        if (in_check && moves.empty()) {
+            return -MATE_SCORE + ply;
+        }
+
+        while (!moves.empty()) {
+            const Move move = moves.next();
+
+            if (!in_check) {
+                //Underpromotions are almost never better than a queen
+                if (move.isPromotion() && (move.flag() & ~CAPTURE) != PROMOTION_QUEEN) {
+                    continue;
+                }
+
+                //Delta pruning. Skip captures that can't bring the score up to alpha even if the piece is won for free
+                if (stand_pat + material_gain(game, move) + DELTA_MARGIN <= alpha) {
+                    continue;
+                }
+
+                //Skip captures that lose material
+                if (!game.seeGE<color>(move, 0)) {
+                    continue;
+                }
+            }
+
+            game.makeMove<color>(move);
+            const int score = -quiescence<~color>(t, ply + 1, -beta, -alpha);
+            game.unmakeMove<color>(move);
+
+            if (stopped(t)) {
+                return 0;
+            }
+
+            if (score > best) {
+                best = score;
+
+                if (score > alpha) {
+                    alpha = score;
+
+                    t.pv[ply][ply] = move;
+                    for (int i = ply + 1; i < t.pv_length[ply + 1]; i++) {
+                        t.pv[ply][i] = t.pv[ply + 1][i];
+                    }
+                    t.pv_length[ply] = t.pv_length[ply + 1];
+
+                    if (score >= beta) {
+                        break;
+                    }
+                }
+            }
+        }
+
+        return best;
+    }
+
+    template<Color color>
+    int negamax(ThreadData &t, int depth, int ply, int alpha, int beta) {
+        Chess &game = t.game;
+        const bool pv_node = beta - alpha > 1;
+        t.pv_length[ply] = ply;
+
+        if (ply > 0 && (game.isRepetition() || game.isFiftyMove() || game.isInsufficientMaterial())) {
+            return 0;
+        }
+
+        const bool in_check = game.inCheck<color>();
+        if (in_check) {
+            depth++; //Don't stop searching in the middle of a check
+        }
+
+        if (depth <= 0 || ply >= MAX_PLY) {
+            return quiescence<color>(t, ply, alpha, beta);
+        }
+
+        count_node(t);
+        if (stopped(t)) {
+            return 0;
+        }
+
+        TTData tt;
+        const bool tt_hit = t.shared->tt->probe(game.getKey(), tt);
+        if (tt_hit && !pv_node && tt.depth >= depth) {
+            const int score = score_from_tt(tt.score, ply);
+            if (tt.bound == BOUND_EXACT || (tt.bound == BOUND_LOWER && score >= beta) || (tt.bound == BOUND_UPPER && score <= alpha)) {
+                return score;
+            }
+        }
+
+        MoveOrdering ordering;
+        ordering.hash_move = ply == 0 && t.best_move.raw() ? t.best_move : tt_hit ? tt.move : Move();
+        ordering.killers[0] = t.killers[ply][0];
+        ordering.killers[1] = t.killers[ply][1];
+        ordering.history = t.history[color];
+
+        ScoredMoveArray moves = game.getScoredMoves<color>(ordering);
+        if (moves.size() == 0) {
+            return in_check ? -MATE_SCORE + ply : 0;
+        }
+
+        const int original_alpha = alpha;
+        int best = -INFINITE_SCORE;
+        Move best_move;
+        int searched = 0;
+
+        while (!moves.empty()) {
+            const Move move = moves.next();
+            int score;
+
+            //Principal variation search. Only the first move gets a full window and the rest just have to prove they're worse
+            game.makeMove<color>(move);
+            if (searched == 0) {
+                score = -negamax<~color>(t, depth - 1, ply + 1, -beta, -alpha);
+            } else {
+                score = -negamax<~color>(t, depth - 1, ply + 1, -alpha - 1, -alpha);
+                if (score > alpha && score < beta) {
+                    score = -negamax<~color>(t, depth - 1, ply + 1, -beta, -alpha);
+                }
+            }
+            game.unmakeMove<color>(move);
+            searched++;
+
+            if (stopped(t)) {
+                return 0;
+            }
+
+            if (score > best) {
+                best = score;
+                best_move = move;
+
+                if (score > alpha) {
+                    alpha = score;
+
+                    //Copy the line below this move up a ply
+                    t.pv[ply][ply] = move;
+                    for (int i = ply + 1; i < t.pv_length[ply + 1]; i++) {
+                        t.pv[ply][i] = t.pv[ply + 1][i];
+                    }
+                    t.pv_length[ply] = t.pv_length[ply + 1];
+
+                    if (score >= beta) {
+                        if (!move.isCapture() && !move.isPromotion()) {
+                            if (move != t.killers[ply][0]) {
+                                t.killers[ply][1] = t.killers[ply][0];
+                                t.killers[ply][0] = move;
+                            }
+                            update_history(t.history[color][move.from()][move.to()], std::min(depth * depth, 1200));
+                        }
+                        break;
+                    }
+                }
+            }
+        }
+
+        const Bound bound = best >= beta ? BOUND_LOWER : best > original_alpha ? BOUND_EXACT : BOUND_UPPER;
+        t.shared->tt->store(game.getKey(), best_move, score_to_tt(best, ply), depth, bound);
+
+        return best;
+    }
+
+    void print_info(const ThreadData &t, int depth, int score) {
+        const int64_t time = elapsed(*t.shared);
+        const uint64_t nodes = total_nodes(*t.shared);
+
+        std::cout << "info depth " << depth << " score ";
+        if (score > MATE_BOUND) {
+            std::cout << "mate " << (MATE_SCORE - score + 1) / 2;
+        } else if (score < -MATE_BOUND) {
+            std::cout << "mate " << -(MATE_SCORE + score) / 2;
+        } else {
+            std::cout << "cp " << score;
+        }
+        std::cout << " nodes " << nodes << " nps " << nodes * 1000 / std::max<int64_t>(time, 1) << " time " << time
+                  << " hashfull " << t.shared->tt->hashfull() << " pv";
+        for (int i = 0; i < t.pv_length[0]; i++) {
+            std::cout << ' ' << t.pv[0][i].UCI();
+        }
+        std::cout << std::endl;
+    }
+
+    template<Color color>
+    void iterative_deepening(ThreadData &t) {
+        const Search::Limits &limits = t.shared->limits;
+        const bool timed = limits.nodes || t.shared->hard_time || limits.infinite;
+        const int max_depth = limits.depth ? std::min(limits.depth, MAX_PLY) : timed ? MAX_PLY : DEFAULT_DEPTH;
+
+        for (int depth = 1; depth <= max_depth; depth++) {
+            if (t.id > 0) {
+                const int i = (t.id - 1) % 20;
+                if (((depth + SKIP_PHASE[i]) / SKIP_SIZE[i]) % 2) {
+                    continue;
+                }
+            }
+
+            const int score = negamax<color>(t, depth, 0, -INFINITE_SCORE, INFINITE_SCORE);
+
+            //A search that got cut off partway through can't be trusted, unless there's nothing else to go on
+            if (stopped(t)) {
+                if (!t.best_move.raw() && t.pv_length[0] > 0) {
+                    t.best_move = t.pv[0][0];
+                }
+                break;
+            }
+
+            t.best_move = t.pv[0][0];
+            t.best_score = score;
+            t.completed_depth = depth;
+
+            if (t.id == 0 && t.shared->print) {
+                print_info(t, depth, score);
+            }
+
+            if (t.id == 0 && t.shared->soft_time && elapsed(*t.shared) >= t.shared->soft_time) {
+                break;
+            }
+
+            //Stop early if a mate has been found as searching deeper won't find a shorter one
+            if (t.id == 0 && !limits.infinite && std::abs(score) > MATE_BOUND && MATE_SCORE - std::abs(score) <= depth) {
+                break;
+            }
+        }
+
+        //An infinite search has to wait to be told to stop before it can give its move
+        if (t.id == 0 && limits.infinite) {
+            while (!t.shared->external_stop->load(std::memory_order_relaxed)) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+
+        //The helpers only stop once the main thread is done
+        if (t.id == 0) {
+            t.shared->stop.store(true, std::memory_order_relaxed);
+        }
+    }
+
+    //Splits the time left on the clock between the moves still to play
+    //The soft limit is what a move should take, the hard limit is what it's allowed to take if a depth runs long
+    void allocate_time(SharedData &shared, Color color) {
+        const Search::Limits &limits = shared.limits;
+        const int64_t time = limits.time[color];
+
+        if (time && !limits.infinite) {
+            const int64_t available = std::max<int64_t>(time - MOVE_OVERHEAD, 1);
+            const int moves = limits.movestogo ? std::min(limits.movestogo, 50) : 30;
+
+            shared.hard_time = std::max<int64_t>(available * 3 / 4, 1);
+            shared.soft_time = std::min(available / moves + limits.increment[color] * 3 / 4, shared.hard_time / 3);
+            shared.soft_time = std::max<int64_t>(shared.soft_time, 1);
+        }
+
+        if (limits.movetime) {
+            shared.hard_time = shared.hard_time ? std::min(shared.hard_time, limits.movetime) : limits.movetime;
+        }
+    }
+
+    //Lazy SMP. Every thread searches the same position with its own copy of the game and they only share the transposition table
+    Search::Result run(const Chess &game, Color color, const Search::Limits &limits, const std::atomic<bool> &stop, size_t threads, bool print,
+                       TranspositionTable &tt = TT) {
+        SharedData shared;
+        shared.limits = limits;
+        shared.print = print;
+        shared.external_stop = &stop;
+        shared.tt = &tt;
+        shared.start = Clock::now();
+        allocate_time(shared, color);
+
+        for (size_t i = 0; i < threads; i++) {
+            shared.threads.push_back(std::make_unique<ThreadData>()); //Too big for the stack
+            shared.threads.back()->id = i;
+            shared.threads.back()->shared = &shared;
+            shared.threads.back()->game = game;
+            if (NNUE::isLoaded()) {
+                shared.threads.back()->accumulators = std::make_unique<NNUE::Accumulators>();
+                shared.threads.back()->game.setAccumulators(shared.threads.back()->accumulators.get());
+            }
+        }
+
+        tt.newSearch();
+
+        auto search = [color](ThreadData *t) {
+            if (color == WHITE) {
+                iterative_deepening<WHITE>(*t);
+            } else {
+                iterative_deepening<BLACK>(*t);
+            }
+        };
+
+        std::vector<std::thread> helpers;
+        for (size_t i = 1; i < threads; i++) {
+            helpers.emplace_back(search, shared.threads[i].get());
+        }
+        search(shared.threads[0].get());
+        for (std::thread &helper : helpers) {
+            helper.join();
+        }
+
+        const ThreadData &main = *shared.threads[0];
+        return Search::Result{main.best_move, main.best_score, main.completed_depth, total_nodes(shared), elapsed(shared)};
+    }
+}
+
+namespace Search {
+    Move go(Chess &game, Color color, const Limits &limits, const std::atomic<bool> &stop) {
+        Move best = run(game, color, limits, stop, thread_count, true).best;
+        std::cout << "bestmove " << (best.raw() ? best.UCI() : "0000") << std::endl;
+        return best;
+    }
+
+    Result search(const Chess &game, Color color, const Limits &limits, TranspositionTable &tt) {
+        static const std::atomic<bool> never_stop {false};
+        return run(game, color, limits, never_stop, 1, false, tt);
+    }
+
+    void setThreads(size_t threads) {
+        thread_count = std::max<size_t>(threads, 1);
+    }
+
+    void setHash(size_t megabytes) {
+        TT.resize(std::max<size_t>(megabytes, 1));
+    }
+
+    void clear() {
+        TT.clear();
+    }
+
+    void threadScaling(const Chess &game, Color color, int depth, const std::atomic<bool> &stop) {
+        Limits limits;
+        limits.depth = depth;
+
+        //Thread counts to test, doubling up to the set number of threads
+        std::vector<size_t> counts;
+        for (size_t threads = 1; threads < thread_count; threads *= 2) {
+            counts.push_back(threads);
+        }
+        counts.push_back(thread_count);
+
+        double base_time = 0;
+        std::cout << "Time to depth " << depth << " with a cleared hash table each run\n";
+        std::cout << "threads      time(ms)    speedup          nodes            nps\n";
+        for (size_t threads : counts) {
+            TT.clear();
+            const Result result = run(game, color, limits, stop, threads, false);
+            if (stop.load(std::memory_order_relaxed)) {
+                break;
+            }
+            const double time = std::max<int64_t>(result.time, 1);
+            if (threads == 1) {
+                base_time = time;
+            }
+
+            std::cout << std::setw(7) << threads << std::setw(14) << result.time
+                      << std::setw(11) << std::fixed << std::setprecision(2) << base_time / time
+                      << std::setw(15) << result.nodes << std::setw(15) << uint64_t(result.nodes * 1000 / time)
+                      << "  bestmove " << result.best.UCI() << '\n';
+        }
+        std::cout << std::endl;
+        TT.clear();
+    }
+}
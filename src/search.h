@@ -0,0 +1,50 @@
+#pragma once
+#include "game.h"
+#include "tt.h"
+#include <atomic>
+
+constexpr int MAX_PLY = 128;
+constexpr int MATE_SCORE = 32000; //Mate at the root, mates further away score MATE_SCORE - ply
+constexpr int MATE_BOUND = MATE_SCORE - MAX_PLY; //Any score past this is a mate
+constexpr int INFINITE_SCORE = 32001;
+constexpr int DEFAULT_DEPTH = 8; //Depth used when go isn't given any limits
+
+namespace Search {
+    //What stops the search. 0 means no limit
+    struct Limits {
+        int depth = 0;
+        uint64_t nodes = 0;
+        int64_t movetime = 0; //Milliseconds
+
+        //Clock for each side in milliseconds, used to work out how long to spend on the move
+        int64_t time[2] = {0, 0};
+        int64_t increment[2] = {0, 0};
+        int movestogo = 0;
+
+        bool infinite = false; //Search until stopped, and don't give the best move until then either
+    };
+
+    struct Result {
+        Move best;
+        int score; //From the side to move's point of view
+        int depth; //Last depth that finished
+        uint64_t nodes;
+        int64_t time; //Milliseconds
+    };
+
+    //Iterative deepening alpha-beta search, run on as many threads as were set with setThreads
+    //Prints a UCI info line after each finished depth and then the best move
+    //Setting stop from another thread ends the search early
+    Move go(Chess &game, Color color, const Limits &limits, const std::atomic<bool> &stop);
+
+    //Single threaded search that prints nothing and uses the given transposition table instead of the shared one,
+    //so lots of them can run at once, like for self-play. limits should have a depth or node limit
+    Result search(const Chess &game, Color color, const Limits &limits, TranspositionTable &tt);
+
+    void setThreads(size_t threads);
+    void setHash(size_t megabytes); //Resizing clears the transposition table
+    void clear(); //Forget everything from earlier searches
+
+    //Searches to a fixed depth with 1, 2, 4... threads up to the set number and reports the time each took
+    void threadScaling(const Chess &game, Color color, int depth, const std::atomic<bool> &stop);
+}
@@ -0,0 +1,387 @@
+#include "selfplay.h"
+#include "playout.h"
+#include "search.h"
+#include "training.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+using std::cout;
+
+namespace {
+    typedef std::chrono::steady_clock Clock;
+
+    constexpr const char *ending_names[Selfplay::ENDING_COUNT] = {"checkmate", "stalemate", "fifty move", "repetition", "insufficient material", "ply cap"};
+    constexpr int64_t REPORT_INTERVAL = 1000; //Milliseconds between progress lines
+    constexpr size_t PGN_LINE_LENGTH = 80;
+
+    struct FinishedGame {
+        uint64_t index = 0;
+        std::string fen; //Empty for the starting position
+        std::vector<Move> moves;
+        std::vector<int16_t> scores; //Of the position before each move from its side to move's point of view, 0 for random moves
+        int random_moves = 0; //Moves at the start played at random to vary the opening
+        int result = 0; //For white: 1 win, 0 draw, -1 loss
+        Selfplay::Ending ending = Selfplay::PLY_CAP;
+    };
+
+    template<Color color>
+    Move random_move(const Chess &game, Xorshift &rng) {
+        const MoveArray moves = game.getMoves<color>();
+        return moves.begin()[rng.below(moves.size())];
+    }
+
+    //Plays one game and takes every move back again so the board can be reused
+    FinishedGame play_game(Chess &game, TranspositionTable *tt, const Selfplay::Options &options, uint64_t index) {
+        FinishedGame finished;
+        finished.index = index;
+        if (!options.openings.empty()) {
+            finished.fen = options.openings[index % options.openings.size()];
+        }
+        Color color = game.setFen(finished.fen.empty() ? starting_pos : finished.fen);
+
+        Xorshift rng = Xorshift::forStream(options.seed, index);
+        Search::Limits limits;
+        limits.depth = options.nodes ? 0 : options.depth;
+        limits.nodes = options.nodes;
+        if (tt) {
+            tt->clear(); //So a game doesn't depend on which worker played it
+        }
+
+        while (true) {
+            const bool has_move = color == WHITE ? game.hasLegalMove<WHITE>() : game.hasLegalMove<BLACK>();
+            if (!has_move) {
+                if (color == WHITE ? game.inCheck<WHITE>() : game.inCheck<BLACK>()) {
+                    finished.ending = Selfplay::CHECKMATE;
+                    finished.result = color == WHITE ? -1 : 1;
+                } else {
+                    finished.ending = Selfplay::STALEMATE;
+                }
+                break;
+            }
+            if (game.isFiftyMove()) {
+                finished.ending = Selfplay::FIFTY_MOVE;
+                break;
+            }
+            if (game.isRepetition(3)) {
+                finished.ending = Selfplay::REPETITION;
+                break;
+            }
+            if (game.isInsufficientMaterial()) {
+                finished.ending = Selfplay::INSUFFICIENT_MATERIAL;
+                break;
+            }
+            if (int(finished.moves.size()) >= options.max_plies || game.getDepth() >= MAX_GAME_LENGTH - 1) {
+                finished.ending = Selfplay::PLY_CAP;
+                break;
+            }
+
+            Move move;
+            int score = 0;
+            if (int(finished.moves.size()) < options.random_plies) {
+                finished.random_moves++;
+            } else if (tt) {
+                const Search::Result result = Search::search(game, color, limits, *tt);
+                move = result.best;
+                score = result.score;
+            }
+            if (move == Move()) {
+                move = color == WHITE ? random_move<WHITE>(game, rng) : random_move<BLACK>(game, rng);
+            }
+
+            finished.moves.push_back(move);
+            finished.scores.push_back(int16_t(score));
+            if (color == WHITE) {
+                game.makeMove<WHITE>(move);
+            } else {
+                game.makeMove<BLACK>(move);
+            }
+            color = ~color;
+        }
+
+        for (auto move = finished.moves.rbegin(); move != finished.moves.rend(); move++) {
+            color = ~color;
+            if (color == WHITE) {
+                game.unmakeMove<WHITE>(*move);
+            } else {
+                game.unmakeMove<BLACK>(*move);
+            }
+        }
+        return finished;
+    }
+
+    //Replays a finished game on the writer's board to write it out
+    class GameWriter {
+      public:
+        GameWriter(std::ostream &out, bool pgn) : out(out), pgn(pgn), game(std::make_unique<Chess>()) {
+            if (!pgn) {
+                training = std::make_unique<Training::Writer>(out);
+            }
+        }
+
+        void write(const FinishedGame &finished) {
+            Color color = game->setFen(finished.fen.empty() ? starting_pos : finished.fen);
+            if (pgn) {
+                write_pgn(finished, color);
+            } else {
+                write_training(finished, color);
+            }
+        }
+
+      private:
+        void write_pgn(const FinishedGame &finished, Color color) {
+            const char *result = finished.result > 0 ? "1-0" : finished.result < 0 ? "0-1" : "1/2-1/2";
+            out << "[Event \"Self-play\"]\n[Site \"?\"]\n[Date \"????.??.??\"]\n[Round \"" << finished.index + 1 << "\"]\n"
+                << "[White \"main.exe\"]\n[Black \"main.exe\"]\n[Result \"" << result << "\"]\n";
+            if (!finished.fen.empty()) {
+                out << "[SetUp \"1\"]\n[FEN \"" << finished.fen << "\"]\n";
+            }
+            out << "[Termination \"" << ending_names[finished.ending] << "\"]\n\n";
+
+            //Move numbers follow the fen's fullmove number, which Chess doesn't keep, so they count from 1
+            std::string line;
+            char san[MAX_SAN_LENGTH];
+            int number = 1;
+            auto add = [&](const char *token) {
+                if (!line.empty() && line.size() + 1 + std::strlen(token) > PGN_LINE_LENGTH) {
+                    out << line << '\n';
+                    line.clear();
+                }
+                if (!line.empty()) {
+                    line += ' ';
+                }
+                line += token;
+            };
+
+            for (size_t i = 0; i < finished.moves.size(); i++) {
+                if (color == WHITE || i == 0) {
+                    add((std::to_string(number) + (color == WHITE ? "." : "...")).c_str());
+                }
+                if (color == WHITE) {
+                    game->toSAN<WHITE>(finished.moves[i], san);
+                    game->makeMove<WHITE>(finished.moves[i]);
+                } else {
+                    game->toSAN<BLACK>(finished.moves[i], san);
+                    game->makeMove<BLACK>(finished.moves[i]);
+                    number++;
+                }
+                add(san);
+                color = ~color;
+            }
+            add(result);
+            out << line << "\n\n";
+            unmake_all(finished, color);
+        }
+
+        //The opening moves are left out since they're the same random noise in every game
+        void write_training(const FinishedGame &finished, Color color) {
+            for (size_t i = 0; i < finished.moves.size(); i++) {
+                if (int(i) >= finished.random_moves) {
+                    training->add(*game, color, finished.scores[i], finished.result, int(i) > finished.random_moves ? finished.moves[i - 1] : Move());
+                }
+                if (color == WHITE) {
+                    game->makeMove<WHITE>(finished.moves[i]);
+                } else {
+                    game->makeMove<BLACK>(finished.moves[i]);
+                }
+                color = ~color;
+            }
+            unmake_all(finished, color);
+        }
+
+        void unmake_all(const FinishedGame &finished, Color color) {
+            for (auto move = finished.moves.rbegin(); move != finished.moves.rend(); move++) {
+                color = ~color;
+                if (color == WHITE) {
+                    game->unmakeMove<WHITE>(*move);
+                } else {
+                    game->unmakeMove<BLACK>(*move);
+                }
+            }
+        }
+
+        std::ostream &out;
+        bool pgn;
+        std::unique_ptr<Chess> game;
+        std::unique_ptr<Training::Writer> training;
+    };
+
+    struct Stats {
+        uint64_t games = 0;
+        uint64_t positions = 0;
+        uint64_t white_wins = 0;
+        uint64_t black_wins = 0;
+        uint64_t draws = 0;
+        uint64_t endings[Selfplay::ENDING_COUNT] = {};
+    };
+
+    void print_stats(const Stats &stats, int64_t time) {
+        const double games = std::max<uint64_t>(stats.games, 1);
+        time = std::max<int64_t>(time, 1);
+        cout << std::fixed << std::setprecision(2);
+        cout << "Games: " << stats.games << " in " << time << " ms (" << stats.games * 1000.0 / time << " games/s, "
+             << uint64_t(stats.positions * 1000 / time) << " positions/s)\n";
+        cout << "White wins: " << stats.white_wins << " (" << 100 * stats.white_wins / games << "%)\n";
+        cout << "Black wins: " << stats.black_wins << " (" << 100 * stats.black_wins / games << "%)\n";
+        cout << "Draws: " << stats.draws << " (" << 100 * stats.draws / games << "%)\n";
+        cout << "Average length: " << stats.positions / games << " plies\n\n";
+
+        for (int i = 0; i < Selfplay::ENDING_COUNT; i++) {
+            cout << std::left << std::setw(23) << ending_names[i] << std::right << std::setw(12) << stats.endings[i]
+                 << std::setw(8) << 100 * stats.endings[i] / games << "%\n";
+        }
+        cout << std::endl;
+    }
+}
+
+namespace Selfplay {
+    int command(std::istringstream &stream) {
+        Options options;
+        std::vector<std::string> args;
+        std::string arg;
+        while (stream >> std::skipws >> arg) {
+            args.push_back(arg);
+        }
+
+        for (size_t i = 0; i < args.size(); i++) {
+            arg = args[i];
+            if (arg == "random") {
+                options.random = true;
+                continue;
+            }
+
+            const std::string value = i + 1 < args.size() ? args[++i] : "";
+            try {
+                if (arg == "games") {
+                    options.games = std::stoull(value);
+                } else if (arg == "threads") {
+                    options.threads = std::max<size_t>(std::stoull(value), 1);
+                } else if (arg == "depth") {
+                    options.depth = std::max(std::stoi(value), 1);
+                } else if (arg == "nodes") {
+                    options.nodes = std::stoull(value);
+                } else if (arg == "randomplies") {
+                    options.random_plies = std::max(std::stoi(value), 0);
+                } else if (arg == "plies") {
+                    options.max_plies = std::max(std::stoi(value), 1);
+                } else if (arg == "hash") {
+                    options.hash = std::max<size_t>(std::stoull(value), 1);
+                } else if (arg == "seed") {
+                    options.seed = std::stoull(value);
+                } else if (arg == "out") {
+                    options.out = value;
+                } else if (arg == "openings") {
+                    std::ifstream file(value);
+                    if (!file) {
+                        cout << "Unable to open \"" << value << "\".\n";
+                        return 1;
+                    }
+                    std::string line;
+                    while (std::getline(file, line)) {
+                        if (!line.empty() && line[0] != '#') {
+                            options.openings.push_back(line);
+                        }
+                    }
+                } else {
+                    cout << "Unknown option \"" << arg << "\".\n";
+                    return 1;
+                }
+            } catch (std::invalid_argument) {
+                cout << "Invalid value for " << arg << ". \"" << value << "\" was recived.\n";
+                return 1;
+            }
+        }
+
+        std::ofstream out;
+        std::unique_ptr<GameWriter> writer;
+        if (!options.out.empty()) {
+            const bool pgn = options.out.size() >= 4 && options.out.compare(options.out.size() - 4, 4, ".pgn") == 0;
+            out.open(options.out, pgn ? std::ios::out : std::ios::binary);
+            if (!out) {
+                cout << "Unable to open \"" << options.out << "\".\n";
+                return 1;
+            }
+            writer = std::make_unique<GameWriter>(out, pgn);
+        }
+
+        cout << "Playing " << options.games << " games on " << options.threads << (options.threads == 1 ? " thread" : " threads") << ", ";
+        if (options.random) {
+            cout << "random moves\n";
+        } else if (options.nodes) {
+            cout << options.nodes << " nodes a move\n";
+        } else {
+            cout << "depth " << options.depth << '\n';
+        }
+
+        MPSCQueue<FinishedGame> queue;
+        std::atomic<uint64_t> next {0};
+        std::atomic<size_t> finished_workers {0};
+
+        auto work = [&]() {
+            std::unique_ptr<Chess> game = std::make_unique<Chess>(); //Too big for the stack
+            std::unique_ptr<TranspositionTable> tt;
+            if (!options.random) {
+                tt = std::make_unique<TranspositionTable>();
+                tt->resize(options.hash);
+            }
+            for (uint64_t index = next++; index < options.games; index = next++) {
+                queue.push(play_game(*game, tt.get(), options, index));
+            }
+            finished_workers.fetch_add(1, std::memory_order_release);
+        };
+
+        const auto start = Clock::now();
+        std::vector<std::thread> workers;
+        for (size_t i = 0; i < options.threads; i++) {
+            workers.emplace_back(work);
+        }
+
+        //This thread is the writer
+        Stats stats;
+        int64_t last_report = 0;
+        while (true) {
+            //Read before popping so no game can be pushed after the queue is seen empty
+            const bool done = finished_workers.load(std::memory_order_acquire) == options.threads;
+
+            FinishedGame finished;
+            if (queue.pop(finished)) {
+                if (writer) {
+                    writer->write(finished);
+                }
+                stats.games++;
+                stats.positions += finished.moves.size();
+                stats.endings[finished.ending]++;
+                (finished.result > 0 ? stats.white_wins : finished.result < 0 ? stats.black_wins : stats.draws)++;
+            } else if (done) {
+                break;
+            } else {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+
+            const int64_t time = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count();
+            if (time - last_report >= REPORT_INTERVAL) {
+                last_report = time;
+                cout << "info games " << stats.games << " positions " << stats.positions
+                     << " games/s " << std::fixed << std::setprecision(2) << stats.games * 1000.0 / time
+                     << " positions/s " << uint64_t(stats.positions * 1000 / time) << std::endl;
+            }
+        }
+
+        for (std::thread &worker : workers) {
+            worker.join();
+        }
+        writer.reset(); //Writes the last chunk of training data
+        const int64_t time = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count();
+
+        print_stats(stats, time);
+        if (!options.out.empty()) {
+            cout << "Written to " << options.out << std::endl;
+        }
+        return 0;
+    }
+}
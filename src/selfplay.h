@@ -0,0 +1,87 @@
+#pragma once
+#include "game.h"
+#include <atomic>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+//Self-play game generation. Worker threads each play games on their own board and hand the finished games
+//to a single writer thread through a lock-free queue, so the workers never wait on the disk
+namespace Selfplay {
+    //Multiple producer, single consumer queue from Dmitry Vyukov
+    //Pushing is one atomic exchange. Only the consumer thread may pop
+    template<typename T>
+    class MPSCQueue {
+      public:
+        MPSCQueue() : head(new Node()), tail(head.load(std::memory_order_relaxed)) {}
+
+        ~MPSCQueue() {
+            T value;
+            while (pop(value)) {}
+            delete tail;
+        }
+
+        MPSCQueue(const MPSCQueue&) = delete;
+        MPSCQueue &operator=(const MPSCQueue&) = delete;
+
+        void push(T value) {
+            Node *node = new Node(std::move(value));
+            Node *previous = head.exchange(node, std::memory_order_acq_rel);
+            previous->next.store(node, std::memory_order_release); //Until this the consumer sees the queue end at previous
+        }
+
+        //Returns false if the queue is empty
+        bool pop(T &value) {
+            Node *next = tail->next.load(std::memory_order_acquire);
+            if (!next) {
+                return false;
+            }
+            value = std::move(next->value);
+            delete tail;
+            tail = next; //next becomes the empty node at the front
+            return true;
+        }
+
+      private:
+        struct Node {
+            std::atomic<Node*> next {nullptr};
+            T value;
+
+            Node() = default;
+            explicit Node(T value) : value(std::move(value)) {}
+        };
+
+        std::atomic<Node*> head; //Last node pushed
+        Node *tail; //Node before the first one that hasn't been popped, only touched by the consumer
+    };
+
+    //How a game ended
+    enum Ending {
+        CHECKMATE,
+        STALEMATE,
+        FIFTY_MOVE,
+        REPETITION,
+        INSUFFICIENT_MATERIAL,
+        PLY_CAP,
+        ENDING_COUNT
+    };
+
+    struct Options {
+        uint64_t games = 100;
+        size_t threads = 1;
+        int depth = 4; //Search depth for each move
+        uint64_t nodes = 0; //Node budget for each move, used instead of depth if set
+        bool random = false; //Play random moves instead of searching, like a playout
+        int random_plies = 8; //Random moves at the start of each game so the games differ
+        int max_plies = 400; //Games longer than this are called a draw
+        size_t hash = 16; //Transposition table size in megabytes for each worker
+        uint64_t seed = 1;
+        std::vector<std::string> openings; //Fens to start from, picked in turn. The starting position if empty
+        std::string out; //Output file, PGN if it ends in .pgn and training data otherwise. Nothing is written if empty
+    };
+
+    //Command line entry point. Reads options as name value pairs like UCI:
+    //games <n> threads <n> depth <n> nodes <n> random randomplies <n> plies <n> hash <mb> seed <n> openings <fen list> out <file>
+    int command(std::istringstream &stream);
+}
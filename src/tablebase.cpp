@@ -0,0 +1,1692 @@
+#include "tablebase.h"
+#include "external_sort.h"
+#include "playout.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+
+using std::cout;
+
+namespace {
+    using namespace Tablebase;
+
+    constexpr uint64_t CHUNK = 4096; //Indices handed to a thread at a time
+    constexpr int MAX_MOVES = 256; //More than any side with up to 5 pieces has
+    constexpr char piece_letters[8] = {' ', 'P', 'N', 'B', 'R', 'Q', 'K', ' '};
+    constexpr int material_values[8] = {0, 1, 3, 3, 5, 9, 0, 0}; //For picking the stronger side
+
+    //Blocks are compressed in the style of LZ4. Each sequence is a token with the number of literals in the high 4
+    //bits and the match length minus MIN_MATCH in the low 4, then more length bytes for either that's 15 or over,
+    //the literals, and a 2 byte offset back to the match. The last sequence has only literals
+    constexpr size_t MIN_MATCH = 4;
+    constexpr size_t COPY_SIZE = 16; //Short literals and matches are copied this many bytes at a time
+    constexpr int HASH_BITS = 12;
+    constexpr int MAX_CHAIN = 32; //Earlier positions with the same hash tried for each match
+    constexpr uint64_t DEFAULT_PROBES = 100000; //Random positions probed for each table by the benchmark
+
+    inline void write_length(std::vector<uint8_t> &out, size_t length) {
+        for (; length >= 255; length -= 255) {
+            out.push_back(255);
+        }
+        out.push_back(uint8_t(length));
+    }
+
+    inline void write_sequence(std::vector<uint8_t> &out, const uint8_t *literals, size_t count, size_t match, size_t offset) {
+        const size_t extra = match ? match - MIN_MATCH : 0;
+        out.push_back(uint8_t((std::min<size_t>(count, 15) << 4) | std::min<size_t>(extra, 15)));
+        if (count >= 15) {
+            write_length(out, count - 15);
+        }
+        out.insert(out.end(), literals, literals + count);
+        if (!match) {
+            return;
+        }
+        out.push_back(uint8_t(offset));
+        out.push_back(uint8_t(offset >> 8));
+        if (extra >= 15) {
+            write_length(out, extra - 15);
+        }
+    }
+
+    //Appends the compressed block to out. Matches are found greedily through hash chains of 4 byte prefixes
+    void compress_block(const uint8_t *block, size_t size, std::vector<uint8_t> &out) {
+        int32_t heads[1 << HASH_BITS];
+        std::fill(heads, heads + (1 << HASH_BITS), -1);
+        std::vector<int32_t> chain(size);
+        auto hash = [&](size_t i) {
+            uint32_t prefix;
+            std::memcpy(&prefix, block + i, sizeof(prefix));
+            return (prefix * 2654435761u) >> (32 - HASH_BITS);
+        };
+        auto insert = [&](size_t i) {
+            if (i + MIN_MATCH <= size) {
+                const uint32_t h = hash(i);
+                chain[i] = heads[h];
+                heads[h] = int32_t(i);
+            }
+        };
+
+        size_t anchor = 0;
+        size_t i = 0;
+        while (i + MIN_MATCH <= size) {
+            size_t best = 0, offset = 0;
+            int32_t candidate = heads[hash(i)];
+            for (int tries = 0; candidate >= 0 && tries < MAX_CHAIN; tries++, candidate = chain[candidate]) {
+                size_t length = 0;
+                while (i + length < size && block[candidate + length] == block[i + length]) {
+                    length++;
+                }
+                if (length > best) {
+                    best = length;
+                    offset = i - candidate;
+                }
+            }
+
+            if (best < MIN_MATCH) {
+                insert(i++);
+                continue;
+            }
+            write_sequence(out, block + anchor, i - anchor, best, offset);
+            for (size_t end = i + best; i < end; i++) {
+                insert(i);
+            }
+            anchor = i;
+        }
+        write_sequence(out, block + anchor, size - anchor, 0, 0);
+    }
+
+    //Returns false unless the data decompresses to exactly size bytes
+    bool decompress_block(const uint8_t *data, size_t length, uint8_t *block, size_t size) {
+        const uint8_t *end = data + length;
+        size_t written = 0;
+        auto read_length = [&](size_t &value) {
+            uint8_t byte;
+            do {
+                if (data == end) {
+                    return false;
+                }
+                byte = *data++;
+                value += byte;
+            } while (byte == 255);
+            return true;
+        };
+
+        while (data < end) {
+            const uint8_t token = *data++;
+            size_t count = token >> 4;
+            if ((count == 15 && !read_length(count)) || count > size_t(end - data) || count > size - written) {
+                return false;
+            }
+            if (count <= COPY_SIZE && end - data >= ptrdiff_t(COPY_SIZE) && size - written >= COPY_SIZE) {
+                std::memcpy(block + written, data, COPY_SIZE); //A fixed size copy is a couple of moves instead of a call
+            } else {
+                std::memcpy(block + written, data, count);
+            }
+            data += count;
+            written += count;
+            if (data == end) {
+                break; //The last sequence
+            }
+
+            if (end - data < 2) {
+                return false;
+            }
+            const size_t offset = data[0] | (size_t(data[1]) << 8);
+            data += 2;
+            size_t match = token & 15;
+            if ((match == 15 && !read_length(match)) || !offset || offset > written || match + MIN_MATCH > size - written) {
+                return false;
+            }
+            match += MIN_MATCH;
+            if (offset == 1) {
+                std::memset(block + written, block[written - 1], match); //A run of one value
+                written += match;
+                continue;
+            }
+            if (offset >= COPY_SIZE) {
+                //Copies past the end of the match are overwritten by whatever comes next
+                const size_t match_end = written + match;
+                for (; written < match_end && size - written >= COPY_SIZE; written += COPY_SIZE) {
+                    std::memcpy(block + written, block + written - offset, COPY_SIZE);
+                }
+                written = std::min(written, match_end);
+                match = match_end - written;
+            }
+            //Byte by byte when the match overlaps what it's copying, which repeats the last offset bytes
+            for (size_t i = 0; i < match; i++, written++) {
+                block[written] = block[written - offset];
+            }
+        }
+        return written == size;
+    }
+
+    //Where the parts of a table file start. Returns false if the file isn't a table for the material
+    bool parse_file(const uint8_t *file, size_t size, const Table &table, const FileHeader *&header,
+                    const uint64_t *&index, const uint16_t *&lengths, const uint8_t *&data) {
+        if (size < sizeof(FileHeader)) {
+            return false;
+        }
+        header = reinterpret_cast<const FileHeader*>(file);
+        const std::string name = table.material().name();
+        const uint64_t blocks = (2 * table.size() + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        const uint64_t index_size = (blocks + INDEX_INTERVAL - 1) / INDEX_INTERVAL * sizeof(uint64_t);
+        const uint64_t data_start = (sizeof(FileHeader) + index_size + blocks * sizeof(uint16_t) + 7) / 8 * 8;
+        if (std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0 || header->count != uint32_t(table.material().count) ||
+            std::string(header->name, strnlen(header->name, sizeof(header->name))) != name || header->positions != table.size() ||
+            header->block_size != BLOCK_SIZE || header->index_interval != INDEX_INTERVAL || header->blocks != blocks || data_start > size) {
+            return false;
+        }
+
+        //The mapping starts on a page boundary and every part is a multiple of 8 bytes in, so they're all aligned
+        index = reinterpret_cast<const uint64_t*>(file + sizeof(FileHeader));
+        lengths = reinterpret_cast<const uint16_t*>(file + sizeof(FileHeader) + index_size);
+        data = file + data_start;
+        const uint64_t last = blocks - 1;
+        uint64_t end = index[last / INDEX_INTERVAL];
+        for (uint64_t block = last / INDEX_INTERVAL * INDEX_INTERVAL; block <= last; block++) {
+            end += lengths[block];
+        }
+        return end == size - data_start;
+    }
+
+    inline uint64_t block_offset(const uint64_t *index, const uint16_t *lengths, uint64_t block) {
+        uint64_t offset = index[block / INDEX_INTERVAL];
+        for (uint64_t i = block / INDEX_INTERVAL * INDEX_INTERVAL; i < block; i++) {
+            offset += lengths[i];
+        }
+        return offset;
+    }
+
+    //Values in a block, which is shorter at the end of the file
+    inline size_t block_values(const Table &table, uint64_t block) {
+        return size_t(std::min<uint64_t>(BLOCK_SIZE, 2 * table.size() - block * BLOCK_SIZE));
+    }
+
+    //Decompresses a block, which is stored as is when compressing doesn't make it any smaller
+    inline bool read_block(const uint8_t *data, const uint64_t *index, const uint16_t *lengths, uint64_t block, uint8_t *values, size_t size) {
+        const uint8_t *start = data + block_offset(index, lengths, block);
+        if (lengths[block] == size) {
+            std::memcpy(values, start, size);
+            return true;
+        }
+        return decompress_block(start, lengths[block], values, size);
+    }
+
+    //binomial[n][k] is n choose k, which is 0 if k > n
+    struct Binomials {
+        uint64_t table[65][MAX_PIECES + 1] = {};
+
+        constexpr Binomials() {
+            for (int n = 0; n <= 64; n++) {
+                table[n][0] = 1;
+                for (int k = 1; k <= MAX_PIECES; k++) {
+                    table[n][k] = n ? table[n - 1][k - 1] + table[n - 1][k] : 0;
+                }
+            }
+        }
+    };
+    constexpr Binomials binomials;
+
+    //The 462 ways to place two kings that aren't next to each other with the white king in the a1-d1-d4 triangle,
+    //and the black king below the diagonal when the white king is on it
+    struct KingPairs {
+        int16_t index[64][64];
+        Square squares[462][2];
+
+        KingPairs() {
+            int count = 0;
+            for (Square white = 0; white < 64; white++) {
+                for (Square black = 0; black < 64; black++) {
+                    index[white][black] = -1;
+                    const int file = white & 7, rank = white >> 3;
+                    const bool adjacent = std::abs(file - (black & 7)) <= 1 && std::abs(rank - (black >> 3)) <= 1;
+                    if (file > 3 || rank > file || adjacent || (rank == file && (black >> 3) > (black & 7))) {
+                        continue;
+                    }
+                    index[white][black] = int16_t(count);
+                    squares[count][0] = white;
+                    squares[count][1] = black;
+                    count++;
+                }
+            }
+        }
+    };
+    const KingPairs king_pairs;
+
+    //Bit 1 flips the files, bit 2 the ranks and bit 4 mirrors along the a1-h8 diagonal, in that order
+    inline Square transform(Square sq, int symmetry) {
+        if (symmetry & 1) {
+            sq ^= 7;
+        }
+        if (symmetry & 2) {
+            sq ^= 56;
+        }
+        if (symmetry & 4) {
+            sq = Square(((sq & 7) << 3) | (sq >> 3));
+        }
+        return sq;
+    }
+
+    inline Bitboard attacks_from(Piece piece, Square sq, Bitboard occupied) {
+        switch (getPieceType(piece)) {
+            case Pawn:
+                return getPieceColor(piece) == WHITE ? pawn_attacks<WHITE>(get_single_bitboard(sq)) : pawn_attacks<BLACK>(get_single_bitboard(sq));
+            case Knight:
+                return get_attacks<Knight>(sq, occupied);
+            case Bishop:
+                return get_attacks<Bishop>(sq, occupied);
+            case Rook:
+                return get_attacks<Rook>(sq, occupied);
+            case Queen:
+                return get_attacks<Queen>(sq, occupied);
+            default:
+                return get_attacks<King>(sq, occupied);
+        }
+    }
+
+    //True if a piece of color by, other than the one at skip, attacks target
+    inline bool is_attacked(const Piece *pieces, const Square *squares, int count, Square target, Color by, Bitboard occupied, int skip = -1) {
+        for (int i = 0; i < count; i++) {
+            if (i != skip && getPieceColor(pieces[i]) == by && (attacks_from(pieces[i], squares[i], occupied) & get_single_bitboard(target))) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    inline Bitboard occupancy(const Square *squares, int count) {
+        Bitboard occupied = 0;
+        for (int i = 0; i < count; i++) {
+            occupied |= get_single_bitboard(squares[i]);
+        }
+        return occupied;
+    }
+
+    //Calls callback(pieces, squares, count, in_table) with the position after every legal move of color. Captures
+    //and promotions change the material so they leave the table, and come with their own piece list
+    template<typename Callback>
+    void for_each_move(const Piece *pieces, const Square *squares, int count, Color color, const Callback &callback) {
+        const Bitboard occupied = occupancy(squares, count);
+        Bitboard own = 0;
+        for (int i = 0; i < count; i++) {
+            own |= getPieceColor(pieces[i]) == color ? get_single_bitboard(squares[i]) : 0;
+        }
+        const int king = color == WHITE ? 0 : 1;
+        Square after[MAX_PIECES];
+
+        auto play = [&](int moved, Square to, Piece promoted) {
+            int captured = -1;
+            for (int i = 0; i < count; i++) {
+                captured = squares[i] == to ? i : captured;
+            }
+            std::copy(squares, squares + count, after);
+            after[moved] = to;
+            const Bitboard occupied_after = (occupied ^ get_single_bitboard(squares[moved])) | get_single_bitboard(to);
+            if (is_attacked(pieces, after, count, after[king], ~color, occupied_after, captured)) {
+                return;
+            }
+            if (captured < 0 && promoted == NoPiece) {
+                callback(pieces, after, count, true);
+                return;
+            }
+
+            Piece exit_pieces[MAX_PIECES];
+            Square exit_squares[MAX_PIECES];
+            int exit_count = 0;
+            for (int i = 0; i < count; i++) {
+                if (i != captured) {
+                    exit_pieces[exit_count] = i == moved && promoted != NoPiece ? promoted : pieces[i];
+                    exit_squares[exit_count++] = after[i];
+                }
+            }
+            callback(exit_pieces, exit_squares, exit_count, false);
+        };
+
+        for (int i = 0; i < count; i++) {
+            if (getPieceColor(pieces[i]) != color) {
+                continue;
+            }
+            const Square from = squares[i];
+            if (getPieceType(pieces[i]) != Pawn) {
+                Bitboard targets = attacks_from(pieces[i], from, occupied) & ~own;
+                while (targets) {
+                    play(i, bitScanForward(targets), NoPiece);
+                    targets &= targets - 1;
+                }
+                continue;
+            }
+
+            const int forward = color == WHITE ? 8 : -8;
+            const Square push = Square(from + forward);
+            const bool promotion = color == WHITE ? push >= 56 : push < 8;
+            Bitboard targets = attacks_from(pieces[i], from, occupied) & occupied & ~own;
+            if (!(occupied & get_single_bitboard(push))) {
+                targets |= get_single_bitboard(push);
+                const Square double_push = Square(push + forward);
+                if ((from >> 3) == (color == WHITE ? 1 : 6) && !(occupied & get_single_bitboard(double_push))) {
+                    play(i, double_push, NoPiece);
+                }
+            }
+            while (targets) {
+                const Square to = bitScanForward(targets);
+                targets &= targets - 1;
+                if (!promotion) {
+                    play(i, to, NoPiece);
+                    continue;
+                }
+                for (PieceType type : {Queen, Rook, Bishop, Knight}) {
+                    play(i, to, makePiece(type, color));
+                }
+            }
+        }
+    }
+
+    //Calls callback(squares) with every legal position color could have moved from to get here without capturing
+    //or promoting, which are the positions in the same table that lead here
+    template<typename Callback>
+    void for_each_unmove(const Piece *pieces, const Square *squares, int count, Color moved, const Callback &callback) {
+        const Bitboard occupied = occupancy(squares, count);
+        const int other_king = moved == WHITE ? 1 : 0;
+        Square before[MAX_PIECES];
+
+        for (int i = 0; i < count; i++) {
+            if (getPieceColor(pieces[i]) != moved) {
+                continue;
+            }
+            const Square to = squares[i];
+            Bitboard origins;
+            if (getPieceType(pieces[i]) == Pawn) {
+                const int backward = moved == WHITE ? -8 : 8;
+                const Square one = Square(to + backward);
+                const bool first_rank = moved == WHITE ? one < 8 : one >= 56;
+                origins = 0;
+                if (!first_rank && !(occupied & get_single_bitboard(one))) {
+                    origins |= get_single_bitboard(one);
+                    const Square two = Square(one + backward);
+                    if ((to >> 3) == (moved == WHITE ? 3 : 4) && !(occupied & get_single_bitboard(two))) {
+                        origins |= get_single_bitboard(two);
+                    }
+                }
+            } else {
+                origins = attacks_from(pieces[i], to, occupied) & ~occupied;
+            }
+
+            while (origins) {
+                const Square from = bitScanForward(origins);
+                origins &= origins - 1;
+                std::copy(squares, squares + count, before);
+                before[i] = from;
+                //It was moved's turn, so the other king can't have been in check
+                const Bitboard occupied_before = occupied ^ get_single_bitboard(to) ^ get_single_bitboard(from);
+                if (!is_attacked(pieces, before, count, before[other_king], moved, occupied_before)) {
+                    callback(before);
+                }
+            }
+        }
+    }
+
+    //Index of the pawn that moved two squares between before and after, or -1 if the move wasn't a double push
+    inline int double_pushed(const Piece *pieces, const Square *before, const Square *after, int count) {
+        for (int i = 0; i < count; i++) {
+            if (before[i] != after[i]) {
+                return getPieceType(pieces[i]) == Pawn && std::abs(before[i] - after[i]) == 16 ? i : -1;
+            }
+        }
+        return -1;
+    }
+
+    //Probes a table with pieces in any order. With flip, the position is the table's colors swapped and mirrored
+    uint8_t probe_oriented(const Table &table, const Piece *pieces, const Square *squares, int count, bool flip, Color color) {
+        Square arranged[MAX_PIECES];
+        bool used[MAX_PIECES] = {};
+        const Material &material = table.material();
+        for (int slot = 0; slot < material.count; slot++) {
+            for (int i = 0; i < count; i++) {
+                const Piece piece = flip ? Piece(pieces[i] ^ 8) : pieces[i];
+                if (!used[i] && piece == material.pieces[slot]) {
+                    used[i] = true;
+                    arranged[slot] = flip ? Square(squares[i] ^ 56) : squares[i];
+                    break;
+                }
+            }
+        }
+        return table.probe(arranged, flip ? ~color : color);
+    }
+
+    //Tables generated or loaded so far by signature
+    std::mutex registry_mutex;
+    std::map<std::string, std::unique_ptr<Table>> registry;
+    std::string directory = ".";
+
+    std::string table_path(const Material &material) {
+        return directory + "/" + material.name() + ".tb";
+    }
+
+    template<typename Function>
+    void parallel_for(size_t threads, uint64_t size, const Function &fn) {
+        std::atomic<uint64_t> next(0);
+        ExternalSort::runParallel(threads, [&](size_t thread) {
+            for (uint64_t begin = next.fetch_add(CHUNK); begin < size; begin = next.fetch_add(CHUNK)) {
+                fn(thread, begin, std::min(begin + CHUNK, size));
+            }
+        });
+    }
+
+    //Ranks a value for the side to move, higher is better. 0 means there's no value yet
+    inline int preference(uint8_t value) {
+        return isWin(value) ? 1000 - matePlies(value) : isLoss(value) ? 100 + matePlies(value) : value == DRAW ? 500 : 0;
+    }
+
+    //Blocks one thread decompressed most recently
+    struct BlockCache {
+        struct Entry {
+            uint64_t table = 0; //MappedTable id, 0 when empty
+            uint64_t block = 0;
+            uint64_t used = 0; //Clock at the last probe
+            uint8_t values[BLOCK_SIZE];
+        };
+
+        std::vector<Entry> entries = std::vector<Entry>(CACHE_BLOCKS);
+        uint64_t clock = 0;
+        uint64_t misses = 0; //Blocks decompressed, for the benchmark
+    };
+    thread_local BlockCache block_cache;
+    std::atomic<uint64_t> next_table_id{1};
+
+    //Memory mapped tables by signature, nullptr for ones that aren't on disk, guarded by registry_mutex
+    std::map<std::string, std::unique_ptr<MappedTable>> mapped_tables;
+
+    //Each thread remembers the table and orientation for each material key so probes don't lock
+    //Bumping the generation makes every thread forget them
+    struct Lookup {
+        const MappedTable *table;
+        bool flip;
+    };
+    struct LookupCache {
+        uint64_t generation = 0;
+        std::unordered_map<uint64_t, Lookup> lookups;
+    };
+    thread_local LookupCache lookup_cache;
+    std::atomic<uint64_t> generation{1};
+
+    Lookup find_mapped(uint64_t key) {
+        const uint64_t current = generation.load(std::memory_order_acquire);
+        if (lookup_cache.generation != current) {
+            lookup_cache.lookups.clear();
+            lookup_cache.generation = current;
+        }
+        const auto found = lookup_cache.lookups.find(key);
+        if (found != lookup_cache.lookups.end()) {
+            return found->second;
+        }
+
+        Piece pieces[MAX_PIECES];
+        int count = 0;
+        for (int piece = WhitePawn; piece <= BlackKing; piece++) {
+            for (uint64_t i = 0; i < ((key >> (4 * piece)) & 15) && count < MAX_PIECES; i++) {
+                pieces[count++] = Piece(piece);
+            }
+        }
+        Material material = Material::fromPieces(pieces, count);
+        const bool flip = material.needsColorFlip();
+        if (flip) {
+            material = material.colorFlipped();
+        }
+
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        const std::string name = material.name();
+        if (!mapped_tables.count(name)) {
+            std::unique_ptr<MappedTable> table = std::make_unique<MappedTable>(material);
+            mapped_tables[name] = table->open(table_path(material)) ? std::move(table) : nullptr;
+        }
+        const Lookup lookup = {mapped_tables[name].get(), flip};
+        lookup_cache.lookups[key] = lookup;
+        return lookup;
+    }
+
+    std::string make_fen(const Piece *pieces, const Square *squares, int count, Color color) {
+        Piece board[64] = {};
+        for (int i = 0; i < count; i++) {
+            board[squares[i]] = pieces[i];
+        }
+        std::string fen;
+        for (int rank = 7; rank >= 0; rank--) {
+            int empty = 0;
+            for (int file = 0; file < 8; file++) {
+                const Piece piece = board[rank * 8 + file];
+                if (piece == NoPiece) {
+                    empty++;
+                    continue;
+                }
+                if (empty) {
+                    fen += char('0' + empty);
+                    empty = 0;
+                }
+                fen += char(piece_letters[getPieceType(piece)] + (getPieceColor(piece) == BLACK ? 'a' - 'A' : 0));
+            }
+            if (empty) {
+                fen += char('0' + empty);
+            }
+            fen += rank ? "/" : "";
+        }
+        return fen + (color == WHITE ? " w - - 0 1" : " b - - 0 1");
+    }
+}
+
+bool Chess::probeDTM(Color color, int &wdl, int &plies) const {
+    const History &current = history[depth];
+    if (castling_rights(current.castling) || pop_count(all_bitboards<WHITE>() | all_bitboards<BLACK>()) > Tablebase::MAX_PIECES) {
+        return false;
+    }
+    //Tables store positions without an en passant capture, so one that can be taken right now isn't in them
+    if (current.en_passant_square) {
+        const Bitboard pawn = Bitboard(1) << current.en_passant_square;
+        const Bitboard beside = ((pawn << 1) & ~LEFT_COLUMN) | ((pawn >> 1) & ~RIGHT_COLUMN);
+        if (beside & bitboards[color == WHITE ? WhitePawn : BlackPawn]) {
+            return false;
+        }
+    }
+
+    uint64_t key = 0;
+    for (int piece = WhitePawn; piece <= BlackKing; piece++) {
+        key += uint64_t(pop_count(bitboards[piece])) << (4 * piece);
+    }
+    const uint8_t value = Tablebase::probe(bitboards, key, color);
+    if (value == Tablebase::ILLEGAL) {
+        return false;
+    }
+    wdl = Tablebase::isWin(value) ? 1 : Tablebase::isLoss(value) ? -1 : 0;
+    plies = value == Tablebase::DRAW ? 0 : Tablebase::matePlies(value);
+    return true;
+}
+
+bool Chess::probeWDL(Color color, int &wdl) const {
+    int plies;
+    return probeDTM(color, wdl, plies);
+}
+
+namespace Tablebase {
+    bool Material::parse(const std::string &name) {
+        const size_t split = name.find('v');
+        if (split == std::string::npos || split == 0 || split + 1 >= name.size() || name.size() - 1 > MAX_PIECES) {
+            return false;
+        }
+
+        Piece list[MAX_PIECES];
+        int size = 0;
+        for (size_t i = 0; i < name.size(); i++) {
+            if (i == split) {
+                continue;
+            }
+            const Color color = i < split ? WHITE : BLACK;
+            const char *letter = std::find(piece_letters + 1, piece_letters + 7, name[i]);
+            const bool first = i == 0 || i == split + 1;
+            if (letter == piece_letters + 7 || (*letter == 'K') != first) {
+                return false; //Each side is a king followed by other pieces
+            }
+            list[size++] = makePiece(PieceType(letter - piece_letters), color);
+        }
+        *this = fromPieces(list, size);
+        return true;
+    }
+
+    Material Material::fromPieces(const Piece *list, int size) {
+        Material material;
+        material.pieces[0] = WhiteKing;
+        material.pieces[1] = BlackKing;
+        material.count = 2;
+        for (Color color : {WHITE, BLACK}) {
+            const int first = material.count;
+            for (int i = 0; i < size; i++) {
+                if (getPieceColor(list[i]) == color && getPieceType(list[i]) != King) {
+                    material.pieces[material.count++] = list[i];
+                }
+            }
+            std::sort(material.pieces.begin() + first, material.pieces.begin() + material.count, std::greater<Piece>());
+        }
+        return material;
+    }
+
+    std::string Material::name() const {
+        std::string name = "K";
+        for (int i = 2; i < count; i++) {
+            if (getPieceColor(pieces[i]) == BLACK && getPieceColor(pieces[i - 1]) != BLACK) {
+                name += "vK";
+            }
+            name += piece_letters[getPieceType(pieces[i])];
+        }
+        if (count == 2 || getPieceColor(pieces[count - 1]) == WHITE) {
+            name += "vK";
+        }
+        return name;
+    }
+
+    bool Material::hasPawns() const {
+        for (int i = 2; i < count; i++) {
+            if (getPieceType(pieces[i]) == Pawn) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool Material::needsColorFlip() const {
+        //More pieces, then more material, then stronger pieces. Pieces are in order so the lists compare directly
+        std::vector<int> sides[2];
+        int values[2] = {0, 0};
+        for (int i = 2; i < count; i++) {
+            const Color color = getPieceColor(pieces[i]);
+            sides[color].push_back(getPieceType(pieces[i]));
+            values[color] += material_values[getPieceType(pieces[i])];
+        }
+        if (sides[WHITE].size() != sides[BLACK].size()) {
+            return sides[BLACK].size() > sides[WHITE].size();
+        }
+        if (values[WHITE] != values[BLACK]) {
+            return values[BLACK] > values[WHITE];
+        }
+        return sides[BLACK] > sides[WHITE];
+    }
+
+    Material Material::colorFlipped() const {
+        Piece list[MAX_PIECES];
+        for (int i = 0; i < count; i++) {
+            list[i] = Piece(pieces[i] ^ 8);
+        }
+        return fromPieces(list, count);
+    }
+
+    std::vector<Material> Material::reachable() const {
+        std::vector<Material> materials;
+        auto add = [&](const Piece *list, int size) {
+            if (size <= 2) {
+                return;
+            }
+            Material material = fromPieces(list, size);
+            if (material.needsColorFlip()) {
+                material = material.colorFlipped();
+            }
+            for (const Material &seen : materials) {
+                if (seen.pieces == material.pieces) {
+                    return;
+                }
+            }
+            materials.push_back(material);
+        };
+
+        Piece list[MAX_PIECES];
+        for (int taken = 2; taken < count; taken++) {
+            //Captures without promoting
+            int size = 0;
+            for (int i = 0; i < count; i++) {
+                if (i != taken) {
+                    list[size++] = pieces[i];
+                }
+            }
+            add(list, size);
+        }
+        for (int pawn = 2; pawn < count; pawn++) {
+            if (getPieceType(pieces[pawn]) != Pawn) {
+                continue;
+            }
+            const Color color = getPieceColor(pieces[pawn]);
+            for (PieceType type : {Queen, Rook, Bishop, Knight}) {
+                std::copy(pieces.begin(), pieces.begin() + count, list);
+                list[pawn] = makePiece(type, color);
+                add(list, count);
+
+                //Promoting with a capture
+                for (int taken = 2; taken < count; taken++) {
+                    if (getPieceColor(pieces[taken]) == color) {
+                        continue;
+                    }
+                    int size = 0;
+                    for (int i = 0; i < count; i++) {
+                        if (i != taken) {
+                            list[size++] = i == pawn ? makePiece(type, color) : pieces[i];
+                        }
+                    }
+                    add(list, size);
+                }
+            }
+        }
+        return materials;
+    }
+
+    Table::Table(const Material &material) : mat(material), pawns(material.hasPawns()) {
+        king_positions = pawns ? 32 * 64 : 462;
+        positions = king_positions;
+        for (int i = 2; i < mat.count; i++) {
+            if (groups.empty() || mat.pieces[groups.back().first] != mat.pieces[i]) {
+                const int squares = getPieceType(mat.pieces[i]) == Pawn ? 48 : 64;
+                groups.push_back(Group{i, 0, squares, 0});
+            }
+            groups.back().count++;
+        }
+        for (Group &group : groups) {
+            group.size = binomials.table[group.squares][group.count];
+            positions *= group.size;
+        }
+    }
+
+    uint64_t Table::encode(const Square *squares) const {
+        if (pawns) {
+            return encode_with(squares, (squares[0] & 7) > 3 ? 1 : 0);
+        }
+
+        //Moves the white king into the triangle
+        int symmetry = ((squares[0] & 7) > 3 ? 1 : 0) | ((squares[0] >> 3) > 3 ? 2 : 0);
+        Square king = transform(squares[0], symmetry);
+        if ((king >> 3) > (king & 7)) {
+            symmetry |= 4;
+            king = transform(squares[0], symmetry);
+        }
+        if ((king >> 3) == (king & 7)) {
+            //On the diagonal the black king decides, and if it's on the diagonal too both sides of it are tried
+            const Square black = transform(squares[1], symmetry);
+            if ((black >> 3) > (black & 7)) {
+                symmetry ^= 4;
+            } else if ((black >> 3) == (black & 7)) {
+                return std::min(encode_with(squares, symmetry), encode_with(squares, symmetry ^ 4));
+            }
+        }
+        return encode_with(squares, symmetry);
+    }
+
+    uint64_t Table::encode_with(const Square *squares, int symmetry) const {
+        Square moved[MAX_PIECES];
+        for (int i = 0; i < mat.count; i++) {
+            moved[i] = transform(squares[i], symmetry);
+        }
+
+        uint64_t index;
+        if (pawns) {
+            index = uint64_t((moved[0] >> 3) * 4 + (moved[0] & 7)) * 64 + moved[1];
+        } else {
+            const int pair = king_pairs.index[moved[0]][moved[1]];
+            if (pair < 0) {
+                return positions; //Kings next to each other
+            }
+            index = pair;
+        }
+
+        for (const Group &group : groups) {
+            //The combinatorial number system numbers each set of squares by its sorted squares
+            Square *first = moved + group.first;
+            std::sort(first, first + group.count);
+            uint64_t combination = 0;
+            for (int j = 0; j < group.count; j++) {
+                combination += binomials.table[first[j] - (group.squares == 48 ? 8 : 0)][j + 1];
+            }
+            index = index * group.size + combination;
+        }
+        return index;
+    }
+
+    void Table::decode(uint64_t index, Square *squares) const {
+        for (auto group = groups.rbegin(); group != groups.rend(); group++) {
+            uint64_t combination = index % group->size;
+            index /= group->size;
+            int square = group->squares - 1;
+            for (int j = group->count - 1; j >= 0; j--) {
+                while (binomials.table[square][j + 1] > combination) {
+                    square--;
+                }
+                combination -= binomials.table[square][j + 1];
+                squares[group->first + j] = Square(square + (group->squares == 48 ? 8 : 0));
+                square--;
+            }
+        }
+
+        if (pawns) {
+            squares[1] = Square(index % 64);
+            const uint64_t king = index / 64;
+            squares[0] = Square((king / 4) * 8 + king % 4);
+        } else {
+            squares[0] = king_pairs.squares[index][0];
+            squares[1] = king_pairs.squares[index][1];
+        }
+    }
+
+    bool Table::write(const std::string &path) const {
+        const uint64_t blocks = (2 * positions + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        std::vector<uint64_t> index((blocks + INDEX_INTERVAL - 1) / INDEX_INTERVAL);
+        std::vector<uint16_t> lengths(blocks);
+        std::vector<uint8_t> data;
+
+        uint8_t block[BLOCK_SIZE];
+        uint8_t last = DRAW;
+        for (uint64_t number = 0; number < blocks; number++) {
+            const size_t size = block_values(*this, number);
+            for (size_t i = 0; i < size; i++) {
+                const uint64_t value = number * BLOCK_SIZE + i;
+                const uint8_t stored = values[value >= positions][value >= positions ? value - positions : value];
+                last = stored == ILLEGAL ? last : stored;
+                block[i] = last;
+            }
+
+            if (number % INDEX_INTERVAL == 0) {
+                index[number / INDEX_INTERVAL] = data.size();
+            }
+            const size_t start = data.size();
+            compress_block(block, size, data);
+            if (data.size() - start >= size) {
+                data.resize(start);
+                data.insert(data.end(), block, block + size);
+            }
+            lengths[number] = uint16_t(data.size() - start);
+        }
+
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        FileHeader header = {};
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.count = uint32_t(mat.count);
+        const std::string name = mat.name();
+        std::memcpy(header.name, name.data(), std::min(name.size(), sizeof(header.name)));
+        header.positions = positions;
+        header.block_size = BLOCK_SIZE;
+        header.index_interval = INDEX_INTERVAL;
+        header.blocks = blocks;
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(index.data()), std::streamsize(index.size() * sizeof(uint64_t)));
+        out.write(reinterpret_cast<const char*>(lengths.data()), std::streamsize(lengths.size() * sizeof(uint16_t)));
+        const char padding[8] = {};
+        out.write(padding, std::streamsize((8 - lengths.size() * sizeof(uint16_t) % 8) % 8));
+        out.write(reinterpret_cast<const char*>(data.data()), std::streamsize(data.size()));
+        return bool(out);
+    }
+
+    bool Table::read(const std::string &path) {
+        MappedFile file;
+        const FileHeader *header;
+        const uint64_t *index;
+        const uint16_t *lengths;
+        const uint8_t *data;
+        if (!file.open(path) || !parse_file(reinterpret_cast<const uint8_t*>(file.data()), file.size(), *this, header, index, lengths, data)) {
+            return false;
+        }
+
+        for (Color color : {WHITE, BLACK}) {
+            values[color].resize(positions);
+        }
+        uint8_t block[BLOCK_SIZE];
+        for (uint64_t number = 0; number < header->blocks; number++) {
+            const size_t size = block_values(*this, number);
+            if (!read_block(data, index, lengths, number, block, size)) {
+                values[WHITE].clear();
+                values[BLACK].clear();
+                return false;
+            }
+            for (size_t i = 0; i < size; i++) {
+                const uint64_t value = number * BLOCK_SIZE + i;
+                values[value >= positions][value >= positions ? value - positions : value] = block[i];
+            }
+        }
+        return true;
+    }
+
+    bool MappedTable::open(const std::string &path) {
+        if (!file.open(path, MappedFile::RANDOM) ||
+            !parse_file(reinterpret_cast<const uint8_t*>(file.data()), file.size(), layout, header, index, lengths, data)) {
+            file.close();
+            return false;
+        }
+        id = next_table_id.fetch_add(1);
+        return true;
+    }
+
+    uint8_t MappedTable::probe(const Square *squares, Color color) const {
+        const uint64_t position = layout.encode(squares);
+        if (position >= layout.size()) {
+            return ILLEGAL;
+        }
+        const uint64_t value = color * layout.size() + position;
+        const uint8_t *values = block(value / BLOCK_SIZE);
+        return values ? values[value % BLOCK_SIZE] : ILLEGAL;
+    }
+
+    const uint8_t *MappedTable::block(uint64_t number) const {
+        BlockCache &cache = block_cache;
+        cache.clock++;
+        BlockCache::Entry *oldest = &cache.entries[0];
+        for (BlockCache::Entry &entry : cache.entries) {
+            if (entry.table == id && entry.block == number) {
+                entry.used = cache.clock;
+                return entry.values;
+            }
+            oldest = entry.used < oldest->used ? &entry : oldest;
+        }
+
+        cache.misses++;
+        if (!read_block(data, index, lengths, number, oldest->values, block_values(layout, number))) {
+            oldest->table = 0;
+            return nullptr;
+        }
+        oldest->table = id;
+        oldest->block = number;
+        oldest->used = cache.clock;
+        return oldest->values;
+    }
+
+    //Solves a table by retrograde analysis, one ply of distance to mate at a time
+    //
+    //Every position starts undecided with a counter of its distinct successors in the table, and the best value it
+    //can get by leaving the table. Positions decided at n plies are the frontier for the next step: a loss in n makes
+    //every predecessor a win in n + 1, and a win in n counts down each predecessor's counter. A predecessor whose
+    //moves in the table all lose is lost, as late as its worst move allows. Values found through captures and
+    //promotions wait in buckets until their distance comes up. Whatever is left at the end is a draw
+    //
+    //Positions are stored without en passant, but a double push next to an enemy pawn gives the other side the
+    //choice between the stored position and capturing, which leaves the table. Such a push is lost for the side that
+    //made it as soon as either one wins for the other side, so a winning capture counts the push down from its own
+    //bucket, and a loss after the push only wins for the pusher if the capture doesn't do better
+    //
+    //Decided positions and the frontiers are bitsets, and threads claim positions with an atomic or so each one is
+    //decided once
+    class Generator {
+      public:
+        Generator(Table &table, size_t threads) : table(table), threads(std::max<size_t>(threads, 1)), states(this->threads) {
+            for (const Material &material : table.mat.reachable()) {
+                subtables.push_back(find(material));
+            }
+            const auto first = table.mat.pieces.begin(), last = first + table.mat.count;
+            en_passant = std::count(first, last, WhitePawn) && std::count(first, last, BlackPawn);
+        }
+
+        bool run(GenerateStats &stats) {
+            for (const Table *subtable : subtables) {
+                if (!subtable) {
+                    return false;
+                }
+            }
+            const uint64_t size = table.positions;
+            const uint64_t words = (size + 63) / 64;
+            for (Color color : {WHITE, BLACK}) {
+                table.values[color].assign(size, 0);
+                counters[color] = std::vector<std::atomic<uint8_t>>(size);
+                decided[color] = std::vector<std::atomic<uint64_t>>(words);
+                frontier[color] = std::vector<std::atomic<uint64_t>>(words);
+                next[color] = std::vector<std::atomic<uint64_t>>(words);
+            }
+
+            parallel_for(threads, size, [&](size_t thread, uint64_t begin, uint64_t end) {
+                for (uint64_t index = begin; index < end; index++) {
+                    initialize(thread, index);
+                }
+            });
+
+            for (int plies = 0; plies <= MAX_PLIES; plies++) {
+                for (ThreadState &state : states) {
+                    for (const Pending &pending : state.pending[plies]) {
+                        if (claim(pending.color, pending.index)) {
+                            table.values[pending.color][pending.index] = pending.value;
+                            frontier[pending.color][pending.index >> 6] |= uint64_t(1) << (pending.index & 63);
+                            found++;
+                        }
+                    }
+                    std::vector<Pending>().swap(state.pending[plies]);
+                }
+                //Double pushes that a capture wins against now, unless the position after the push was won sooner
+                for (ThreadState &state : states) {
+                    for (const Passant &passant : state.passants[plies]) {
+                        const uint8_t after = table.values[~passant.color][passant.after];
+                        if (is_decided(passant.color, passant.index)
+                            || (is_decided(~passant.color, passant.after) && isWin(after) && matePlies(after) <= plies)) {
+                            continue;
+                        }
+                        lose(0, passant.color, passant.index, plies);
+                    }
+                    std::vector<Passant>().swap(state.passants[plies]);
+                }
+
+                if (found) {
+                    stats.longest = plies;
+                    stats.iterations++;
+                    found = 0;
+                    parallel_for(threads, words, [&](size_t thread, uint64_t begin, uint64_t end) {
+                        for (uint64_t word = begin; word < end; word++) {
+                            for (Color color : {WHITE, BLACK}) {
+                                for (uint64_t bits = frontier[color][word]; bits; bits &= bits - 1) {
+                                    propagate(thread, color, word * 64 + bitScanForward(bits), plies);
+                                }
+                            }
+                        }
+                    });
+                } else if (!waiting(plies)) {
+                    break;
+                }
+
+                for (Color color : {WHITE, BLACK}) {
+                    frontier[color].swap(next[color]);
+                    for (std::atomic<uint64_t> &word : next[color]) {
+                        word.store(0, std::memory_order_relaxed);
+                    }
+                }
+            }
+
+            //Anything undecided can avoid losing forever
+            for (Color color : {WHITE, BLACK}) {
+                for (uint64_t index = 0; index < size; index++) {
+                    if (!(decided[color][index >> 6] & (uint64_t(1) << (index & 63)))) {
+                        table.values[color][index] = DRAW;
+                    }
+                    const uint8_t value = table.values[color][index];
+                    stats.positions += value != ILLEGAL;
+                    stats.wins[color] += isWin(value);
+                    stats.draws[color] += value == DRAW;
+                    stats.losses[color] += isLoss(value);
+                }
+                std::vector<std::atomic<uint8_t>>().swap(counters[color]);
+                std::vector<std::atomic<uint64_t>>().swap(decided[color]);
+                std::vector<std::atomic<uint64_t>>().swap(frontier[color]);
+                std::vector<std::atomic<uint64_t>>().swap(next[color]);
+            }
+            return true;
+        }
+
+      private:
+        struct Pending {
+            uint64_t index;
+            uint8_t value;
+            Color color;
+        };
+
+        //A double push that an en passant capture wins against
+        struct Passant {
+            uint64_t index; //Before the push
+            uint64_t after; //After the push, as stored without the capture
+            Color color; //Side that pushed
+        };
+
+        //Per-thread state, padded so threads don't share cache lines
+        struct alignas(64) ThreadState {
+            std::vector<std::vector<Pending>> pending = std::vector<std::vector<Pending>>(MAX_PLIES + 2); //By plies
+            std::vector<std::vector<Passant>> passants = std::vector<std::vector<Passant>>(MAX_PLIES + 2); //By plies of the capture
+        };
+
+        inline bool is_decided(Color color, uint64_t index) const {
+            return decided[color][index >> 6].load(std::memory_order_relaxed) & (uint64_t(1) << (index & 63));
+        }
+
+        //Returns true if this call decided the position
+        inline bool claim(Color color, uint64_t index) {
+            const uint64_t bit = uint64_t(1) << (index & 63);
+            return !(decided[color][index >> 6].fetch_or(bit, std::memory_order_relaxed) & bit);
+        }
+
+        inline void decide(Color color, uint64_t index, uint8_t value) {
+            table.values[color][index] = value;
+            decided[color][index >> 6].fetch_or(uint64_t(1) << (index & 63), std::memory_order_relaxed);
+        }
+
+        inline void wait(size_t thread, Color color, uint64_t index, uint8_t value) {
+            states[thread].pending[matePlies(value)].push_back(Pending{index, value, color});
+        }
+
+        //True if any value is waiting for a distance past plies
+        bool waiting(int plies) const {
+            for (const ThreadState &state : states) {
+                for (int i = plies + 1; i < int(state.pending.size()); i++) {
+                    if (!state.pending[i].empty() || !state.passants[i].empty()) {
+                        return true;
+                    }
+                }
+            }
+            return false;
+        }
+
+        //Value for the side that moved of the position after a capture or promotion, with color to move
+        uint8_t exit_value(const Piece *pieces, const Square *squares, int count, Color color) const {
+            if (count == 2) {
+                return DRAW;
+            }
+            Material material = Material::fromPieces(pieces, count);
+            const bool flip = material.needsColorFlip();
+            if (flip) {
+                material = material.colorFlipped();
+            }
+            for (const Table *subtable : subtables) {
+                if (subtable->material().pieces == material.pieces) {
+                    const uint8_t value = probe_oriented(*subtable, pieces, squares, count, flip, color);
+                    return value >= 2 ? uint8_t(std::min(value + 1, 255)) : value;
+                }
+            }
+            return DRAW;
+        }
+
+        //Value for the side to move of its best en passant capture of the pawn that just made a double push, or 0
+        //if it has none
+        uint8_t passant_value(const Piece *pieces, const Square *squares, int count, int pawn) const {
+            const Color color = ~getPieceColor(pieces[pawn]);
+            const Square target = Square(squares[pawn] + (color == WHITE ? 8 : -8));
+            const Bitboard occupied = occupancy(squares, count);
+            uint8_t best = 0;
+            for (int i = 0; i < count; i++) {
+                if (pieces[i] != makePiece(Pawn, color) || (squares[i] >> 3) != (squares[pawn] >> 3)
+                    || std::abs((squares[i] & 7) - (squares[pawn] & 7)) != 1) {
+                    continue;
+                }
+                Square after[MAX_PIECES];
+                std::copy(squares, squares + count, after);
+                after[i] = target;
+                const Bitboard occupied_after = occupied ^ get_single_bitboard(squares[i]) ^ get_single_bitboard(squares[pawn]) ^ get_single_bitboard(target);
+                if (is_attacked(pieces, after, count, after[color == WHITE ? 0 : 1], ~color, occupied_after, pawn)) {
+                    continue;
+                }
+
+                Piece exit_pieces[MAX_PIECES];
+                Square exit_squares[MAX_PIECES];
+                int exit_count = 0;
+                for (int j = 0; j < count; j++) {
+                    if (j != pawn) {
+                        exit_pieces[exit_count] = pieces[j];
+                        exit_squares[exit_count++] = after[j];
+                    }
+                }
+                const uint8_t value = exit_value(exit_pieces, exit_squares, exit_count, ~color);
+                if (preference(value) > preference(best)) {
+                    best = value;
+                }
+            }
+            return best;
+        }
+
+        void initialize(size_t thread, uint64_t index) {
+            const Piece *pieces = table.mat.pieces.data();
+            const int count = table.mat.count;
+            Square squares[MAX_PIECES];
+            table.decode(index, squares);
+            const Bitboard occupied = occupancy(squares, count);
+
+            //Indices that don't decode to a real position, or that are stored under another index, are never used
+            if (pop_count(occupied) != count || table.encode(squares) != index) {
+                decide(WHITE, index, ILLEGAL);
+                decide(BLACK, index, ILLEGAL);
+                return;
+            }
+
+            for (Color color : {WHITE, BLACK}) {
+                //The side that just moved can't be in check
+                if (is_attacked(pieces, squares, count, squares[color == WHITE ? 1 : 0], color, occupied)) {
+                    decide(color, index, ILLEGAL);
+                    continue;
+                }
+
+                uint64_t successors[MAX_MOVES];
+                int size = 0;
+                Passant passants[MAX_MOVES];
+                int passant_count = 0;
+                bool moves = false;
+                uint8_t best_exit = 0;
+                for_each_move(pieces, squares, count, color, [&](const Piece *after_pieces, const Square *after, int after_count, bool in_table) {
+                    moves = true;
+                    if (in_table) {
+                        const uint64_t successor = table.encode(after);
+                        successors[size++] = successor;
+                        const int pawn = en_passant ? double_pushed(pieces, squares, after, count) : -1;
+                        const uint8_t passant = pawn < 0 ? 0 : passant_value(pieces, after, count, pawn);
+                        //Symmetric pushes can lead to the same index, which is only counted down once
+                        if (isWin(passant) && std::none_of(passants, passants + passant_count, [&](const Passant &p) { return p.after == successor; })) {
+                            passants[passant_count++] = Passant{index, successor, color};
+                            states[thread].passants[matePlies(passant)].push_back(passants[passant_count - 1]);
+                        }
+                        return;
+                    }
+                    const uint8_t value = exit_value(after_pieces, after, after_count, ~color);
+                    if (preference(value) > preference(best_exit)) {
+                        best_exit = value;
+                    }
+                });
+
+                if (!moves) {
+                    const bool check = is_attacked(pieces, squares, count, squares[color == WHITE ? 0 : 1], ~color, occupied);
+                    if (check) {
+                        decide(color, index, 2); //Mated
+                        frontier[color][index >> 6] |= uint64_t(1) << (index & 63);
+                        found++;
+                    } else {
+                        decide(color, index, DRAW);
+                    }
+                    continue;
+                }
+
+                //Symmetric moves can lead to the same index, which is only counted down once
+                std::sort(successors, successors + size);
+                size = int(std::unique(successors, successors + size) - successors);
+                counters[color][index].store(uint8_t(size), std::memory_order_relaxed);
+                table.values[color][index] = best_exit;
+                if (!size && best_exit == DRAW) {
+                    decide(color, index, DRAW);
+                } else if (isWin(best_exit) || (!size && isLoss(best_exit))) {
+                    wait(thread, color, index, best_exit);
+                }
+            }
+        }
+
+        void propagate(size_t thread, Color color, uint64_t index, int plies) {
+            const Piece *pieces = table.mat.pieces.data();
+            const int count = table.mat.count;
+            const uint8_t value = table.values[color][index];
+            const Color moved = ~color;
+            Square squares[MAX_PIECES];
+            table.decode(index, squares);
+
+            //Each with the value of color's en passant capture if it got here by a double push
+            std::pair<uint64_t, uint8_t> predecessors[MAX_MOVES];
+            int size = 0;
+            for_each_unmove(pieces, squares, count, moved, [&](const Square *before) {
+                const int pawn = en_passant ? double_pushed(pieces, before, squares, count) : -1;
+                predecessors[size++] = {table.encode(before), pawn < 0 ? uint8_t(0) : passant_value(pieces, squares, count, pawn)};
+            });
+            std::sort(predecessors, predecessors + size);
+            size = int(std::unique(predecessors, predecessors + size, [](const auto &a, const auto &b) { return a.first == b.first; }) - predecessors);
+
+            for (int i = 0; i < size; i++) {
+                const uint64_t predecessor = predecessors[i].first;
+                const uint8_t passant = predecessors[i].second;
+                if (is_decided(moved, predecessor)) {
+                    continue;
+                }
+                if (isLoss(value)) {
+                    //Capturing en passant instead is a draw or a win, or a loss that takes longer
+                    if (passant && !isLoss(passant)) {
+                        continue;
+                    }
+                    if (passant && matePlies(passant) > plies) {
+                        wait(thread, moved, predecessor, uint8_t(passant + 1));
+                        continue;
+                    }
+                    if (claim(moved, predecessor)) {
+                        table.values[moved][predecessor] = uint8_t(value + 1);
+                        next[moved][predecessor >> 6].fetch_or(uint64_t(1) << (predecessor & 63), std::memory_order_relaxed);
+                        found++;
+                    }
+                    continue;
+                }
+
+                //The capture already counted it down if it won sooner
+                if (isWin(passant) && matePlies(passant) < plies) {
+                    continue;
+                }
+                lose(thread, moved, predecessor, plies);
+            }
+        }
+
+        //Counts down a move of color at index that loses, with mate plies after it
+        void lose(size_t thread, Color color, uint64_t index, int plies) {
+            if (counters[color][index].fetch_sub(1, std::memory_order_relaxed) != 1) {
+                return;
+            }
+            //Every move in the table loses, so it's lost unless leaving the table does better
+            const uint8_t exit = table.values[color][index];
+            if (exit == DRAW || isWin(exit)) {
+                return;
+            }
+            const int distance = exit ? std::max(plies + 1, matePlies(exit)) : plies + 1;
+            if (distance > MAX_PLIES) {
+                return;
+            }
+            if (distance > plies + 1) {
+                wait(thread, color, index, uint8_t(2 + distance));
+            } else if (claim(color, index)) {
+                table.values[color][index] = uint8_t(2 + distance);
+                next[color][index >> 6].fetch_or(uint64_t(1) << (index & 63), std::memory_order_relaxed);
+                found++;
+            }
+        }
+
+        Table &table;
+        size_t threads;
+        std::vector<const Table*> subtables; //Tables captures and promotions lead to
+        bool en_passant; //Both sides have pawns, so double pushes can allow en passant
+        std::vector<std::atomic<uint8_t>> counters[2]; //Successors in the table not known to win
+        std::vector<std::atomic<uint64_t>> decided[2];
+        std::vector<std::atomic<uint64_t>> frontier[2]; //Decided at the current distance
+        std::vector<std::atomic<uint64_t>> next[2]; //Decided at the next distance
+        std::atomic<uint64_t> found{0}; //Positions added to the frontier or next
+        std::vector<ThreadState> states;
+    };
+
+    void setDirectory(const std::string &dir) {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        directory = dir.empty() ? "." : dir;
+        mapped_tables.clear();
+        generation++;
+    }
+
+    const Table *find(const Material &material) {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        const std::string name = material.name();
+        const auto found = registry.find(name);
+        if (found != registry.end()) {
+            return found->second.get();
+        }
+        std::unique_ptr<Table> table = std::make_unique<Table>(material);
+        if (!table->read(table_path(material))) {
+            return nullptr;
+        }
+        return (registry[name] = std::move(table)).get();
+    }
+
+    const Table *generate(const std::string &name, size_t threads, GenerateStats *stats) {
+        Material material;
+        if (!material.parse(name) || material.count < 3) {
+            return nullptr;
+        }
+        if (material.needsColorFlip()) {
+            material = material.colorFlipped();
+        }
+        if (const Table *table = find(material)) {
+            return table;
+        }
+        for (const Material &subtable : material.reachable()) {
+            if (!generate(subtable.name(), threads)) {
+                return nullptr;
+            }
+        }
+
+        std::unique_ptr<Table> table = std::make_unique<Table>(material);
+        GenerateStats local;
+        if (!Generator(*table, threads).run(stats ? *stats : local)) {
+            return nullptr;
+        }
+        if (!table->write(table_path(material))) {
+            cout << "Unable to write \"" << table_path(material) << "\".\n";
+        }
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        if (mapped_tables.count(material.name()) && !mapped_tables[material.name()]) {
+            //Probes found no file before, so they have to look again
+            mapped_tables.erase(material.name());
+            generation++;
+        }
+        return (registry[material.name()] = std::move(table)).get();
+    }
+
+    uint8_t probe(const Piece *pieces, const Square *squares, int count, Color color) {
+        Bitboard bitboards[15] = {};
+        uint64_t key = 0;
+        for (int i = 0; i < count; i++) {
+            bitboards[pieces[i]] |= get_single_bitboard(squares[i]);
+            key += uint64_t(1) << (4 * pieces[i]);
+        }
+        return count > MAX_PIECES ? ILLEGAL : probe(bitboards, key, color);
+    }
+
+    uint8_t probe(const Bitboard *bitboards, uint64_t key, Color color) {
+        if (key == (uint64_t(1) << (4 * WhiteKing)) + (uint64_t(1) << (4 * BlackKing))) {
+            return DRAW;
+        }
+        const Lookup lookup = find_mapped(key);
+        if (!lookup.table) {
+            return ILLEGAL;
+        }
+
+        //Identical pieces can go in any order, so each slot takes the next square of its piece
+        const Material &material = lookup.table->material();
+        Bitboard remaining[15];
+        std::copy(bitboards, bitboards + 15, remaining);
+        Square squares[MAX_PIECES];
+        for (int slot = 0; slot < material.count; slot++) {
+            const Piece piece = lookup.flip ? Piece(material.pieces[slot] ^ 8) : material.pieces[slot];
+            if (!remaining[piece]) {
+                return ILLEGAL;
+            }
+            const Square sq = bitScanForward(remaining[piece]);
+            remaining[piece] &= remaining[piece] - 1;
+            squares[slot] = lookup.flip ? Square(sq ^ 56) : sq;
+        }
+        return lookup.table->probe(squares, lookup.flip ? ~color : color);
+    }
+
+    int command(std::istringstream &stream) {
+        std::vector<std::string> names;
+        int max_pieces = 0;
+        size_t threads = 1;
+        std::vector<std::string> args;
+        std::string arg;
+        while (stream >> std::skipws >> arg) {
+            args.push_back(arg);
+        }
+
+        for (size_t i = 0; i < args.size(); i++) {
+            arg = args[i];
+            if (arg == "tables") {
+                //The list goes until the next option
+                while (i + 1 < args.size() && args[i + 1] != "pieces" && args[i + 1] != "dir" && args[i + 1] != "threads") {
+                    names.push_back(args[++i]);
+                }
+                continue;
+            }
+
+            const std::string value = i + 1 < args.size() ? args[++i] : "";
+            try {
+                if (arg == "pieces") {
+                    max_pieces = std::stoi(value);
+                    if (max_pieces < 3 || max_pieces > MAX_PIECES) {
+                        cout << "Tables have 3 to " << MAX_PIECES << " pieces.\n";
+                        return 1;
+                    }
+                } else if (arg == "dir") {
+                    setDirectory(value);
+                } else if (arg == "threads") {
+                    threads = std::stoull(value);
+                } else {
+                    cout << "Unknown option \"" << arg << "\".\n";
+                    return 1;
+                }
+            } catch (std::invalid_argument) {
+                cout << "Invalid value for " << arg << ". \"" << value << "\" was recived.\n";
+                return 1;
+            }
+        }
+
+        //Every material with up to max_pieces pieces, as each side's pieces strongest first
+        std::vector<Material> materials;
+        std::function<void(std::vector<Piece>&, int, Color, int)> add_pieces = [&](std::vector<Piece> &list, int left, Color color, int weakest) {
+            if (list.size() > 2) {
+                const Material material = Material::fromPieces(list.data(), int(list.size()));
+                if (!material.needsColorFlip()) {
+                    materials.push_back(material);
+                }
+            }
+            for (int type = weakest; type <= Queen && left; type++) {
+                list.push_back(makePiece(PieceType(type), color));
+                add_pieces(list, left - 1, color, type);
+                list.pop_back();
+            }
+            if (color == WHITE) {
+                //Black's pieces come after all of white's
+                for (int type = Pawn; type <= Queen && left; type++) {
+                    list.push_back(makePiece(PieceType(type), BLACK));
+                    add_pieces(list, left - 1, BLACK, type);
+                    list.pop_back();
+                }
+            }
+        };
+        if (max_pieces) {
+            std::vector<Piece> list = {WhiteKing, BlackKing};
+            add_pieces(list, max_pieces - 2, WHITE, Pawn);
+        }
+        for (const std::string &name : names) {
+            Material material;
+            if (!material.parse(name)) {
+                cout << "\"" << name << "\" isn't a material signature with up to " << MAX_PIECES << " pieces.\n";
+                return 1;
+            }
+            materials.push_back(material.needsColorFlip() ? material.colorFlipped() : material);
+        }
+        if (materials.empty()) {
+            cout << "Either tables or pieces is needed.\n";
+            return 1;
+        }
+        std::stable_sort(materials.begin(), materials.end(), [](const Material &a, const Material &b) {
+            return a.count < b.count;
+        });
+
+        //Tables a table depends on are generated first so each one's stats get printed
+        std::set<std::string> done;
+        std::function<bool(const Material&)> visit = [&](const Material &material) {
+            const std::string name = material.name();
+            if (material.count < 3 || !done.insert(name).second) {
+                return true;
+            }
+            for (const Material &subtable : material.reachable()) {
+                if (!visit(subtable)) {
+                    return false;
+                }
+            }
+            if (find(material)) {
+                cout << name << ": read from " << table_path(material) << '\n';
+                return true;
+            }
+
+            GenerateStats stats;
+            const auto start = std::chrono::steady_clock::now();
+            if (!generate(name, threads, &stats)) {
+                cout << "Unable to generate " << name << ".\n";
+                return false;
+            }
+            const int64_t time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+            cout << name << ": " << stats.positions << " positions in " << time << " ms, longest mate " << stats.longest << " plies, "
+                << stats.iterations << " iterations\n";
+            for (Color color : {WHITE, BLACK}) {
+                cout << "  " << (color == WHITE ? "White" : "Black") << " to move: " << stats.wins[color] << " wins, "
+                    << stats.draws[color] << " draws, " << stats.losses[color] << " losses\n";
+            }
+            const uint64_t bytes = uint64_t(std::ifstream(table_path(material), std::ios::binary | std::ios::ate).tellg());
+            const uint64_t raw = 2 * Table(material).size();
+            cout << "  Written to " << table_path(material) << ", " << bytes << " bytes, " << bytes * 100 / std::max<uint64_t>(raw, 1)
+                << "% of one byte per position\n";
+            cout << std::flush;
+            return true;
+        };
+        for (const Material &material : materials) {
+            if (!visit(material)) {
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    int probeCommand(std::istringstream &stream) {
+        std::string fen;
+        std::vector<std::string> names;
+        uint64_t probes = DEFAULT_PROBES;
+        std::vector<std::string> args;
+        std::string arg;
+        while (stream >> std::skipws >> arg) {
+            args.push_back(arg);
+        }
+
+        auto is_option = [](const std::string &arg) {
+            return arg == "dir" || arg == "fen" || arg == "bench" || arg == "probes";
+        };
+        for (size_t i = 0; i < args.size(); i++) {
+            arg = args[i];
+            if (arg == "fen" || arg == "bench") {
+                //Both go until the next option
+                while (i + 1 < args.size() && !is_option(args[i + 1])) {
+                    if (arg == "fen") {
+                        fen += args[++i] + ' ';
+                    } else {
+                        names.push_back(args[++i]);
+                    }
+                }
+                continue;
+            }
+
+            const std::string value = i + 1 < args.size() ? args[++i] : "";
+            try {
+                if (arg == "dir") {
+                    setDirectory(value);
+                } else if (arg == "probes") {
+                    probes = std::max<uint64_t>(std::stoull(value), 1);
+                } else {
+                    cout << "Unknown option \"" << arg << "\".\n";
+                    return 1;
+                }
+            } catch (std::invalid_argument) {
+                cout << "Invalid value for " << arg << ". \"" << value << "\" was recived.\n";
+                return 1;
+            }
+        }
+        if (fen.empty() && names.empty()) {
+            cout << "Either fen or bench is needed.\n";
+            return 1;
+        }
+
+        std::unique_ptr<Chess> game = std::make_unique<Chess>(); //Too big for the stack
+        if (!fen.empty()) {
+            const Color color = game->setFen(fen);
+            int wdl, plies;
+            if (!game->probeDTM(color, wdl, plies)) {
+                cout << "No table for this position.\n";
+            } else if (wdl) {
+                cout << (wdl > 0 ? "Win" : "Loss") << " for the side to move, mate in " << plies << " plies\n";
+            } else {
+                cout << "Draw\n";
+            }
+        }
+
+        //Random legal positions of each material, each probed once when its block probably isn't cached
+        //and then again when it is
+        for (size_t table = 0; table < names.size(); table++) {
+            Material material;
+            if (!material.parse(names[table]) || material.count < 3) {
+                cout << "\"" << names[table] << "\" isn't a material signature with 3 to " << MAX_PIECES << " pieces.\n";
+                return 1;
+            }
+            Xorshift random = Xorshift::forStream(0, table);
+            uint64_t cold = 0, warm = 0, done = 0;
+            const uint64_t misses = block_cache.misses;
+            int wdl, plies;
+            while (done < probes) {
+                Square squares[MAX_PIECES];
+                Bitboard occupied = 0;
+                for (int i = 0; i < material.count; i++) {
+                    const bool pawn = getPieceType(material.pieces[i]) == Pawn;
+                    do {
+                        squares[i] = Square(pawn ? 8 + random.below(48) : random.below(64));
+                    } while (occupied & get_single_bitboard(squares[i]));
+                    occupied |= get_single_bitboard(squares[i]);
+                }
+                const Color color = Color(random.below(2));
+                game->setFen(make_fen(material.pieces.data(), squares, material.count, color));
+                if ((king_masks[squares[0]] & get_single_bitboard(squares[1])) || (color == WHITE ? game->inCheck<BLACK>() : game->inCheck<WHITE>())) {
+                    continue;
+                }
+
+                const auto start = std::chrono::steady_clock::now();
+                const bool found = game->probeDTM(color, wdl, plies);
+                const auto middle = std::chrono::steady_clock::now();
+                game->probeDTM(color, wdl, plies);
+                const auto end = std::chrono::steady_clock::now();
+                if (!found) {
+                    cout << "No table for " << material.name() << " in the directory.\n";
+                    return 1;
+                }
+                if (done) { //The first probe opens the file
+                    cold += std::chrono::duration_cast<std::chrono::nanoseconds>(middle - start).count();
+                    warm += std::chrono::duration_cast<std::chrono::nanoseconds>(end - middle).count();
+                }
+                done++;
+            }
+
+            const uint64_t timed = std::max<uint64_t>(done - 1, 1);
+            cout << material.name() << ": " << done << " probes, " << cold / timed << " ns on new positions, " << warm / timed
+                << " ns probing the same position again, " << (block_cache.misses - misses) * 100 / done << "% decompressed a block\n";
+        }
+        cout << std::flush;
+        return 0;
+    }
+}
@@ -0,0 +1,180 @@
+#pragma once
+#include "game.h"
+#include "mapped_file.h"
+#include <array>
+#include <sstream>
+#include <string>
+#include <vector>
+
+//Endgame tablebases with exact distance to mate, generated by retrograde analysis
+//
+//A table covers one material signature like KQvKR with both sides to move, and stores one byte for each position:
+//ILLEGAL, DRAW, or 2 + the plies to mate. Wins are an odd number of plies away and losses an even number,
+//so the byte says both who wins and how long it takes. Castling is never possible in a table, and positions are
+//stored without an en passant capture, though double pushes still count the captures they allow
+//
+//Positions are indexed with symmetry. Without pawns the board can be flipped vertically, horizontally and along
+//the diagonal, so the white king is moved into the a1-d1-d4 triangle and the two kings are indexed together as one
+//of the 462 legal pairs. With pawns only the horizontal flip is allowed, which puts the white king on files a to d.
+//Identical pieces are indexed as a set with the combinatorial number system, so their order doesn't matter
+//
+//Files hold the values with white to move and then black to move, cut into blocks of BLOCK_SIZE values that are
+//compressed on their own, so a probe only decompresses one block. Illegal positions are never probed, so they take
+//the value before them to keep runs going. A sparse index gives where every INDEX_INTERVAL-th block starts and a
+//length for every block finds the rest. Numbers are stored in the machine's byte order
+namespace Tablebase {
+    constexpr int MAX_PIECES = 5;
+    constexpr char MAGIC[4] = {'T', 'B', 'Z', '1'};
+    constexpr uint32_t BLOCK_SIZE = 4096; //Values in a block
+    constexpr uint32_t INDEX_INTERVAL = 64; //Blocks between index entries
+    constexpr size_t CACHE_BLOCKS = 16; //Decompressed blocks kept by each thread
+
+    //Values from the side to move's point of view
+    constexpr uint8_t ILLEGAL = 0;
+    constexpr uint8_t DRAW = 1;
+    constexpr int MAX_PLIES = 253; //Longest mate a byte can hold
+
+    inline bool isWin(uint8_t value) {
+        return value >= 2 && (value & 1);
+    }
+    inline bool isLoss(uint8_t value) {
+        return value >= 2 && !(value & 1);
+    }
+    inline int matePlies(uint8_t value) { //Plies until mate for wins and losses
+        return value - 2;
+    }
+
+    //Pieces of a table in index order: the white king, the black king, then the other white pieces and the other
+    //black pieces, each strongest first
+    struct Material {
+        std::array<Piece, MAX_PIECES> pieces = {};
+        int count = 0;
+
+        //Reads a signature like KRPvKR. Returns false if it isn't one or has too many pieces
+        bool parse(const std::string &name);
+        //Puts any list of pieces into index order
+        static Material fromPieces(const Piece *pieces, int count);
+
+        std::string name() const;
+        bool hasPawns() const;
+        //Tables are stored with the stronger side as white. Returns true if this material is the other way around
+        bool needsColorFlip() const;
+        Material colorFlipped() const;
+        //Materials a capture or promotion can lead to in stored orientation, leaving out two bare kings
+        std::vector<Material> reachable() const;
+    };
+
+    class Table {
+      public:
+        explicit Table(const Material &material);
+
+        const Material &material() const {
+            return mat;
+        }
+        //Positions for each side to move, counting unused indices
+        uint64_t size() const {
+            return positions;
+        }
+
+        //Index of a position with squares in the material's order, after moving it into its canonical orientation
+        uint64_t encode(const Square *squares) const;
+        //Squares in the material's order of the canonical position at index
+        void decode(uint64_t index, Square *squares) const;
+
+        uint8_t probe(const Square *squares, Color color) const {
+            const uint64_t index = encode(squares);
+            return index < positions ? values[color][index] : ILLEGAL;
+        }
+
+        bool write(const std::string &path) const;
+        bool read(const std::string &path); //Decompresses the whole file into memory
+
+      private:
+        friend class Generator;
+
+        uint64_t encode_with(const Square *squares, int symmetry) const;
+
+        struct Group {
+            int first; //Index of the first piece of the group in the material
+            int count;
+            int squares; //64, or 48 for pawns which can't be on the first or last rank
+            uint64_t size;
+        };
+
+        Material mat;
+        bool pawns;
+        uint64_t king_positions;
+        std::vector<Group> groups;
+        uint64_t positions;
+        std::vector<uint8_t> values[2];
+    };
+
+    struct FileHeader {
+        char magic[4];
+        uint32_t count; //Pieces
+        char name[16];
+        uint64_t positions; //For each side to move
+        uint32_t block_size;
+        uint32_t index_interval;
+        uint64_t blocks;
+    };
+    static_assert(sizeof(FileHeader) == 48, "Headers are written as raw bytes");
+
+    //A table probed straight from a read-only memory map, so only the pages of the blocks that get probed are read
+    //Each thread keeps the last CACHE_BLOCKS blocks it decompressed, least recently used out first
+    class MappedTable {
+      public:
+        explicit MappedTable(const Material &material) : layout(material) {}
+
+        bool open(const std::string &path); //Returns false if it can't be opened or isn't a table for the material
+
+        const Material &material() const {
+            return layout.material();
+        }
+
+        uint8_t probe(const Square *squares, Color color) const;
+
+      private:
+        const uint8_t *block(uint64_t number) const; //Decompressed, nullptr if the block is corrupt
+
+        Table layout; //Only for the index, it has no values
+        MappedFile file;
+        const FileHeader *header = nullptr;
+        const uint64_t *index = nullptr;
+        const uint16_t *lengths = nullptr;
+        const uint8_t *data = nullptr;
+        uint64_t id = 0; //Names the table in the block caches, unlike its address it's never reused
+    };
+
+    struct GenerateStats {
+        uint64_t positions = 0; //Legal positions with either side to move
+        uint64_t wins[2] = {0, 0}; //For each side to move
+        uint64_t draws[2] = {0, 0};
+        uint64_t losses[2] = {0, 0};
+        int longest = 0; //Longest mate in plies
+        int iterations = 0;
+    };
+
+    //Tables are kept in memory once generated or loaded, and written to and read from dir as <signature>.tb
+    //Not safe to call while other threads are probing
+    void setDirectory(const std::string &dir);
+
+    //Generates the table for a material, and first any tables it can reach by captures and promotions that aren't
+    //in memory or on disk. Returns nullptr if the material can't be read
+    const Table *generate(const std::string &name, size_t threads, GenerateStats *stats = nullptr);
+
+    //Table for a material from memory or disk, nullptr if there isn't one. Doesn't generate anything
+    const Table *find(const Material &material);
+
+    //Value of any legal position with up to MAX_PIECES pieces in any order, for side to move color, from the memory
+    //mapped files. Flips colors when the weaker side is white. Two bare kings are a draw. ILLEGAL if there's no table
+    uint8_t probe(const Piece *pieces, const Square *squares, int count, Color color);
+    //The same from a board's bitboards indexed by Piece. key adds up each piece's count shifted 4 bits per Piece
+    uint8_t probe(const Bitboard *bitboards, uint64_t key, Color color);
+
+    //Command line entry points. Read options as name value pairs like UCI:
+    //tables <signature list> pieces <n> dir <dir> threads <n>
+    int command(std::istringstream &stream);
+    //dir <dir> fen <fen> bench <signature list> probes <n>
+    int probeCommand(std::istringstream &stream);
+}
@@ -0,0 +1,353 @@
+#include "training.h"
+#include "mapped_file.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <ostream>
+#include <thread>
+
+using std::cout;
+
+namespace {
+    constexpr int SCORE_K = 4; //Exp-Golomb parameter, score changes below 16 centipawns take 5 bits
+    constexpr size_t MAX_PLY_BYTES = 8; //An index of at most 8 bits and a score code of at most 31
+    constexpr uint16_t MAX_CHAIN_PLIES = MAX_GAME_LENGTH - 2; //The reader has to be able to make them all
+
+    //Bits needed to store an index below count
+    inline int index_bits(size_t count) {
+        int bits = 0;
+        while ((size_t(1) << bits) < count) {
+            bits++;
+        }
+        return bits;
+    }
+
+    inline uint32_t zigzag(int value) {
+        return value < 0 ? (uint32_t(-value) << 1) - 1 : uint32_t(value) << 1;
+    }
+
+    inline int unzigzag(uint32_t value) {
+        return (value & 1) ? -int((value + 1) >> 1) : int(value >> 1);
+    }
+
+    inline int clamp_score(int score) {
+        return std::clamp(score, -32767, 32767);
+    }
+
+    //Reads the bit stream of a chain. The chunk is padded with zeros so it can always look ahead
+    class BitReader {
+      public:
+        BitReader(const uint8_t *data, size_t size, size_t pos) : data(data), size(size), pos(pos) {}
+
+        inline uint64_t read(int bits) {
+            if (bits == 0) {
+                return 0;
+            }
+            refill();
+            const uint64_t value = buffer & ((uint64_t(1) << bits) - 1);
+            buffer >>= bits;
+            count -= bits;
+            return value;
+        }
+
+        inline uint32_t readExpGolomb() {
+            refill();
+            const int length = buffer ? bitScanForward(buffer) : 64;
+            if (length > 32) {
+                count = -1; //Can't come from the writer
+                return 0;
+            }
+            read(length + 1);
+            return uint32_t(((uint64_t(1) << (length + SCORE_K)) | read(length + SCORE_K)) - (uint64_t(1) << SCORE_K));
+        }
+
+        //Byte after the last one read from
+        inline size_t end() const {
+            return pos - count / 8;
+        }
+
+        inline bool failed() const {
+            return count < 0;
+        }
+
+      private:
+        inline void refill() {
+            while (count <= 56) {
+                buffer |= uint64_t(pos < size ? data[pos] : 0) << count;
+                pos++;
+                count += 8;
+            }
+        }
+
+        const uint8_t *data;
+        size_t size;
+        size_t pos;
+        uint64_t buffer = 0;
+        int count = 0;
+    };
+
+    //Per-thread checksum for the command, padded so threads don't share cache lines
+    struct alignas(64) Checksum {
+        uint64_t value = 0;
+    };
+}
+
+namespace Training {
+    Writer::Writer(std::ostream &out, std::mutex *lock) : out(out), lock(lock), chunk(CHUNK_SIZE, 0), used(sizeof(ChunkHeader)) {
+        std::memcpy(header.magic, CHUNK_MAGIC, sizeof(CHUNK_MAGIC));
+        header.bytes = header.chains = header.positions = 0;
+    }
+
+    Writer::~Writer() {
+        flush();
+    }
+
+    void Writer::write_bits(uint64_t value, int bits) {
+        bit_buffer |= value << bit_count;
+        bit_count += bits;
+        while (bit_count >= 8) {
+            chunk[used++] = uint8_t(bit_buffer);
+            bit_buffer >>= 8;
+            bit_count -= 8;
+        }
+    }
+
+    void Writer::end_chain() {
+        if (!in_chain) {
+            return;
+        }
+        if (bit_count) {
+            chunk[used++] = uint8_t(bit_buffer);
+        }
+        bit_buffer = 0;
+        bit_count = 0;
+        std::memcpy(chunk.data() + chain_start + offsetof(PackedPosition, reserved), &info, sizeof(info));
+        in_chain = false;
+    }
+
+    void Writer::start_chain(const Chess &game, Color color, int score, int result) {
+        end_chain();
+        if (used + sizeof(PackedPosition) + MAX_PLY_BYTES > CHUNK_SIZE) {
+            flush();
+        }
+
+        info = ChainInfo{int16_t(score), int8_t(result), uint8_t(std::min<int>(game.getDepth(), 255)), 0};
+        const PackedPosition packed = game.getPacked(color);
+        chain_start = used;
+        std::memcpy(chunk.data() + used, &packed, sizeof(packed));
+        used += sizeof(packed);
+        header.chains++;
+        in_chain = true;
+    }
+
+    void Writer::add(const Chess &game, Color color, int score, int result, Move played) {
+        score = clamp_score(score);
+
+        bool chained = false;
+        if (in_chain && played != Move() && result == info.result && info.plies < MAX_CHAIN_PLIES &&
+            used + (bit_count + 7) / 8 + MAX_PLY_BYTES <= CHUNK_SIZE) {
+            const Move *found = std::find(last_moves.begin(), last_moves.end(), played);
+            if (found != last_moves.end()) {
+                write_bits(found - last_moves.begin(), index_bits(last_moves.size()));
+
+                //Exp-Golomb: the length of the value in unary, then the value without its top bit
+                const uint64_t code = zigzag(score + last_score) + (uint64_t(1) << SCORE_K);
+                int length = 0;
+                while (code >> (length + SCORE_K + 1)) {
+                    length++;
+                }
+                write_bits(uint64_t(1) << length, length + 1);
+                write_bits(code & ((uint64_t(1) << (length + SCORE_K)) - 1), length + SCORE_K);
+
+                info.plies++;
+                chained = true;
+            }
+        }
+        if (!chained) {
+            start_chain(game, color, score, result);
+        }
+
+        last_score = score;
+        last_moves = color == WHITE ? game.getMoves<WHITE>() : game.getMoves<BLACK>();
+        header.positions++;
+        total_positions++;
+    }
+
+    void Writer::flush() {
+        end_chain();
+        if (header.positions) {
+            header.bytes = uint32_t(used);
+            std::memcpy(chunk.data(), &header, sizeof(header));
+            if (lock) {
+                std::lock_guard<std::mutex> guard(*lock);
+                out.write(reinterpret_cast<const char*>(chunk.data()), CHUNK_SIZE);
+            } else {
+                out.write(reinterpret_cast<const char*>(chunk.data()), CHUNK_SIZE);
+            }
+        }
+
+        std::fill(chunk.begin(), chunk.end(), 0);
+        used = sizeof(ChunkHeader);
+        header.chains = header.positions = 0;
+    }
+
+    void Stats::add(const Stats &other) {
+        chunks += other.chunks;
+        chains += other.chains;
+        positions += other.positions;
+        errors += other.errors;
+    }
+
+    Stats decodeChunk(const uint8_t *chunk, Chess &game, size_t thread, const Callback &callback) {
+        Stats stats;
+        ChunkHeader header;
+        std::memcpy(&header, chunk, sizeof(header));
+        if (std::memcmp(header.magic, CHUNK_MAGIC, sizeof(CHUNK_MAGIC)) != 0 || header.bytes > CHUNK_SIZE) {
+            stats.errors++;
+            return stats;
+        }
+        stats.chunks++;
+
+        Move played[MAX_GAME_LENGTH];
+        size_t pos = sizeof(header);
+        for (uint32_t chain = 0; chain < header.chains; chain++) {
+            if (pos + sizeof(PackedPosition) > header.bytes) {
+                stats.errors++;
+                return stats;
+            }
+            PackedPosition packed;
+            ChainInfo info;
+            std::memcpy(&packed, chunk + pos, sizeof(packed));
+            std::memcpy(&info, packed.reserved, sizeof(info));
+            pos += sizeof(packed);
+
+            Color color = game.setPacked(packed);
+            int score = info.score;
+            callback(Position{game, color, score, info.result, Move(), info.ply, thread});
+            stats.positions++;
+            stats.chains++;
+
+            BitReader bits(chunk, header.bytes, pos);
+            int ply = 0;
+            for (; ply < std::min<int>(info.plies, MAX_CHAIN_PLIES); ply++) {
+                const MoveArray moves = color == WHITE ? game.getMoves<WHITE>() : game.getMoves<BLACK>();
+                const size_t index = bits.read(index_bits(moves.size()));
+                score = unzigzag(bits.readExpGolomb()) - score;
+                if (index >= moves.size() || bits.failed()) {
+                    stats.errors++;
+                    break;
+                }
+
+                played[ply] = moves.begin()[index];
+                if (color == WHITE) {
+                    game.makeMove<WHITE>(played[ply]);
+                } else {
+                    game.makeMove<BLACK>(played[ply]);
+                }
+                color = ~color;
+                callback(Position{game, color, score, info.result, played[ply], info.ply + ply + 1, thread});
+                stats.positions++;
+            }
+            pos = bits.end();
+
+            for (int i = ply - 1; i >= 0; i--) {
+                color = ~color;
+                if (color == WHITE) {
+                    game.unmakeMove<WHITE>(played[i]);
+                } else {
+                    game.unmakeMove<BLACK>(played[i]);
+                }
+            }
+            if (ply < info.plies) {
+                return stats; //The rest of the chunk can't be trusted
+            }
+        }
+        return stats;
+    }
+
+    Stats read(std::string_view data, size_t threads, const Callback &callback) {
+        threads = std::max<size_t>(threads, 1);
+        const size_t chunks = data.size() / CHUNK_SIZE;
+        std::atomic<size_t> next {0};
+        std::vector<Stats> results(threads);
+
+        auto work = [&](size_t id) {
+            std::unique_ptr<Chess> game = std::make_unique<Chess>(); //Too big for the stack
+            for (size_t chunk = next++; chunk < chunks; chunk = next++) {
+                results[id].add(decodeChunk(reinterpret_cast<const uint8_t*>(data.data()) + chunk * CHUNK_SIZE, *game, id, callback));
+            }
+        };
+
+        std::vector<std::thread> helpers;
+        for (size_t i = 1; i < threads; i++) {
+            helpers.emplace_back(work, i);
+        }
+        work(0);
+        for (std::thread &helper : helpers) {
+            helper.join();
+        }
+
+        Stats stats;
+        for (const Stats &result : results) {
+            stats.add(result);
+        }
+        if (data.size() % CHUNK_SIZE) {
+            stats.errors++; //Cut off chunk at the end
+        }
+        return stats;
+    }
+
+    int command(std::istringstream &stream) {
+        std::string path;
+        size_t threads = 1;
+        std::string arg, value;
+        while (stream >> std::skipws >> arg) {
+            stream >> value;
+            try {
+                if (arg == "file") {
+                    path = value;
+                } else if (arg == "threads") {
+                    threads = std::stoull(value);
+                } else {
+                    cout << "Unknown option \"" << arg << "\".\n";
+                    return 1;
+                }
+            } catch (std::invalid_argument) {
+                cout << "Invalid value for " << arg << ". \"" << value << "\" was recived.\n";
+                return 1;
+            }
+        }
+
+        MappedFile file;
+        if (path.empty() || !file.open(path)) {
+            cout << "Unable to open \"" << path << "\".\n";
+            return 1;
+        }
+
+        //XOR of the keys of every position, the same as the pgn command gives for the games the data came from
+        std::vector<Checksum> checksums(std::max<size_t>(threads, 1));
+        auto callback = [&](const Position &position) {
+            checksums[position.thread].value ^= position.game.getKey();
+        };
+
+        const auto start = std::chrono::steady_clock::now();
+        const Stats stats = read(file.view(), threads, callback);
+        const int64_t time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+
+        uint64_t checksum = 0;
+        for (const Checksum &sum : checksums) {
+            checksum ^= sum.value;
+        }
+
+        cout << "Chunks: " << stats.chunks << ", chains: " << stats.chains << '\n';
+        cout << "Positions: " << stats.positions << " in " << time << " ms (" << uint64_t(stats.positions * 1000 / std::max<int64_t>(time, 1)) << " positions/s, "
+             << std::fixed << std::setprecision(2) << double(file.size()) / std::max<uint64_t>(stats.positions, 1) << " bytes/position)\n";
+        cout << "Errors: " << stats.errors << '\n';
+        cout << "Checksum: " << std::hex << std::setw(16) << std::setfill('0') << checksum << std::dec << std::setfill(' ') << std::endl;
+        return 0;
+    }
+}
@@ -0,0 +1,113 @@
+#pragma once
+#include "game.h"
+#include "packed.h"
+#include <functional>
+#include <iosfwd>
+#include <mutex>
+#include <sstream>
+#include <string_view>
+#include <vector>
+
+//Binary training data, stored as chains of positions from the same game
+//A chain starts with a whole PackedPosition. Every position after that only needs the index of the move played
+//into it out of getMoves and its score, which are packed into a few bits
+//
+//The file is a sequence of CHUNK_SIZE byte chunks that each hold whole chains, so any chunk can be decoded on its
+//own and a reader can split the chunks between threads:
+//  ChunkHeader, then the chains, then zeros up to CHUNK_SIZE
+//A chain is a PackedPosition with its reserved bytes holding the ChainInfo, then the plies as a bit stream
+//rounded up to a whole byte. Each ply is the move index in just enough bits for the number of legal moves,
+//then the score plus the score of the position before, zigzag and exp-Golomb coded
+//since the scores are from the side to move's point of view and barely change between plies
+namespace Training {
+    constexpr size_t CHUNK_SIZE = 1 << 16;
+    constexpr char CHUNK_MAGIC[4] = {'C', 'H', 'N', '1'};
+
+    struct ChunkHeader {
+        char magic[4];
+        uint32_t bytes; //Used bytes including this header
+        uint32_t chains;
+        uint32_t positions;
+    };
+
+    //Kept in PackedPosition::reserved at the start of a chain
+    struct ChainInfo {
+        int16_t score; //Of the first position
+        int8_t result; //Game result for white: 1 win, 0 draw, -1 loss
+        uint8_t ply; //Plies played in the game before the first position, up to 255
+        uint16_t plies; //Positions in the chain after the first
+    };
+    static_assert(sizeof(ChainInfo) == sizeof(PackedPosition::reserved), "ChainInfo has to fit in the reserved bytes");
+
+    //Builds chunks and writes whole ones to a stream. Several writers can share one stream by sharing a mutex,
+    //their chunks just get interleaved
+    class Writer {
+      public:
+        explicit Writer(std::ostream &out, std::mutex *lock = nullptr);
+        ~Writer(); //Writes whatever is left
+
+        //Adds the position game is in with its score from the side to move's point of view
+        //played is the move that led here from the position added before. Move() or a different result starts a new chain
+        void add(const Chess &game, Color color, int score, int result, Move played = Move());
+        void flush(); //Writes the chunk being built, even if it isn't full
+
+        uint64_t positions() const {
+            return total_positions;
+        }
+
+      private:
+        void start_chain(const Chess &game, Color color, int score, int result);
+        void end_chain();
+        void write_bits(uint64_t value, int bits);
+
+        std::ostream &out;
+        std::mutex *lock;
+        std::vector<uint8_t> chunk;
+        ChunkHeader header;
+        size_t used; //Whole bytes of the chunk used, not counting the bit buffer
+
+        //Chain being built
+        bool in_chain = false;
+        size_t chain_start; //Offset of the chain's PackedPosition in the chunk
+        ChainInfo info;
+        int last_score;
+        MoveArray last_moves; //Legal moves of the last position, for finding the index of the next move
+        uint64_t bit_buffer = 0;
+        int bit_count = 0;
+
+        uint64_t total_positions = 0;
+    };
+
+    //Handed to the callback for every position
+    struct Position {
+        const Chess &game;
+        Color color; //Side to move
+        int score; //From the side to move's point of view
+        int result; //For white: 1 win, 0 draw, -1 loss
+        Move played; //Move that led here from the position before, Move() at the start of a chain
+        int ply; //Plies played so far in the game
+        size_t thread; //So callbacks can keep per-thread state without locking
+    };
+
+    //Called from every thread at once
+    using Callback = std::function<void(const Position&)>;
+
+    struct Stats {
+        uint64_t chunks = 0;
+        uint64_t chains = 0;
+        uint64_t positions = 0;
+        uint64_t errors = 0; //Chunks with a bad header or a move index that isn't legal
+        void add(const Stats &other);
+    };
+
+    //Decodes one chunk, replaying the chains through makeMove on game. game is set up from scratch for every chain
+    //and left with its moves taken back, so it can be reused for the next chunk
+    Stats decodeChunk(const uint8_t *chunk, Chess &game, size_t thread, const Callback &callback);
+
+    //Decodes every chunk in data, split over the threads
+    Stats read(std::string_view data, size_t threads, const Callback &callback);
+
+    //Command line entry point. Reads options as name value pairs like UCI:
+    //file <data> threads <n>
+    int command(std::istringstream &stream);
+}
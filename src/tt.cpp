@@ -0,0 +1,83 @@
+#include "tt.h"
+#include <algorithm>
+
+TranspositionTable::TranspositionTable() : buckets(nullptr), bucket_count(0), generation(0) {
+    resize(16);
+}
+
+TranspositionTable::~TranspositionTable() {
+    delete[] buckets;
+}
+
+void TranspositionTable::resize(size_t megabytes) {
+    //Round down to a power of two number of buckets
+    size_t count = 1;
+    while (count * 2 * sizeof(Bucket) <= megabytes * 1024 * 1024) {
+        count *= 2;
+    }
+
+    delete[] buckets;
+    buckets = new Bucket[count];
+    bucket_count = count;
+    clear();
+}
+
+void TranspositionTable::clear() {
+    for (size_t i = 0; i < bucket_count; i++) {
+        for (Entry &entry : buckets[i].entries) {
+            entry.check.store(0, std::memory_order_relaxed);
+            entry.data.store(0, std::memory_order_relaxed);
+        }
+    }
+    generation = 0;
+}
+
+void TranspositionTable::store(uint64_t key, Move move, int score, int depth, Bound bound) {
+    Bucket &b = bucket(key);
+    Entry *replace = &b.entries[0];
+    int worst = 1 << 30;
+
+    for (Entry &entry : b.entries) {
+        const uint64_t data = entry.data.load(std::memory_order_relaxed);
+
+        if (!data) {
+            replace = &entry;
+            break;
+        }
+
+        if ((entry.check.load(std::memory_order_relaxed) ^ data) == key) {
+            //Same position. Don't write over a much deeper result from this search with a bound
+            const TTData old = unpack(data);
+            if (bound != BOUND_EXACT && depth + 3 < old.depth && entry_generation(data) == generation) {
+                return;
+            }
+            if (!move.raw()) {
+                move = old.move; //Keep the old move if there isn't a new one
+            }
+            replace = &entry;
+            break;
+        }
+
+        //Replace whatever is shallowest, counting entries from older searches as shallower
+        const int value = unpack(data).depth - 8 * uint8_t(generation - entry_generation(data));
+        if (value < worst) {
+            worst = value;
+            replace = &entry;
+        }
+    }
+
+    const uint64_t data = pack(TTData{move, int16_t(score), uint8_t(depth), bound}, generation);
+    replace->check.store(key ^ data, std::memory_order_relaxed);
+    replace->data.store(data, std::memory_order_relaxed);
+}
+
+int TranspositionTable::hashfull() const {
+    int used = 0;
+    for (size_t i = 0; i < 250 && i < bucket_count; i++) {
+        for (const Entry &entry : buckets[i].entries) {
+            const uint64_t data = entry.data.load(std::memory_order_relaxed);
+            used += data && entry_generation(data) == generation;
+        }
+    }
+    return used * 1000 / (std::min<size_t>(250, bucket_count) * BUCKET_SIZE);
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include "moves.h"
+#include <atomic>
+#include <cstddef>
+
+enum Bound : uint8_t {
+    BOUND_NONE = 0,
+    BOUND_UPPER = 1, //Score is at most this, the search failed low
+    BOUND_LOWER = 2, //Score is at least this, the search failed high
+    BOUND_EXACT = 3
+};
+
+//What gets stored for a position
+struct TTData {
+    Move move;
+    int16_t score;
+    uint8_t depth;
+    Bound bound;
+};
+
+//Transposition table shared between all the search threads without any locks
+//Each entry is stored as the key xor'd with the data alongside the data itself
+//If two threads write to the same entry at once, the halves won't match up and the probe just misses
+class TranspositionTable {
+  private:
+    struct Entry {
+        std::atomic<uint64_t> check; //key ^ data
+        std::atomic<uint64_t> data;
+    };
+
+    //Four entries fill a cache line so a probe only ever touches one line
+    static constexpr size_t BUCKET_SIZE = 4;
+    struct alignas(64) Bucket {
+        Entry entries[BUCKET_SIZE];
+    };
+
+    Bucket *buckets;
+    size_t bucket_count; //Always a power of two so the index is just a mask
+    uint8_t generation; //Bumped every search so old entries get replaced first
+
+    static inline uint64_t pack(const TTData &tt, uint8_t generation) {
+        return uint64_t(tt.move.raw()) | (uint64_t(uint16_t(tt.score)) << 16) | (uint64_t(tt.depth) << 32) |
+               (uint64_t(tt.bound) << 40) | (uint64_t(generation) << 48);
+    }
+
+    static inline TTData unpack(uint64_t data) {
+        return TTData{Move(uint16_t(data)), int16_t(uint16_t(data >> 16)), uint8_t(data >> 32), Bound((data >> 40) & 0b11)};
+    }
+
+    static inline uint8_t entry_generation(uint64_t data) {
+        return uint8_t(data >> 48);
+    }
+
+    inline Bucket &bucket(uint64_t key) const {
+        return buckets[key & (bucket_count - 1)];
+    }
+
+  public:
+    TranspositionTable();
+    ~TranspositionTable();
+
+    void resize(size_t megabytes);
+    void clear();
+
+    inline void newSearch() {
+        generation++;
+    }
+
+    inline bool probe(uint64_t key, TTData &tt) const {
+        for (const Entry &entry : bucket(key).entries) {
+            const uint64_t data = entry.data.load(std::memory_order_relaxed);
+            if ((entry.check.load(std::memory_order_relaxed) ^ data) == key && data) {
+                tt = unpack(data);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void store(uint64_t key, Move move, int score, int depth, Bound bound);
+
+    int hashfull() const; //Permill of the table used in this search, for UCI info
+};
@@ -1,39 +1,243 @@
 #include "uci.h"
 #include "perft.h"
+#include "search.h"
+#include "mcts.h"
+#include "mate.h"
+#include "nnue.h"
+#include "playout.h"
+#include "polyglot.h"
+#include <chrono>
+#include <atomic>
 #include <string>
 #include <sstream>
+#include <thread>
 #include <iostream>
 
 using std::string, std::istringstream, std::skipws, std::cout;
 
+namespace {
+    //Searches and perfts run on this thread so commands like stop can still be read while they're going
+    std::thread worker;
+    std::atomic<bool> stop_requested {false};
+
+    constexpr uint64_t DEFAULT_PLAYOUTS = 100000; //For go mcts without a node count
+
+    //Set with the BookFile option. go plays a move from it without searching while the position is in the book
+    Polyglot::Book book;
+    Xorshift book_rng(uint64_t(std::chrono::steady_clock::now().time_since_epoch().count()));
+
+    //Finds the legal move matching a move in UCI notation like e2e4 or e7e8q
+    //Returns an empty move if it isn't legal
+    template<Color color>
+    Move parse_move(const Chess &game, const string &uci) {
+        for (Move move : game.getMoves<color>()) {
+            if (move.UCI() == uci) {
+                return move;
+            }
+        }
+        return Move();
+    }
+}
+
 namespace UCI {
-    void go(istringstream &stream, Chess game, Color color) {
-        string arg, sdepth;
-        stream >> skipws >> arg;
-        if (arg == "perft") {
-            stream >> skipws >> sdepth;
+    void go(istringstream &stream, const Chess &game, Color color) {
+        string arg, sdepth, value;
+        Search::Limits limits;
+        bool mcts = false;
+        int mate = 0;
+        size_t threads = 1; //Only for MCTS, the alpha-beta search uses the Threads option
+
+        //Only one thing runs at once. Whatever is running is stopped rather than waited for, since an infinite search never ends on its own
+        stop();
+        stop_requested = false;
+
+        while (stream >> skipws >> arg) {
+            if (arg == "perft" || arg == "smpbench") {
+                stream >> skipws >> sdepth;
+                int depth;
+                try {
+                    depth = std::stoi(sdepth);
+                } catch (std::invalid_argument) {
+                    cout << "Invalid depth. \"" << sdepth << "\" was recived.";
+                    return;
+                }
+
+                if (arg == "perft") {
+                    worker = std::thread([game, color, depth]() { perft(game, color, depth, stop_requested); });
+                } else {
+                    worker = std::thread([game, color, depth]() { Search::threadScaling(game, color, depth, stop_requested); });
+                }
+                return;
+            } else if (arg == "infinite") {
+                limits.infinite = true;
+                continue;
+            } else if (arg == "mcts") {
+                mcts = true;
+                continue;
+            }
+
+            stream >> skipws >> value;
             try {
-                perft(game, color, std::stoi(sdepth));
+                if (arg == "depth") {
+                    limits.depth = std::stoi(value);
+                } else if (arg == "nodes") {
+                    limits.nodes = std::stoull(value);
+                } else if (arg == "movetime") {
+                    limits.movetime = std::stoll(value);
+                } else if (arg == "wtime") {
+                    limits.time[WHITE] = std::stoll(value);
+                } else if (arg == "btime") {
+                    limits.time[BLACK] = std::stoll(value);
+                } else if (arg == "winc") {
+                    limits.increment[WHITE] = std::stoll(value);
+                } else if (arg == "binc") {
+                    limits.increment[BLACK] = std::stoll(value);
+                } else if (arg == "movestogo") {
+                    limits.movestogo = std::stoi(value);
+                } else if (arg == "threads") {
+                    threads = std::stoull(value);
+                } else if (arg == "mate") {
+                    mate = std::stoi(value);
+                }
             } catch (std::invalid_argument) {
-                cout << "Invalid depth. \"" << sdepth << "\" was recived.";
+                cout << "Invalid value for " << arg << ". \"" << value << "\" was recived.\n";
+                return;
+            }
+        }
+
+        if (mate > 0) {
+            worker = std::thread([game, color, mate]() { Mate::go(game, color, mate, stop_requested); });
+            return;
+        }
+
+        if (book.isOpen() && !limits.infinite) {
+            const Move move = book.pick(game, color, book_rng.next());
+            if (move != Move()) {
+                cout << "info string book move\n";
+                cout << "bestmove " << move.UCI() << std::endl;
+                return;
             }
         }
+
+        if (mcts) {
+            const uint64_t playouts = limits.nodes ? limits.nodes : DEFAULT_PLAYOUTS;
+            worker = std::thread([game, color, playouts, threads]() { MCTS::go(game, color, playouts, threads, stop_requested); });
+            return;
+        }
+
+        worker = std::thread([position = game, color, limits]() mutable { Search::go(position, color, limits, stop_requested); });
+    }
+
+    void stop() {
+        stop_requested = true;
+        wait();
+    }
+
+    void wait() {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+
+    void uci() {
+        cout << "id name ChessnutChess\n";
+        cout << "id author ChessnutChess authors\n";
+        cout << "option name Hash type spin default 16 min 1 max 65536\n";
+        cout << "option name Threads type spin default 1 min 1 max 256\n";
+        cout << "option name EvalFile type string default <empty>\n";
+        cout << "option name BookFile type string default <empty>\n";
+        cout << "option name BookKeys type string default <empty>\n";
+        cout << "uciok" << std::endl;
+    }
+
+    void newGame() {
+        stop();
+        Search::clear();
+    }
+
+    void setoption(istringstream &stream) {
+        string arg, name, value;
+        stop(); //Can't resize the hash table under a search
+        stream >> skipws >> arg;
+        if (arg != "name") {
+            cout << "Expected \"name\" after setoption.\n";
+            return;
+        }
+
+        //Option names can have spaces in them so read until the value
+        while (stream >> skipws >> arg && arg != "value") {
+            name += (name.empty() ? "" : " ") + arg;
+        }
+        stream >> skipws >> value;
+
+        try {
+            if (name == "Hash") {
+                Search::setHash(std::stoull(value));
+            } else if (name == "Threads") {
+                Search::setThreads(std::stoull(value));
+            } else if (name == "EvalFile") {
+                if (NNUE::load(value)) {
+                    cout << "info string loaded " << value << '\n';
+                }
+            } else if (name == "BookFile") {
+                if (value.empty() || value == "<empty>") {
+                    book.close();
+                } else if (book.open(value)) {
+                    cout << "info string loaded " << value << " with " << book.size() << " entries\n";
+                } else {
+                    cout << "info string unable to open " << value << '\n';
+                }
+            } else if (name == "BookKeys") {
+                if (Polyglot::loadKeys(value)) {
+                    cout << "info string loaded " << value << '\n';
+                } else {
+                    cout << "info string unable to read " << Polyglot::KEY_COUNT << " keys from " << value << '\n';
+                }
+            } else {
+                cout << "No such option: " << name << '\n';
+            }
+        } catch (std::invalid_argument) {
+            cout << "Invalid value for " << name << ". \"" << value << "\" was recived.\n";
+        }
     }
 
     void position(istringstream &stream, Chess &game, Color &color) {
         string arg;
-        string fen, fen_end;
+        string fen, fen_part;
         stream >> skipws >> arg;
         if (arg == "startpos") {
             game = Chess();
             color = WHITE;
+            stream >> skipws >> arg;
         } else if (arg == "fen") {
-            stream >> skipws >> fen;
-            std::getline(stream, fen_end);
+            //The fen goes until the end of the line or the moves
+            while (stream >> skipws >> arg && arg != "moves") {
+                fen += arg + ' ';
+            }
             game = Chess();
-            color = game.setFen(fen + fen_end);
+            color = game.setFen(fen);
         } else {
             cout << "Unable to parse position input \"" << arg << "\".\n";
+            return;
+        }
+
+        if (arg != "moves") {
+            return;
+        }
+
+        while (stream >> skipws >> arg) {
+            Move move = color == WHITE ? parse_move<WHITE>(game, arg) : parse_move<BLACK>(game, arg);
+            if (!move.raw()) {
+                cout << "Illegal move \"" << arg << "\".\n";
+                return;
+            }
+
+            if (color == WHITE) {
+                game.makeMove<WHITE>(move);
+            } else {
+                game.makeMove<BLACK>(move);
+            }
+            color = ~color;
         }
     }
-}
\ No newline at end of file
+}
@@ -5,6 +5,13 @@
 using std::istringstream;
 
 namespace UCI {
-    void go(istringstream &stream, Chess game, Color color);
+    //Starts a search or perft on the worker thread and returns straight away
+    void go(istringstream &stream, const Chess &game, Color color);
+    void stop(); //Ends whatever the worker is doing and waits for it to finish
+    void wait(); //Waits for the worker to finish on its own
+
+    void uci();
+    void newGame();
     void position(istringstream &stream, Chess &game, Color &color);
+    void setoption(istringstream &stream);
 }
\ No newline at end of file
@@ -0,0 +1,53 @@
+#include "zobrist.h"
+
+//The keys are generated at compile time with splitmix64 from a fixed seed so every build hashes positions the same way
+namespace {
+    constexpr Bitboard splitmix64(Bitboard &state) {
+        Bitboard z = (state += 0x9E3779B97F4A7C15);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+        return z ^ (z >> 31);
+    }
+
+    constexpr std::array<std::array<Bitboard, 64>, 15> generate_piece_keys(Bitboard seed) {
+        std::array<std::array<Bitboard, 64>, 15> keys {};
+        for (int piece = 0; piece < 15; piece++) {
+            //Only real pieces get keys so xor'ing in an empty square does nothing
+            if ((piece & 0b111) == NoPieceType || (piece & 0b111) == 7) {
+                continue;
+            }
+            for (int sq = 0; sq < 64; sq++) {
+                keys[piece][sq] = splitmix64(seed);
+            }
+        }
+        return keys;
+    }
+
+    template<size_t N>
+    constexpr std::array<Bitboard, N> generate_keys(Bitboard seed) {
+        std::array<Bitboard, N> keys {};
+        for (size_t i = 0; i < N; i++) {
+            keys[i] = splitmix64(seed);
+        }
+        return keys;
+    }
+
+    constexpr std::array<Bitboard, 16> generate_castling_keys(Bitboard seed) {
+        //Every combination of rights is the xor of the keys of the single rights
+        std::array<Bitboard, 4> single = generate_keys<4>(seed);
+        std::array<Bitboard, 16> keys {};
+        for (int rights = 0; rights < 16; rights++) {
+            for (int i = 0; i < 4; i++) {
+                if (rights & (1 << i)) {
+                    keys[rights] ^= single[i];
+                }
+            }
+        }
+        return keys;
+    }
+}
+
+const std::array<std::array<Bitboard, 64>, 15> Zobrist::pieces = generate_piece_keys(0x2F6F6D7E3A1C5B49);
+const std::array<Bitboard, 16> Zobrist::castling = generate_castling_keys(0x7A3D1E5F9B2C4D61);
+const std::array<Bitboard, 8> Zobrist::en_passant = generate_keys<8>(0x5C1B9E2A7D4F3068);
+const Bitboard Zobrist::side = generate_keys<1>(0x1D8E4B7A2C6F9035)[0];
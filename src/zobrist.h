@@ -0,0 +1,26 @@
+#pragma once
+#include "bits.h"
+#include "piece.h"
+#include <array>
+
+//Random keys for hashing positions
+//Each part of the position gets its own key and a position's hash is all of its parts' keys xor'd together
+//That way makeMove only has to xor in the keys of whatever changed
+namespace Zobrist {
+    extern const std::array<std::array<Bitboard, 64>, 15> pieces; //Indexed by Piece so NoPiece and the unused indices are all 0
+    extern const std::array<Bitboard, 16> castling; //Indexed by castling_rights()
+    extern const std::array<Bitboard, 8> en_passant; //Indexed by the file of the en passant square
+    extern const Bitboard side; //Xor'd in when it's black to move
+}
+
+/**
+ * Packs the castling bitboard from History into 4 bits of castling rights
+ * Bit 0 is white short, bit 1 is white long, bit 2 is black short, bit 3 is black long
+ * A right is still there if neither the king nor that rook have moved, which is when their bits are 0
+*/
+inline uint8_t castling_rights(Bitboard castling) {
+    return uint8_t(!(castling & Bitboard(0x90))) |
+          (uint8_t(!(castling & Bitboard(0x11))) << 1) |
+          (uint8_t(!(castling & (Bitboard(0x90) << 56))) << 2) |
+          (uint8_t(!(castling & (Bitboard(0x11) << 56))) << 3);
+}
@@ -27,7 +27,21 @@ expect perft.exp "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - -" 6 11030083 > /dev/null
 expect perft.exp "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1" 5 15833292 > /dev/null
 expect perft.exp "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8" 5 89941194 > /dev/null
 expect perft.exp "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10" 5 164075551 > /dev/null
+expect perft.exp "rnbqkbnr/1pppp1pp/p7/4Pp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 3" 1 31 > /dev/null
+expect perft.exp "8/8/8/2k5/3Pp3/8/8/4K3 b - d3" 1 9 > /dev/null
+expect perft.exp "7n/5KP1/8/8/8/8/8/k7 w - - 0 1" 1 10 > /dev/null
+expect perft.exp "6b1/5P2/4K3/8/8/8/8/k7 w - - 0 1" 1 11 > /dev/null
+expect perft.exp "2b4k/3p4/8/4P3/6K1/8/8/8 b - - 0 1" 2 58 > /dev/null
 
 rm perft.exp
 
+# hasLegalMove has to agree with the move generator everywhere in the tree
+./main.exe legalcheck fen "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1" depth 4 > /dev/null
+./main.exe legalcheck fen "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq -" depth 3 > /dev/null
+./main.exe legalcheck fen "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - -" depth 5 > /dev/null
+./main.exe legalcheck fen "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1" depth 3 > /dev/null
+./main.exe legalcheck fen "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8" depth 3 > /dev/null
+./main.exe legalcheck fen "8/8/8/2k5/3Pp3/8/8/4K3 b - d3" depth 4 > /dev/null
+./main.exe legalcheck fen "2b4k/3p4/8/4P3/6K1/8/8/8 b - - 0 1" depth 4 > /dev/null
+
 echo "perft testing OK"
\ No newline at end of file